@@ -0,0 +1,778 @@
+/*****************************************************************************
+ * bench_corpus.c : parsing, decoding and DRCS benchmark over PES corpora
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Each file is either a stream of whole private_stream_1 PES packets, as
+ * bench/corpus holds, or a recording in MPEG-TS whose caption and
+ * superimposed text PES are picked out. Results are written as JSON on
+ * the standard output, one entry per benchmark and file. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "aribb24/aribb24.h"
+#include "aribb24/parser.h"
+#include "aribb24/decoder.h"
+
+/* every benchmark repeats over its file for at least that long */
+#define MIN_SECONDS 0.5
+#define TS_PACKET 188
+
+typedef struct
+{
+    const uint8_t *p_data; /* PES data packet, as arib_parse_pes() takes it */
+    size_t i_data;
+    int64_t i_pts;
+    int i_glyphs;          /* DRCS patterns it carries */
+} pes_t;
+
+typedef struct
+{
+    const char *psz_name;
+    uint8_t *p_file;
+    size_t i_file;
+
+    pes_t *p_pes;
+    size_t i_pes;
+    size_t i_pes_size;
+    uint8_t **pp_ts;        /* PES reassembled from TS packets */
+    size_t i_ts;
+} corpus_t;
+
+static double now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*****************************************************************************
+ * Loading
+ *****************************************************************************/
+/* DRCS patterns in the data units of a caption data group */
+static int count_glyphs( const uint8_t *p, size_t i_size )
+{
+    if( i_size < 3 )
+    {
+        return 0;
+    }
+    size_t i = 3 + ( p[2] & 0x0f ); /* PES_data_packet_header */
+    if( i + 5 > i_size )
+    {
+        return 0;
+    }
+    uint8_t i_group_id = p[i] >> 2;
+    size_t i_end = i + 5 + ( ( p[i + 3] << 8 ) | p[i + 4] );
+    i += 5;
+    if( i_group_id == 0x00 || i_group_id == 0x20 || i_end > i_size )
+    {
+        return 0;
+    }
+
+    /* statement data: TMD, optional STM, data_unit_loop_length */
+    int i_tmd = p[i] >> 6;
+    i += ( i_tmd == 1 || i_tmd == 2 ) ? 6 : 1;
+    i += 3;
+
+    int i_glyphs = 0;
+    while( i + 5 <= i_end && p[i] == 0x1f )
+    {
+        uint8_t i_parameter = p[i + 1];
+        size_t i_unit = ( p[i + 2] << 16 ) | ( p[i + 3] << 8 ) | p[i + 4];
+        size_t j = i + 5;
+        i = j + i_unit;
+        if( i_parameter != 0x30 && i_parameter != 0x31 )
+        {
+            continue;
+        }
+        if( i > i_end || j >= i )
+        {
+            break;
+        }
+        int i_codes = p[j++];
+        for( int c = 0; c < i_codes && j + 3 <= i; c++ )
+        {
+            int i_fonts = p[j + 2];
+            j += 3;
+            for( int f = 0; f < i_fonts && j + 1 <= i; f++ )
+            {
+                int i_mode = p[j] & 0x0f;
+                if( i_mode > 0x01 )
+                {
+                    if( j + 5 > i )
+                    {
+                        break;
+                    }
+                    j += 5 + ( ( p[j + 3] << 8 ) | p[j + 4] );
+                    continue;
+                }
+                if( j + 4 > i )
+                {
+                    break;
+                }
+                int i_depth = p[j + 1] + 2, i_bits = 1;
+                while( i_bits * i_bits < i_depth )
+                {
+                    i_bits++;
+                }
+                j += 4 + p[j + 2] * p[j + 3] * i_bits / 8;
+                i_glyphs++;
+            }
+        }
+    }
+    return i_glyphs;
+}
+
+/* Returns the size of the header of a synchronized (private_stream_1)
+ * or asynchronous (private_stream_2, no optional header) PES, or 0 */
+static size_t pes_header_size( const uint8_t *p, size_t i_size )
+{
+    if( i_size < 6 || p[0] || p[1] || p[2] != 0x01 )
+    {
+        return 0;
+    }
+    if( p[3] == 0xbf )
+    {
+        return 6;
+    }
+    if( p[3] == 0xbd && i_size >= 9 )
+    {
+        return 9 + p[8];
+    }
+    return 0;
+}
+
+static bool add_pes( corpus_t *p_corpus, const uint8_t *p, size_t i_size )
+{
+    size_t i_header = pes_header_size( p, i_size );
+    if( i_header == 0 || i_header >= i_size )
+    {
+        return true;
+    }
+    int64_t i_pts = -1;
+    if( p[3] == 0xbd && ( p[7] & 0x80 ) && p[8] >= 5 )
+    {
+        i_pts = ( (int64_t) ( p[9] & 0x0e ) << 29 ) | ( p[10] << 22 ) |
+                ( ( p[11] & 0xfe ) << 14 ) | ( p[12] << 7 ) | ( p[13] >> 1 );
+    }
+
+    if( p_corpus->i_pes == p_corpus->i_pes_size )
+    {
+        size_t i_new = p_corpus->i_pes_size ? p_corpus->i_pes_size * 2 : 256;
+        pes_t *p_new = (pes_t*) realloc( p_corpus->p_pes, i_new * sizeof(*p_new) );
+        if( p_new == NULL )
+        {
+            return false;
+        }
+        p_corpus->p_pes = p_new;
+        p_corpus->i_pes_size = i_new;
+    }
+    pes_t *p_pes = &p_corpus->p_pes[p_corpus->i_pes++];
+    p_pes->p_data = p + i_header;
+    p_pes->i_data = i_size - i_header;
+    p_pes->i_pts = i_pts;
+    p_pes->i_glyphs = count_glyphs( p_pes->p_data, p_pes->i_data );
+    return true;
+}
+
+static bool split_pes( corpus_t *p_corpus )
+{
+    const uint8_t *p = p_corpus->p_file;
+    size_t i_size = p_corpus->i_file;
+    size_t i = 0;
+    while( i + 6 <= i_size )
+    {
+        if( p[i] || p[i + 1] || p[i + 2] != 0x01 )
+        {
+            i++;
+            continue;
+        }
+        size_t i_packet = 6 + ( ( p[i + 4] << 8 ) | p[i + 5] );
+        if( i + i_packet > i_size )
+        {
+            break;
+        }
+        if( !add_pes( p_corpus, &p[i], i_packet ) )
+        {
+            return false;
+        }
+        i += i_packet;
+    }
+    return true;
+}
+
+static bool is_ts( const corpus_t *p_corpus )
+{
+    if( p_corpus->i_file < 3 * TS_PACKET )
+    {
+        return false;
+    }
+    for( int i = 0; i < 3; i++ )
+    {
+        if( p_corpus->p_file[i * TS_PACKET] != 0x47 )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef struct
+{
+    uint8_t *p;
+    size_t i;
+} ts_buffer_t;
+
+/* Keeps a complete caption or superimposed text PES, by its data
+ * identifier */
+static bool ts_flush( corpus_t *p_corpus, ts_buffer_t *p_buffer )
+{
+    const uint8_t *p = p_buffer->p;
+    size_t i_header = pes_header_size( p, p_buffer->i );
+    bool b_ok = true;
+    if( i_header != 0 && p_buffer->i > i_header &&
+        p_buffer->i >= 6u + ( ( p[4] << 8 ) | p[5] ) &&
+        ( p[i_header] == 0x80 || p[i_header] == 0x81 ) )
+    {
+        uint8_t **pp_ts = (uint8_t**) realloc( p_corpus->pp_ts,
+                ( p_corpus->i_ts + 1 ) * sizeof(*pp_ts) );
+        if( pp_ts != NULL )
+        {
+            p_corpus->pp_ts = pp_ts;
+            pp_ts[p_corpus->i_ts++] = p_buffer->p;
+            p_buffer->p = NULL;
+            b_ok = add_pes( p_corpus, p, 6 + ( ( p[4] << 8 ) | p[5] ) );
+        }
+        else
+        {
+            b_ok = false;
+        }
+    }
+    free( p_buffer->p );
+    p_buffer->p = NULL;
+    p_buffer->i = 0;
+    return b_ok;
+}
+
+/* private_stream_1 and private_stream_2 PES are reassembled on every PID */
+static bool split_ts( corpus_t *p_corpus )
+{
+    ts_buffer_t *p_buffers = (ts_buffer_t*) calloc( 8192, sizeof(*p_buffers) );
+    if( p_buffers == NULL )
+    {
+        return false;
+    }
+
+    bool b_ok = true;
+    for( size_t i = 0; b_ok && i + TS_PACKET <= p_corpus->i_file; i += TS_PACKET )
+    {
+        const uint8_t *p = &p_corpus->p_file[i];
+        /* sync byte, no transport error, with a payload */
+        if( p[0] != 0x47 || ( p[1] & 0x80 ) || !( p[3] & 0x10 ) )
+        {
+            continue;
+        }
+        ts_buffer_t *p_buffer = &p_buffers[( ( p[1] & 0x1f ) << 8 ) | p[2]];
+        size_t i_payload = 4;
+        if( p[3] & 0x20 )
+        {
+            i_payload += 1 + p[4];
+        }
+        if( i_payload >= TS_PACKET )
+        {
+            continue;
+        }
+
+        if( p[1] & 0x40 ) /* payload_unit_start_indicator */
+        {
+            const uint8_t *pes = &p[i_payload];
+            if( p_buffer->p != NULL && !ts_flush( p_corpus, p_buffer ) )
+            {
+                b_ok = false;
+                break;
+            }
+            if( TS_PACKET - i_payload < 4 || pes[0] || pes[1] ||
+                pes[2] != 0x01 || ( pes[3] != 0xbd && pes[3] != 0xbf ) )
+            {
+                continue;
+            }
+            p_buffer->p = (uint8_t*) malloc( 6 + 0xffff );
+            if( p_buffer->p == NULL )
+            {
+                b_ok = false;
+                break;
+            }
+        }
+        else if( p_buffer->p == NULL )
+        {
+            continue;
+        }
+
+        size_t i_copy = TS_PACKET - i_payload;
+        if( p_buffer->i + i_copy > 6 + 0xffff )
+        {
+            i_copy = 6 + 0xffff - p_buffer->i;
+        }
+        memcpy( &p_buffer->p[p_buffer->i], &p[i_payload], i_copy );
+        p_buffer->i += i_copy;
+    }
+
+    for( int i = 0; i < 8192; i++ )
+    {
+        if( p_buffers[i].p != NULL && !ts_flush( p_corpus, &p_buffers[i] ) )
+        {
+            b_ok = false;
+        }
+    }
+    free( p_buffers );
+    return b_ok;
+}
+
+static bool load_corpus( corpus_t *p_corpus, const char *psz_path )
+{
+    memset( p_corpus, 0, sizeof(*p_corpus) );
+    const char *psz_name = strrchr( psz_path, '/' );
+    p_corpus->psz_name = psz_name ? psz_name + 1 : psz_path;
+
+    FILE *fp = fopen( psz_path, "rb" );
+    if( fp == NULL )
+    {
+        fprintf( stderr, "cannot open %s\n", psz_path );
+        return false;
+    }
+    size_t i_read;
+    uint8_t buf[65536];
+    while( (i_read = fread( buf, 1, sizeof(buf), fp )) > 0 )
+    {
+        uint8_t *p_file = (uint8_t*) realloc( p_corpus->p_file,
+                                              p_corpus->i_file + i_read );
+        if( p_file == NULL )
+        {
+            fclose( fp );
+            return false;
+        }
+        p_corpus->p_file = p_file;
+        memcpy( &p_file[p_corpus->i_file], buf, i_read );
+        p_corpus->i_file += i_read;
+    }
+    fclose( fp );
+
+    /* PES lengths are trusted: a packet longer than the file is dropped */
+    if( is_ts( p_corpus ) ? !split_ts( p_corpus ) : !split_pes( p_corpus ) )
+    {
+        fprintf( stderr, "out of memory loading %s\n", psz_path );
+        return false;
+    }
+    return true;
+}
+
+static void free_corpus( corpus_t *p_corpus )
+{
+    for( size_t i = 0; i < p_corpus->i_ts; i++ )
+    {
+        free( p_corpus->pp_ts[i] );
+    }
+    free( p_corpus->pp_ts );
+    free( p_corpus->p_pes );
+    free( p_corpus->p_file );
+}
+
+/*****************************************************************************
+ * Benchmarks
+ *****************************************************************************/
+static bool b_first_result = true;
+
+static void print_string( const char *psz )
+{
+    putchar( '"' );
+    for( ; *psz; psz++ )
+    {
+        unsigned char c = *psz;
+        if( c == '"' || c == '\\' )
+        {
+            printf( "\\%c", c );
+        }
+        else if( c < 0x20 )
+        {
+            printf( "\\u%04x", c );
+        }
+        else
+        {
+            putchar( c );
+        }
+    }
+    putchar( '"' );
+}
+
+/* Opens a result object, to be closed by end_result() */
+static void begin_result( const corpus_t *p_corpus, const char *psz_benchmark,
+                          int i_passes, double f_seconds )
+{
+    printf( "%s\n    { \"benchmark\": ", b_first_result ? "" : "," );
+    b_first_result = false;
+    print_string( psz_benchmark );
+    printf( ", \"corpus\": " );
+    print_string( p_corpus->psz_name );
+    printf( ", \"passes\": %d, \"seconds\": %.6f", i_passes, f_seconds );
+}
+
+static void end_result( void )
+{
+    printf( " }" );
+}
+
+static arib_instance_t * new_instance( void )
+{
+    arib_instance_t *p_instance = arib_instance_new( NULL );
+    if( p_instance != NULL )
+    {
+        arib_set_log_level( p_instance, ARIB_LOG_ERROR );
+    }
+    return p_instance;
+}
+
+static size_t count_chars( const char *psz, size_t i_size )
+{
+    size_t i_chars = 0;
+    for( size_t i = 0; i < i_size; i++ )
+    {
+        i_chars += ( psz[i] & 0xc0 ) != 0x80;
+    }
+    return i_chars;
+}
+
+/* statement data groups */
+static bool is_statement( const pes_t *p_pes )
+{
+    if( p_pes->i_data < 3 )
+    {
+        return false;
+    }
+    size_t i_group = 3 + ( p_pes->p_data[2] & 0x0f );
+    if( i_group >= p_pes->i_data )
+    {
+        return false;
+    }
+    uint8_t i_group_id = p_pes->p_data[i_group] >> 2;
+    return i_group_id != 0x00 && i_group_id != 0x20;
+}
+
+static void bench_parse( const corpus_t *p_corpus )
+{
+    arib_instance_t *p_instance = new_instance();
+    arib_parser_t *p_parser = arib_get_parser( p_instance );
+    size_t i_bytes = 0;
+    for( size_t i = 0; i < p_corpus->i_pes; i++ )
+    {
+        i_bytes += p_corpus->p_pes[i].i_data;
+    }
+
+    int i_passes = 0;
+    double t = now(), f_seconds;
+    do
+    {
+        for( size_t i = 0; i < p_corpus->i_pes; i++ )
+        {
+            const pes_t *p_pes = &p_corpus->p_pes[i];
+            arib_parse_pes_pts( p_parser, p_pes->p_data, p_pes->i_data, p_pes->i_pts );
+        }
+        i_passes++;
+        f_seconds = now() - t;
+    } while( f_seconds < MIN_SECONDS );
+
+    begin_result( p_corpus, "parse", i_passes, f_seconds );
+    printf( ", \"pes\": %zu, \"bytes\": %zu, \"pes_per_s\": %.0f, \"mb_per_s\": %.3f",
+            p_corpus->i_pes, i_bytes, p_corpus->i_pes * i_passes / f_seconds,
+            i_bytes * (double) i_passes / f_seconds / 1e6 );
+    end_result();
+    arib_instance_destroy( p_instance );
+}
+
+/* Statement bodies of the corpus, decoded alone or as a player does right
+ * after parsing each PES */
+static void bench_decode( const corpus_t *p_corpus )
+{
+    arib_instance_t *p_instance = new_instance();
+    arib_parser_t *p_parser = arib_get_parser( p_instance );
+    arib_decoder_t *p_decoder = arib_get_decoder( p_instance );
+
+    size_t i_statements = 0, i_bytes = 0, i_max = 0;
+    unsigned char **pp_bodies = (unsigned char**) calloc( p_corpus->i_pes + 1,
+                                                          sizeof(*pp_bodies) );
+    size_t *pi_bodies = (size_t*) calloc( p_corpus->i_pes + 1, sizeof(*pi_bodies) );
+    if( pp_bodies == NULL || pi_bodies == NULL )
+    {
+        goto end;
+    }
+    for( size_t i = 0; i < p_corpus->i_pes; i++ )
+    {
+        const pes_t *p_pes = &p_corpus->p_pes[i];
+        arib_parse_pes_pts( p_parser, p_pes->p_data, p_pes->i_data, p_pes->i_pts );
+        size_t i_data;
+        const unsigned char *p_data = arib_parser_get_data( p_parser, &i_data );
+        if( !is_statement( p_pes ) || p_data == NULL || i_data == 0 )
+        {
+            continue;
+        }
+        pp_bodies[i_statements] = (unsigned char*) malloc( i_data );
+        if( pp_bodies[i_statements] == NULL )
+        {
+            goto end;
+        }
+        memcpy( pp_bodies[i_statements], p_data, i_data );
+        pi_bodies[i_statements++] = i_data;
+        i_bytes += i_data;
+        if( i_data > i_max )
+        {
+            i_max = i_data;
+        }
+    }
+    if( i_statements == 0 )
+    {
+        goto end;
+    }
+
+    /* a character is at most 4 bytes of UTF-8 */
+    size_t i_text_size = 4 * i_max + 1;
+    char *p_text = (char*) malloc( i_text_size );
+    if( p_text == NULL )
+    {
+        goto end;
+    }
+
+    size_t i_chars = 0;
+    int i_passes = 0;
+    double t = now(), f_seconds;
+    do
+    {
+        i_chars = 0;
+        for( size_t i = 0; i < i_statements; i++ )
+        {
+            arib_initialize_decoder_a_profile( p_decoder );
+            size_t i_text = arib_decode_buffer( p_decoder, pp_bodies[i], pi_bodies[i],
+                                                p_text, i_text_size );
+            i_chars += count_chars( p_text, i_text );
+        }
+        i_passes++;
+        f_seconds = now() - t;
+    } while( f_seconds < MIN_SECONDS );
+
+    begin_result( p_corpus, "decode", i_passes, f_seconds );
+    printf( ", \"statements\": %zu, \"bytes\": %zu, \"chars\": %zu, "
+            "\"mb_per_s\": %.3f, \"chars_per_s\": %.0f",
+            i_statements, i_bytes, i_chars,
+            i_bytes * (double) i_passes / f_seconds / 1e6,
+            i_chars * (double) i_passes / f_seconds );
+    end_result();
+
+    i_passes = 0;
+    t = now();
+    do
+    {
+        for( size_t i = 0; i < p_corpus->i_pes; i++ )
+        {
+            const pes_t *p_pes = &p_corpus->p_pes[i];
+            arib_parse_pes_pts( p_parser, p_pes->p_data, p_pes->i_data, p_pes->i_pts );
+            size_t i_data;
+            const unsigned char *p_data = arib_parser_get_data( p_parser, &i_data );
+            if( !is_statement( p_pes ) || p_data == NULL || i_data == 0 )
+            {
+                continue;
+            }
+            arib_initialize_decoder_a_profile( p_decoder );
+            arib_decode_buffer( p_decoder, p_data, i_data, p_text, i_text_size );
+        }
+        i_passes++;
+        f_seconds = now() - t;
+    } while( f_seconds < MIN_SECONDS );
+
+    begin_result( p_corpus, "pipeline", i_passes, f_seconds );
+    printf( ", \"pes\": %zu, \"pes_per_s\": %.0f, \"chars_per_s\": %.0f",
+            p_corpus->i_pes, p_corpus->i_pes * i_passes / f_seconds,
+            i_chars * (double) i_passes / f_seconds );
+    end_result();
+    free( p_text );
+
+end:
+    for( size_t i = 0; pp_bodies && i < i_statements; i++ )
+    {
+        free( pp_bodies[i] );
+    }
+    free( pp_bodies );
+    free( pi_bodies );
+    arib_finalize_decoder( p_decoder );
+    arib_instance_destroy( p_instance );
+}
+
+static void remove_tree( const char *psz_path )
+{
+    DIR *p_dir = opendir( psz_path );
+    if( p_dir != NULL )
+    {
+        struct dirent *p_entry;
+        while( (p_entry = readdir( p_dir )) != NULL )
+        {
+            if( !strcmp( p_entry->d_name, "." ) || !strcmp( p_entry->d_name, ".." ) )
+            {
+                continue;
+            }
+            char psz_entry[4096];
+            snprintf( psz_entry, sizeof(psz_entry), "%s/%s", psz_path, p_entry->d_name );
+            remove_tree( psz_entry );
+        }
+        closedir( p_dir );
+        rmdir( psz_path );
+    }
+    else
+    {
+        unlink( psz_path );
+    }
+}
+
+static int count_files( const char *psz_path )
+{
+    int i_files = 0;
+    DIR *p_dir = opendir( psz_path );
+    if( p_dir != NULL )
+    {
+        struct dirent *p_entry;
+        while( (p_entry = readdir( p_dir )) != NULL )
+        {
+            i_files += p_entry->d_name[0] != '.';
+        }
+        closedir( p_dir );
+    }
+    return i_files;
+}
+
+/* Hashing and glyph conversion of the DRCS patterns, then the same with
+ * a PNG file written for each pattern the base path has not seen */
+static void bench_drcs( const corpus_t *p_corpus )
+{
+    int i_glyphs = 0;
+    for( size_t i = 0; i < p_corpus->i_pes; i++ )
+    {
+        i_glyphs += p_corpus->p_pes[i].i_glyphs;
+    }
+    if( i_glyphs == 0 )
+    {
+        return;
+    }
+
+    char psz_base[] = "/tmp/aribb24-bench-XXXXXX";
+    if( mkdtemp( psz_base ) == NULL )
+    {
+        return;
+    }
+    for( int b_png = 0; b_png < 2; b_png++ )
+    {
+        arib_instance_t *p_instance = new_instance();
+        arib_parser_t *p_parser = arib_get_parser( p_instance );
+        int i_passes = 0, i_files = 0;
+        double f_seconds = 0.;
+        do
+        {
+            char psz_path[64];
+            if( b_png )
+            {
+                /* a fresh base path per pass, as patterns are written once */
+                snprintf( psz_path, sizeof(psz_path), "%s/%d", psz_base, i_passes );
+                mkdir( psz_path, 0700 );
+                snprintf( psz_path, sizeof(psz_path), "%s/%d/data", psz_base, i_passes );
+                mkdir( psz_path, 0700 );
+                psz_path[strlen( psz_path ) - 5] = '\0';
+                arib_set_base_path( p_instance, psz_path );
+            }
+            double t = now();
+            for( size_t i = 0; i < p_corpus->i_pes; i++ )
+            {
+                const pes_t *p_pes = &p_corpus->p_pes[i];
+                if( p_pes->i_glyphs > 0 )
+                {
+                    arib_parse_pes_pts( p_parser, p_pes->p_data, p_pes->i_data,
+                                        p_pes->i_pts );
+                }
+            }
+            f_seconds += now() - t;
+            if( b_png )
+            {
+                char psz_data[80];
+                snprintf( psz_data, sizeof(psz_data), "%s/data", psz_path );
+                i_files = count_files( psz_data );
+                remove_tree( psz_path );
+            }
+            i_passes++;
+        } while( f_seconds < MIN_SECONDS );
+        arib_instance_destroy( p_instance );
+
+        /* without libpng the library writes no image */
+        if( b_png && i_files == 0 )
+        {
+            break;
+        }
+        begin_result( p_corpus, b_png ? "drcs_png" : "drcs_hash", i_passes, f_seconds );
+        printf( ", \"glyphs\": %d", i_glyphs );
+        if( b_png )
+        {
+            printf( ", \"files\": %d", i_files );
+        }
+        printf( ", \"glyphs_per_s\": %.0f", i_glyphs * i_passes / f_seconds );
+        end_result();
+    }
+    remove_tree( psz_base );
+}
+
+int main( int argc, char **argv )
+{
+    if( argc < 2 )
+    {
+        fprintf( stderr, "usage: %s file.pes|file.ts...\n", argv[0] );
+        return 1;
+    }
+
+    printf( "{\n  \"results\": [" );
+    int i_ret = 0;
+    for( int i = 1; i < argc; i++ )
+    {
+        corpus_t corpus;
+        if( !load_corpus( &corpus, argv[i] ) )
+        {
+            i_ret = 1;
+        }
+        else if( corpus.i_pes == 0 )
+        {
+            fprintf( stderr, "no caption PES in %s\n", argv[i] );
+        }
+        else
+        {
+            bench_parse( &corpus );
+            bench_decode( &corpus );
+            bench_drcs( &corpus );
+        }
+        free_corpus( &corpus );
+    }
+    printf( "\n  ]\n}\n" );
+    return i_ret;
+}
@@ -0,0 +1,136 @@
+/*****************************************************************************
+ * bench_encode.c : UTF-8 to ARIB STD-B24 encoder benchmark
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "aribb24/aribb24.h"
+#include "aribb24/decoder.h"
+#include "aribb24/encoder.h"
+
+#define CHARS 4096
+#define ROUNDS 500
+
+static double now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Caption-like text as kanji set cells: words of kanji, hiragana,
+ * katakana or fullwidth alphanumerics, separated by punctuation */
+static size_t make_statement( unsigned char *p )
+{
+    unsigned char *p_start = p;
+    uint32_t i_seed = 1;
+    *p++ = 0x1b; *p++ = 0x24; *p++ = 0x42; /* G0 = kanji */
+    for( int i = 0; i < CHARS; )
+    {
+        i_seed = i_seed * 1103515245 + 12345;
+        uint32_t r = i_seed >> 8;
+        int i_kind = r % 8;
+        int i_word = 1 + ( r >> 3 ) % 4;
+        for( int j = 0; j < i_word; j++, i++ )
+        {
+            i_seed = i_seed * 1103515245 + 12345;
+            r = i_seed >> 8;
+            switch( i_kind )
+            {
+                case 0: case 1: case 2: /* kanji */
+                    *p++ = 0x30 + r % 16;
+                    *p++ = 0x21 + ( r >> 4 ) % 94;
+                    break;
+                case 3: case 4: case 5: /* hiragana */
+                    *p++ = 0x24;
+                    *p++ = 0x21 + ( r >> 4 ) % 83;
+                    break;
+                case 6: /* katakana */
+                    *p++ = 0x25;
+                    *p++ = 0x21 + ( r >> 4 ) % 86;
+                    break;
+                default: /* fullwidth letters */
+                    *p++ = 0x23;
+                    *p++ = 0x41 + ( r >> 4 ) % 26;
+                    break;
+            }
+        }
+        *p++ = 0x21; /* ideographic comma */
+        *p++ = 0x22;
+        i++;
+    }
+    return p - p_start;
+}
+
+int main( void )
+{
+    static unsigned char statement[3 + 4 * CHARS];
+    static char text[4 * CHARS + 1];
+    static unsigned char encoded[4 * CHARS];
+    static char check[4 * CHARS + 1];
+
+    arib_instance_t *p_instance = arib_instance_new( NULL );
+    arib_decoder_t *p_decoder = arib_get_decoder( p_instance );
+    arib_encoder_t *p_encoder = arib_encoder_new( p_instance );
+    if( p_encoder == NULL )
+    {
+        return 1;
+    }
+
+    size_t i_statement = make_statement( statement );
+    arib_initialize_decoder_a_profile( p_decoder );
+    size_t i_text = arib_decode_buffer( p_decoder, statement, i_statement,
+                                        text, sizeof(text) );
+    arib_finalize_decoder( p_decoder );
+
+    size_t i_consumed, i_written = 0;
+    double t = now();
+    for( int n = 0; n < ROUNDS; n++ )
+    {
+        arib_initialize_encoder_a_profile( p_encoder );
+        if( arib_encode_buffer( p_encoder, text, i_text, encoded, sizeof(encoded),
+                                &i_consumed, &i_written ) != ARIB_ENCODE_OK )
+        {
+            fprintf( stderr, "encoding failed at %zu\n", i_consumed );
+            return 1;
+        }
+    }
+    t = now() - t;
+
+    arib_initialize_decoder_a_profile( p_decoder );
+    arib_decode_buffer( p_decoder, encoded, i_written, check, sizeof(check) );
+    arib_finalize_decoder( p_decoder );
+    if( strcmp( text, check ) )
+    {
+        fprintf( stderr, "round trip mismatch\n" );
+        return 1;
+    }
+
+    printf( "encode       %zu bytes UTF-8 -> %zu bytes ARIB (kanji set only: %zu): "
+            "%.1f MB/s, %.1f Mchars/s\n",
+            i_text, i_written, i_statement, i_text * ROUNDS / t / 1e6,
+            (double) CHARS * ROUNDS / t / 1e6 );
+
+    arib_encoder_free( p_encoder );
+    arib_instance_destroy( p_instance );
+    return 0;
+}
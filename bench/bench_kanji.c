@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * bench_kanji.c : kanji conversion table lookup benchmark
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "aribb24/aribb24.h"
+#include "aribb24/decoder.h"
+
+#define CONVTABLE_KANJI 1
+#include "convtable.h"
+#include "convtable16.h"
+
+#define CHARS 4096
+#define ROUNDS 2000
+
+static double now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Caption-like mix: mostly JIS level 1 kanji and kana, some symbols */
+static void make_cells( uint8_t *p_ku, uint8_t *p_ten )
+{
+    uint32_t i_seed = 1;
+    for( int i = 0; i < CHARS; i++ )
+    {
+        i_seed = i_seed * 1103515245 + 12345;
+        uint32_t r = i_seed >> 8;
+        int i_kind = r % 10;
+        r /= 10;
+        if( i_kind < 5 )
+        {
+            p_ku[i] = 15 + r % 32; /* level 1 kanji */
+        }
+        else if( i_kind < 8 )
+        {
+            p_ku[i] = 3 + r % 2; /* hiragana, katakana */
+        }
+        else if( i_kind < 9 )
+        {
+            p_ku[i] = 0; /* punctuation */
+        }
+        else
+        {
+            p_ku[i] = 89 + r % 5; /* ARIB additional symbols */
+        }
+        p_ten[i] = ( r >> 8 ) % 94;
+    }
+}
+
+int main( void )
+{
+    static uint8_t ku[CHARS], ten[CHARS];
+    make_cells( ku, ten );
+
+    uint32_t i_sum = 0;
+    double t = now();
+    for( int n = 0; n < ROUNDS; n++ )
+    {
+        for( int i = 0; i < CHARS; i++ )
+        {
+            i_sum += decoder_kanji_table[ku[i]][ten[i]];
+        }
+    }
+    double t32 = now() - t;
+
+    uint32_t i_sum16 = 0;
+    t = now();
+    for( int n = 0; n < ROUNDS; n++ )
+    {
+        for( int i = 0; i < CHARS; i++ )
+        {
+            uint32_t uc = decoder_kanji_table16[ku[i] * 94 + ten[i]];
+            if( uc >= DECODER_KANJI_SUPPLEMENTARY && uc < 0xe000 )
+            {
+                uc = decoder_kanji_supplementary[0][uc - DECODER_KANJI_SUPPLEMENTARY];
+            }
+            i_sum16 += uc;
+        }
+    }
+    double t16 = now() - t;
+
+    if( i_sum != i_sum16 )
+    {
+        fprintf( stderr, "16-bit table mismatch\n" );
+        return 1;
+    }
+
+    double i_lookups = (double) CHARS * ROUNDS;
+    printf( "kanji table  uint32[94][94] %6zu bytes: %.2f ns/lookup\n",
+            sizeof(decoder_kanji_table), t32 * 1e9 / i_lookups );
+    printf( "kanji table  uint16[94*94]  %6zu bytes: %.2f ns/lookup\n",
+            sizeof(decoder_kanji_table16) + sizeof(decoder_kanji_supplementary[0]),
+            t16 * 1e9 / i_lookups );
+
+    /* the same cells through the decoder */
+    static unsigned char buf[3 + 2 * CHARS];
+    static char text[4 * CHARS + 1];
+    size_t i_buf = 0;
+    buf[i_buf++] = 0x1b; buf[i_buf++] = 0x24; buf[i_buf++] = 0x42; /* G0 = kanji */
+    for( int i = 0; i < CHARS; i++ )
+    {
+        /* undefined cells stop the decoder */
+        if( decoder_kanji_table[ku[i]][ten[i]] == 0 ||
+            ( ku[i] >= 89 && decoder_private_conv_table[ku[i] - 89][ten[i]] == 0 ) )
+        {
+            continue;
+        }
+        buf[i_buf++] = 0x21 + ku[i];
+        buf[i_buf++] = 0x21 + ten[i];
+    }
+
+    arib_instance_t *p_instance = arib_instance_new( NULL );
+    arib_decoder_t *p_decoder = arib_get_decoder( p_instance );
+    size_t i_text = 0;
+    t = now();
+    for( int n = 0; n < ROUNDS / 10; n++ )
+    {
+        arib_initialize_decoder_a_profile( p_decoder );
+        i_text = arib_decode_buffer( p_decoder, buf, i_buf, text, sizeof(text) );
+    }
+    double t_decode = now() - t;
+    printf( "decode       %zu bytes kanji statement, %zu bytes UTF-8: %.1f MB/s\n",
+            i_buf, i_text, i_buf * ( ROUNDS / 10 ) / t_decode / 1e6 );
+
+    arib_finalize_decoder( p_decoder );
+    arib_instance_destroy( p_instance );
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*****************************************************************************
+ * bench_profile.c : per profile statement decoding benchmark
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "aribb24/aribb24.h"
+#include "aribb24/decoder.h"
+
+/* three lines of caption text */
+#define CHARS 48
+#define ROUNDS 200000
+
+static double now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Kanji and hiragana with the A profile designations: kanji in G0 on GL,
+ * hiragana in G2 on GR */
+static size_t make_a_statement( unsigned char *p )
+{
+    unsigned char *p_start = p;
+    uint32_t i_seed = 1;
+    for( int i = 0; i < CHARS; i++ )
+    {
+        i_seed = i_seed * 1103515245 + 12345;
+        uint32_t r = i_seed >> 8;
+        if( r % 3 == 0 )
+        {
+            *p++ = 0x21 + 15 + ( r >> 2 ) % 31; /* level 1 kanji */
+            *p++ = 0x21 + ( r >> 8 ) % 94;
+        }
+        else
+        {
+            *p++ = 0xa1 + ( r >> 2 ) % 83;
+        }
+    }
+    return p - p_start;
+}
+
+/* Kanji and alphanumerics with the C profile designations: kanji in G2 on
+ * GR, alphanumerics in G1 locked into GL */
+static size_t make_c_statement( unsigned char *p )
+{
+    unsigned char *p_start = p;
+    uint32_t i_seed = 1;
+    *p++ = 0x0e; /* LS1 */
+    for( int i = 0; i < CHARS; i++ )
+    {
+        i_seed = i_seed * 1103515245 + 12345;
+        uint32_t r = i_seed >> 8;
+        if( r % 3 == 0 )
+        {
+            *p++ = 0x21 + ( r >> 2 ) % 94;
+        }
+        else
+        {
+            *p++ = 0xa1 + 15 + ( r >> 2 ) % 31; /* level 1 kanji */
+            *p++ = 0xa1 + ( r >> 8 ) % 94;
+        }
+    }
+    return p - p_start;
+}
+
+static size_t run( arib_decoder_t *p_decoder,
+                   void (*pf_init)( arib_decoder_t * ),
+                   const unsigned char *p_prefix, size_t i_prefix,
+                   const unsigned char *buf, size_t i_buf,
+                   char *text, size_t i_text_size, const char *psz_name )
+{
+    size_t i_text = 0;
+    double t = now();
+    for( int n = 0; n < ROUNDS; n++ )
+    {
+        pf_init( p_decoder );
+        if( i_prefix > 0 )
+        {
+            arib_decode_buffer( p_decoder, p_prefix, i_prefix, NULL, 0 );
+        }
+        i_text = arib_decode_buffer( p_decoder, buf, i_buf, text, i_text_size );
+    }
+    t = now() - t;
+    printf( "%-18s %zu bytes statement, %zu bytes UTF-8: %.1f MB/s\n",
+            psz_name, i_buf, i_text, i_buf * (double) ROUNDS / t / 1e6 );
+    return i_text;
+}
+
+int main( void )
+{
+    static unsigned char buf_a[2 * CHARS], buf_c[1 + 2 * CHARS];
+    static char text[4 * CHARS + 1], text_generic[4 * CHARS + 1];
+    size_t i_buf_a = make_a_statement( buf_a );
+    size_t i_buf_c = make_c_statement( buf_c );
+
+    arib_instance_t *p_instance = arib_instance_new( NULL );
+    arib_decoder_t *p_decoder = arib_get_decoder( p_instance );
+
+    run( p_decoder, arib_initialize_decoder_a_profile, NULL, 0,
+         buf_a, i_buf_a, text, sizeof(text), "a profile" );
+    size_t i_text = run( p_decoder, arib_initialize_decoder_c_profile,
+                         NULL, 0, buf_c, i_buf_c, text, sizeof(text),
+                         "c profile" );
+
+    /* the same C statement through the loop that handles macros, with the
+     * A profile geometry which wraps lines at about the same width */
+    static const unsigned char c_designations[] = {
+        0x1b, 0x28, 0x20, 0x41, /* G0 = DRCS-1 */
+        0x1b, 0x24, 0x2a, 0x42, /* G2 = kanji */
+    };
+    size_t i_text_generic = run( p_decoder, arib_initialize_decoder_a_profile,
+                                 c_designations, sizeof(c_designations),
+                                 buf_c, i_buf_c,
+                                 text_generic, sizeof(text_generic),
+                                 "c with macro loop" );
+    if( i_text != i_text_generic || memcmp( text, text_generic, i_text ) )
+    {
+        fprintf( stderr, "c profile output mismatch\n" );
+        return 1;
+    }
+
+    arib_finalize_decoder( p_decoder );
+    arib_instance_destroy( p_instance );
+    return 0;
+}
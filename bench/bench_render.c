@@ -0,0 +1,142 @@
+/*****************************************************************************
+ * bench_render.c : full frame caption rendering benchmark
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "aribb24/aribb24.h"
+#include "aribb24/decoder.h"
+#include "aribb24/render.h"
+
+#define FRAMES 200
+
+static double now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Ten full lines of kanji and kana, with a color change every few chars */
+static size_t make_caption( unsigned char *p )
+{
+    unsigned char *p_start = p;
+    for( int i_line = 0; i_line < 10; i_line++ )
+    {
+        *p++ = 0x1c; /* APS */
+        *p++ = 0x40 + i_line;
+        *p++ = 0x40;
+        for( int i = 0; i < 20; i++ )
+        {
+            if( i % 5 == 0 )
+            {
+                *p++ = 0x81 + ( i_line + i / 5 ) % 7; /* RDF..WHF */
+            }
+            if( i & 1 )
+            {
+                *p++ = 0x1b; *p++ = 0x24; *p++ = 0x42; /* G0 = kanji */
+                *p++ = 0x30 + i_line;
+                *p++ = 0x21 + i;
+            }
+            else
+            {
+                *p++ = 0x1b; *p++ = 0x28; *p++ = 0x4a; /* G0 = alphanumeric */
+                *p++ = 0x41 + i;
+            }
+        }
+    }
+    return p - p_start;
+}
+
+static void run( arib_renderer_t *p_renderer, arib_decoder_t *p_decoder,
+                 const char *psz_text, arib_surface_format_t i_format,
+                 const char *psz_name )
+{
+    arib_surface_t surface;
+    int i_bpp = i_format == ARIB_SURFACE_A8 ? 1 : 4;
+    surface.i_width = 1920;
+    surface.i_height = 1080;
+    surface.i_pitch = surface.i_width * i_bpp;
+    surface.i_format = i_format;
+    surface.p_pixels = malloc( (size_t) surface.i_pitch * surface.i_height );
+    if( surface.p_pixels == NULL )
+    {
+        return;
+    }
+
+    /* first frame fills the glyph cache */
+    memset( surface.p_pixels, 0, (size_t) surface.i_pitch * surface.i_height );
+    double t = now();
+    int i_chars = arib_render( p_renderer, p_decoder, psz_text, &surface );
+    double t_cold = now() - t;
+
+    t = now();
+    for( int i = 0; i < FRAMES; i++ )
+    {
+        memset( surface.p_pixels, 0, (size_t) surface.i_pitch * surface.i_height );
+        arib_render( p_renderer, p_decoder, psz_text, &surface );
+    }
+    double t_warm = ( now() - t ) / FRAMES;
+
+    printf( "%-8s 1920x1080 %d chars: cold %.3f ms, warm %.3f ms/frame\n",
+            psz_name, i_chars, t_cold * 1e3, t_warm * 1e3 );
+    free( surface.p_pixels );
+}
+
+int main( int argc, char **argv )
+{
+    const char *psz_font = argc > 1 && argv[1][0] ? argv[1] : NULL;
+
+    arib_instance_t *p_instance = arib_instance_new( NULL );
+    arib_decoder_t *p_decoder = arib_get_decoder( p_instance );
+    arib_renderer_t *p_renderer = arib_renderer_new( p_instance, psz_font );
+    if( p_renderer == NULL && psz_font != NULL )
+    {
+        fprintf( stderr, "cannot load font %s, "
+                         "drawing backgrounds only\n", psz_font );
+        psz_font = NULL;
+        p_renderer = arib_renderer_new( p_instance, NULL );
+    }
+    if( p_renderer == NULL )
+    {
+        fprintf( stderr, "cannot create renderer\n" );
+        return 1;
+    }
+    if( psz_font == NULL )
+    {
+        printf( "no font, drawing backgrounds only\n" );
+    }
+
+    unsigned char buf[4096];
+    size_t i_buf = make_caption( buf );
+    char text[8192];
+    arib_initialize_decoder_a_profile( p_decoder );
+    arib_decode_buffer( p_decoder, buf, i_buf, text, sizeof(text) );
+
+    run( p_renderer, p_decoder, text, ARIB_SURFACE_ARGB32, "argb32" );
+    run( p_renderer, p_decoder, text, ARIB_SURFACE_A8, "a8" );
+
+    arib_finalize_decoder( p_decoder );
+    arib_renderer_free( p_renderer );
+    arib_instance_destroy( p_instance );
+    return 0;
+}
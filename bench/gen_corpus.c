@@ -0,0 +1,790 @@
+/*****************************************************************************
+ * gen_corpus.c : synthetic ARIB STD-B24 caption corpus generator
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Writes caption statements for the A profile, as whole PES packets with
+ * caption management data ahead, or as bare statement bodies. The output
+ * only depends on the options and the seed, so a corpus or a bug report
+ * is reproduced from its command line. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "aribb24/aribb24.h"
+#include "aribb24/writer.h"
+
+enum
+{
+    TEXT_KANJI,
+    TEXT_HIRAGANA,
+    TEXT_KATAKANA,
+    TEXT_ALNUM,
+    TEXT_DRCS,
+    TEXT_COUNT
+};
+
+enum
+{
+    CONTROL_C0,    /* positioning, shifts, CS, NUL, BEL, CAN, RS */
+    CONTROL_C1,    /* colors, sizes, COL, FLC, CDC, POL, WMM, HLC, RPC... */
+    CONTROL_CSI,   /* every CSI final byte the decoder knows */
+    CONTROL_SZX,
+    CONTROL_ESC,   /* designations and locking shifts */
+    CONTROL_MACRO, /* default macros and macro definitions */
+    CONTROL_TIME,
+    CONTROL_COUNT
+};
+
+static const char * const text_names[TEXT_COUNT] = {
+    "kanji", "hiragana", "katakana", "alnum", "drcs",
+};
+static const char * const control_names[CONTROL_COUNT] = {
+    "c0", "c1", "csi", "szx", "esc", "macro", "time",
+};
+
+/* default macro 0x60: the A profile designations and invocations */
+static const uint8_t gen_designations[] = {
+    0x1b, 0x24, 0x39, 0x1b, 0x29, 0x4a, 0x1b, 0x2a, 0x30,
+    0x1b, 0x2b, 0x20, 0x70, 0x0f, 0x1b, 0x7d,
+};
+
+#define GEN_DRCS_MAX 94
+#define GEN_PES_MAX ( 6 + 0xffff )
+
+typedef struct
+{
+    uint64_t i_rng;
+
+    int i_statements;
+    int i_chars_min;
+    int i_chars_max;
+    int i_control_rate;  /* controls per 100 characters */
+    int text_weights[TEXT_COUNT];
+    int control_weights[CONTROL_COUNT];
+    int i_drcs;          /* DRCS patterns per statement */
+    int i_regions;       /* forced regions per statement */
+    int i_management;    /* statements between management data */
+    bool b_body;
+
+    /* statement being written */
+    uint8_t *p_body;
+    size_t i_body;
+    size_t i_body_size;
+    bool b_alnum;        /* G1 locked into GL */
+} gen_t;
+
+/* xorshift64* */
+static uint32_t gen_rand( gen_t *p_gen )
+{
+    p_gen->i_rng ^= p_gen->i_rng >> 12;
+    p_gen->i_rng ^= p_gen->i_rng << 25;
+    p_gen->i_rng ^= p_gen->i_rng >> 27;
+    return ( p_gen->i_rng * UINT64_C(2685821657736338717) ) >> 32;
+}
+
+static int gen_range( gen_t *p_gen, int i_min, int i_max )
+{
+    return i_min + gen_rand( p_gen ) % ( i_max - i_min + 1 );
+}
+
+static int gen_pick( gen_t *p_gen, const int *p_weights, int i_count )
+{
+    int i_total = 0;
+    for( int i = 0; i < i_count; i++ )
+    {
+        i_total += p_weights[i];
+    }
+    int r = gen_rand( p_gen ) % i_total;
+    for( int i = 0; i < i_count; i++ )
+    {
+        if( r < p_weights[i] )
+        {
+            return i;
+        }
+        r -= p_weights[i];
+    }
+    return 0;
+}
+
+static void gen_put( gen_t *p_gen, const uint8_t *p, size_t i_size )
+{
+    if( p_gen->i_body + i_size > p_gen->i_body_size )
+    {
+        size_t i_new = p_gen->i_body_size ? p_gen->i_body_size * 2 : 4096;
+        while( i_new < p_gen->i_body + i_size )
+        {
+            i_new *= 2;
+        }
+        uint8_t *p_body = (uint8_t*) realloc( p_gen->p_body, i_new );
+        if( p_body == NULL )
+        {
+            fprintf( stderr, "out of memory\n" );
+            exit( 1 );
+        }
+        p_gen->p_body = p_body;
+        p_gen->i_body_size = i_new;
+    }
+    memcpy( &p_gen->p_body[p_gen->i_body], p, i_size );
+    p_gen->i_body += i_size;
+}
+
+static void gen_byte( gen_t *p_gen, uint8_t i_byte )
+{
+    gen_put( p_gen, &i_byte, 1 );
+}
+
+static void gen_bytes( gen_t *p_gen, int i_count, ... )
+{
+    uint8_t bytes[8];
+    va_list args;
+    va_start( args, i_count );
+    for( int i = 0; i < i_count; i++ )
+    {
+        bytes[i] = va_arg( args, int );
+    }
+    va_end( args );
+    gen_put( p_gen, bytes, i_count );
+}
+
+/* CSI parameters and final byte */
+static void gen_csi( gen_t *p_gen, int i_param1, int i_param2, uint8_t i_final )
+{
+    char psz[32];
+    int i_len = i_param2 >= 0
+              ? snprintf( psz, sizeof(psz), "%d;%d", i_param1, i_param2 )
+              : snprintf( psz, sizeof(psz), "%d", i_param1 );
+    gen_byte( p_gen, 0x9b );
+    gen_put( p_gen, (const uint8_t*) psz, i_len );
+    gen_byte( p_gen, 0x20 );
+    gen_byte( p_gen, i_final );
+}
+
+static void gen_restore( gen_t *p_gen )
+{
+    gen_put( p_gen, gen_designations, sizeof(gen_designations) );
+    p_gen->b_alnum = false;
+}
+
+/*****************************************************************************
+ * Text
+ *****************************************************************************/
+static void gen_text( gen_t *p_gen, int i_type )
+{
+    uint32_t r = gen_rand( p_gen );
+    if( i_type == TEXT_DRCS && p_gen->i_drcs == 0 )
+    {
+        i_type = TEXT_HIRAGANA;
+    }
+    if( ( i_type == TEXT_ALNUM ) != p_gen->b_alnum )
+    {
+        gen_byte( p_gen, p_gen->b_alnum ? 0x0f : 0x0e ); /* LS0, LS1 */
+        p_gen->b_alnum = !p_gen->b_alnum;
+    }
+    switch( i_type )
+    {
+        case TEXT_KANJI:
+            /* JIS level 1, and a few level 2 and symbols of row 1 */
+            if( r % 16 == 0 )
+            {
+                gen_byte( p_gen, 0x50 + ( r >> 4 ) % 0x24 );
+            }
+            else if( r % 16 == 1 )
+            {
+                gen_byte( p_gen, 0x21 );
+            }
+            else
+            {
+                gen_byte( p_gen, 0x30 + ( r >> 4 ) % 0x1f );
+            }
+            gen_byte( p_gen, 0x21 + ( r >> 12 ) % 94 );
+            break;
+        case TEXT_HIRAGANA:
+            gen_byte( p_gen, 0xa1 + r % 83 ); /* G2 on GR */
+            break;
+        case TEXT_KATAKANA:
+            /* row 5 of the kanji set, as broadcasters mostly send it */
+            gen_byte( p_gen, 0x25 );
+            gen_byte( p_gen, 0x21 + r % 86 );
+            break;
+        case TEXT_ALNUM:
+            gen_byte( p_gen, 0x21 + r % 94 );
+            break;
+        case TEXT_DRCS:
+            /* 2-byte DRCS in G0, then kanji back */
+            gen_bytes( p_gen, 7, 0x1b, 0x24, 0x28, 0x20, 0x40,
+                       0x41, 0x21 + r % p_gen->i_drcs );
+            gen_bytes( p_gen, 3, 0x1b, 0x24, 0x39 );
+            break;
+    }
+}
+
+/*****************************************************************************
+ * Controls
+ *****************************************************************************/
+static void gen_control_c0( gen_t *p_gen )
+{
+    uint32_t r = gen_rand( p_gen );
+    switch( r % 12 )
+    {
+        case 0: gen_byte( p_gen, 0x08 ); break; /* APB */
+        case 1: gen_byte( p_gen, 0x09 ); break; /* APF */
+        case 2: gen_byte( p_gen, 0x0a ); break; /* APD */
+        case 3: gen_byte( p_gen, 0x0b ); break; /* APU */
+        case 4: gen_byte( p_gen, 0x0d ); break; /* APR */
+        case 5: gen_bytes( p_gen, 2, 0x16, 0x40 + ( r >> 8 ) % 8 ); break; /* PAPF */
+        case 6: /* APS */
+            gen_bytes( p_gen, 3, 0x1c, 0x40 + ( r >> 8 ) % 10, 0x40 + ( r >> 16 ) % 20 );
+            break;
+        case 7: /* NUL, BEL, CAN, RS */
+        {
+            static const uint8_t codes[] = { 0x00, 0x07, 0x18, 0x1e };
+            gen_byte( p_gen, codes[( r >> 8 ) % 4] );
+            break;
+        }
+        case 8: /* SS2: hiragana through GL */
+            gen_bytes( p_gen, 2, 0x19, 0x21 + ( r >> 8 ) % 83 );
+            break;
+        case 9: /* SS3: a default macro */
+            if( p_gen->control_weights[CONTROL_MACRO] > 0 )
+            {
+                gen_bytes( p_gen, 2, 0x1d, 0x60 + ( r >> 8 ) % 16 );
+                gen_restore( p_gen );
+            }
+            break;
+        case 10: /* CS, seldom */
+            if( ( r >> 8 ) % 8 == 0 )
+            {
+                gen_byte( p_gen, 0x0c );
+            }
+            break;
+        case 11: /* LS1 ... LS0 */
+            gen_text( p_gen, TEXT_ALNUM );
+            gen_text( p_gen, TEXT_HIRAGANA );
+            break;
+    }
+}
+
+static void gen_control_c1( gen_t *p_gen )
+{
+    uint32_t r = gen_rand( p_gen );
+    uint32_t p = r >> 8;
+    switch( r % 13 )
+    {
+        case 0: gen_byte( p_gen, 0x80 + p % 8 ); break; /* BKF-WHF */
+        case 1: gen_byte( p_gen, 0x88 + p % 3 ); break; /* SSZ, MSZ, NSZ */
+        case 2: /* COL, palette or color */
+            if( p % 3 == 0 )
+            {
+                gen_bytes( p_gen, 3, 0x90, 0x20, 0x40 + ( p >> 2 ) % 4 );
+            }
+            else
+            {
+                gen_bytes( p_gen, 2, 0x90, 0x40 + ( p >> 2 ) % 0x30 );
+            }
+            break;
+        case 3: /* FLC */
+        {
+            static const uint8_t modes[] = { 0x40, 0x47, 0x4f };
+            gen_bytes( p_gen, 2, 0x91, modes[p % 3] );
+            break;
+        }
+        case 4: /* CDC */
+            if( p % 3 == 0 )
+            {
+                gen_bytes( p_gen, 3, 0x92, 0x20, 0x40 + ( p >> 2 ) % 10 );
+            }
+            else
+            {
+                gen_bytes( p_gen, 2, 0x92, p % 3 == 1 ? 0x40 : 0x4f );
+            }
+            break;
+        case 5: gen_bytes( p_gen, 2, 0x93, 0x40 + p % 3 ); break; /* POL */
+        case 6: /* WMM */
+        {
+            static const uint8_t modes[] = { 0x40, 0x44, 0x45 };
+            gen_bytes( p_gen, 2, 0x94, modes[p % 3] );
+            break;
+        }
+        case 7: gen_bytes( p_gen, 2, 0x97, 0x40 + p % 16 ); break; /* HLC */
+        case 8: gen_bytes( p_gen, 2, 0x98, 0x41 + p % 4 ); break; /* RPC */
+        case 9: gen_byte( p_gen, 0x99 ); break; /* SPL */
+        case 10: gen_byte( p_gen, 0x9a ); break; /* STL */
+        case 11: gen_byte( p_gen, 0x87 ); break; /* WHF back */
+        case 12: gen_byte( p_gen, 0x8a ); break; /* NSZ back */
+    }
+}
+
+static void gen_control_csi( gen_t *p_gen )
+{
+    static const uint8_t finals[] = {
+        0x42, 0x53, 0x54, 0x56, 0x57, 0x58, 0x59, 0x5d, 0x5e, 0x5f,
+        0x6e, 0x61, 0x63, 0x62, 0x64, 0x65, 0x66, 0x68, 0x69, 0x6a, 0x6f,
+    };
+    uint32_t r = gen_rand( p_gen );
+    uint8_t i_final = finals[r % sizeof(finals)];
+    switch( i_final )
+    {
+        case 0x56: /* SDF */
+            gen_csi( p_gen, 960, 540, i_final );
+            break;
+        case 0x5f: /* SDP */
+            gen_csi( p_gen, 40 * ( ( r >> 8 ) % 4 ), 30 * ( ( r >> 10 ) % 4 ), i_final );
+            break;
+        case 0x61: /* ACPS */
+            gen_csi( p_gen, 100 + ( r >> 8 ) % 700, 100 + ( r >> 16 ) % 400, i_final );
+            break;
+        case 0x57: /* SSM */
+            gen_csi( p_gen, 36, 36, i_final );
+            break;
+        case 0x58: /* SHS */
+        case 0x59: /* SVS */
+            gen_csi( p_gen, ( r >> 8 ) % 16, -1, i_final );
+            break;
+        case 0x63: /* ORN */
+            gen_csi( p_gen, ( r >> 8 ) % 3, 7 + 100 * ( ( r >> 10 ) % 4 ), i_final );
+            break;
+        case 0x53: /* SWF: 7 is 960x540 horizontal */
+            gen_csi( p_gen, 7, -1, i_final );
+            break;
+        default:
+            gen_csi( p_gen, ( r >> 8 ) % 10, -1, i_final );
+            break;
+    }
+}
+
+static void gen_control_szx( gen_t *p_gen )
+{
+    static const uint8_t sizes[] = { 0x60, 0x41, 0x44, 0x45, 0x6b, 0x64 };
+    gen_bytes( p_gen, 2, 0x8b, sizes[gen_rand( p_gen ) % sizeof(sizes)] );
+}
+
+/* A set designated to one of G0-G3 and locked into GL or GR, a few of its
+ * characters, then the usual designations back */
+static void gen_control_esc( gen_t *p_gen )
+{
+    static const uint8_t sets[] = {
+        0x30, 0x31, 0x36, 0x37, 0x38, 0x4a, /* hiragana, katakana, alnum */
+        0x39, 0x3b, 0x42,                   /* kanji */
+    };
+    static const uint8_t gl_shifts[4][2] = {
+        { 0x0f }, { 0x0e }, { 0x1b, 0x6e }, { 0x1b, 0x6f },
+    };
+    static const uint8_t gr_shifts[4] = { 0, 0x7e, 0x7d, 0x7c };
+    uint32_t r = gen_rand( p_gen );
+    int i_g = r % 4;
+    uint8_t i_set = sets[( r >> 2 ) % sizeof(sets)];
+    bool b_kanji = i_set == 0x39 || i_set == 0x3b || i_set == 0x42;
+    bool b_gr = i_g > 0 && ( r >> 6 ) % 2;
+
+    gen_byte( p_gen, 0x1b );
+    if( b_kanji )
+    {
+        gen_byte( p_gen, 0x24 );
+        if( i_g > 0 )
+        {
+            gen_byte( p_gen, 0x28 + i_g );
+        }
+    }
+    else
+    {
+        gen_byte( p_gen, 0x28 + i_g );
+    }
+    gen_byte( p_gen, i_set );
+    if( b_gr )
+    {
+        gen_bytes( p_gen, 2, 0x1b, gr_shifts[i_g] );
+    }
+    else
+    {
+        gen_put( p_gen, gl_shifts[i_g], gl_shifts[i_g][0] == 0x1b ? 2 : 1 );
+    }
+
+    int i_chars = 1 + ( r >> 8 ) % 4;
+    uint8_t i_half = b_gr ? 0x80 : 0x00;
+    for( int i = 0; i < i_chars; i++ )
+    {
+        uint32_t c = gen_rand( p_gen );
+        if( b_kanji )
+        {
+            gen_bytes( p_gen, 2, i_half | ( 0x30 + c % 0x1f ),
+                       i_half | ( 0x21 + ( c >> 8 ) % 94 ) );
+        }
+        else
+        {
+            gen_byte( p_gen, i_half | ( 0x21 + c % ( i_set == 0x36 || i_set == 0x4a ? 94 : 83 ) ) );
+        }
+    }
+    gen_restore( p_gen );
+}
+
+static void gen_control_macro( gen_t *p_gen )
+{
+    uint32_t r = gen_rand( p_gen );
+    if( r % 4 )
+    {
+        /* SS3 on the macro set in G3 */
+        gen_bytes( p_gen, 2, 0x1d, 0x60 + ( r >> 2 ) % 16 );
+    }
+    else
+    {
+        /* MACRO: defined and executed, a color and a few characters */
+        gen_bytes( p_gen, 3, 0x95, 0x41, 0x21 + ( r >> 2 ) % 0x3f );
+        gen_byte( p_gen, 0x80 + ( r >> 8 ) % 8 );
+        int i_chars = 1 + ( r >> 12 ) % 4;
+        for( int i = 0; i < i_chars; i++ )
+        {
+            gen_byte( p_gen, 0xa1 + gen_rand( p_gen ) % 83 );
+        }
+        gen_bytes( p_gen, 2, 0x95, 0x4f );
+    }
+    gen_restore( p_gen );
+}
+
+static void gen_control_time( gen_t *p_gen )
+{
+    uint32_t r = gen_rand( p_gen );
+    switch( r % 3 )
+    {
+        case 0: /* presentation wait, 0.1 s units */
+            gen_bytes( p_gen, 3, 0x9d, 0x20, 0x40 + ( r >> 2 ) % 20 );
+            break;
+        case 1: /* time control mode */
+            gen_bytes( p_gen, 3, 0x9d, 0x28, 0x40 + ( r >> 2 ) % 4 );
+            break;
+        case 2: /* presentation time, ignored */
+            gen_bytes( p_gen, 5, 0x9d, 0x29, 0x31, 0x32, 0x40 );
+            break;
+    }
+}
+
+static void gen_control( gen_t *p_gen )
+{
+    switch( gen_pick( p_gen, p_gen->control_weights, CONTROL_COUNT ) )
+    {
+        case CONTROL_C0: gen_control_c0( p_gen ); break;
+        case CONTROL_C1: gen_control_c1( p_gen ); break;
+        case CONTROL_CSI: gen_control_csi( p_gen ); break;
+        case CONTROL_SZX: gen_control_szx( p_gen ); break;
+        case CONTROL_ESC: gen_control_esc( p_gen ); break;
+        case CONTROL_MACRO: gen_control_macro( p_gen ); break;
+        case CONTROL_TIME: gen_control_time( p_gen ); break;
+    }
+}
+
+/*****************************************************************************
+ * Statements
+ *****************************************************************************/
+static void gen_statement( gen_t *p_gen )
+{
+    p_gen->i_body = 0;
+    p_gen->b_alnum = false;
+    gen_byte( p_gen, 0x0c ); /* CS */
+    gen_restore( p_gen );
+    gen_bytes( p_gen, 3, 0x1c, 0x40 + gen_range( p_gen, 0, 9 ), 0x44 ); /* APS */
+
+    /* a region each: positioned, colored and one character */
+    for( int i = 0; i < p_gen->i_regions; i++ )
+    {
+        gen_bytes( p_gen, 4, 0x1c, 0x40 + i % 10, 0x40 + ( i / 10 ) % 20,
+                   0x80 + 1 + i % 7 );
+        gen_byte( p_gen, 0xa1 + gen_rand( p_gen ) % 83 );
+    }
+
+    int i_chars = gen_range( p_gen, p_gen->i_chars_min, p_gen->i_chars_max );
+    for( int i = 0; i < i_chars; i++ )
+    {
+        if( p_gen->i_control_rate > 0 &&
+            (int) ( gen_rand( p_gen ) % 100 ) < p_gen->i_control_rate )
+        {
+            gen_control( p_gen );
+        }
+        gen_text( p_gen, gen_pick( p_gen, p_gen->text_weights, TEXT_COUNT ) );
+    }
+    if( p_gen->b_alnum )
+    {
+        gen_byte( p_gen, 0x0f );
+    }
+}
+
+/* 2-byte DRCS data unit, 16x16 patterns in 4 gradations */
+static size_t gen_drcs( gen_t *p_gen, uint8_t *p_unit )
+{
+    size_t i = 0;
+    p_unit[i++] = p_gen->i_drcs; /* NumberOfCode */
+    for( int k = 0; k < p_gen->i_drcs; k++ )
+    {
+        p_unit[i++] = 0x41; /* CharacterCode */
+        p_unit[i++] = 0x21 + k;
+        p_unit[i++] = 1;    /* NumberOfFont */
+        p_unit[i++] = 0x00; /* fontId, mode */
+        p_unit[i++] = 2;    /* depth */
+        p_unit[i++] = 16;   /* width */
+        p_unit[i++] = 16;   /* height */
+        for( int j = 0; j < 16 * 16 * 2 / 8; j++ )
+        {
+            p_unit[i++] = gen_rand( p_gen );
+        }
+    }
+    return i;
+}
+
+static bool gen_write_pes( FILE *fp, const arib_caption_group_t *p_group, int64_t i_pts )
+{
+    static uint8_t pes[GEN_PES_MAX];
+    size_t i_pes = arib_write_pes( p_group, i_pts, pes, sizeof(pes) );
+    if( i_pes == 0 )
+    {
+        fprintf( stderr, "statement too large for a PES packet, "
+                         "use fewer characters or regions\n" );
+        return false;
+    }
+    return fwrite( pes, 1, i_pes, fp ) == i_pes;
+}
+
+static bool gen_run( gen_t *p_gen, FILE *fp )
+{
+    static uint8_t drcs[1 + GEN_DRCS_MAX * ( 7 + 64 )];
+    arib_caption_language_t language = {
+        .i_language_tag = 0, .i_dmf = 0x0, .language_code = { 'j', 'p', 'n' },
+        .i_format = 0x8, .i_tcs = 0, .i_rollup_mode = 0,
+    };
+    int64_t i_pts = 90000;
+
+    for( int i = 0; i < p_gen->i_statements; i++ )
+    {
+        if( !p_gen->b_body && p_gen->i_management > 0 &&
+            i % p_gen->i_management == 0 )
+        {
+            arib_caption_group_t management = {
+                .i_group_id = 0x00, .i_tmd = ARIB_TMD_FREE,
+                .p_languages = &language, .i_languages = 1,
+            };
+            if( !gen_write_pes( fp, &management, i_pts ) )
+            {
+                return false;
+            }
+        }
+
+        gen_statement( p_gen );
+        if( p_gen->b_body )
+        {
+            if( fwrite( p_gen->p_body, 1, p_gen->i_body, fp ) != p_gen->i_body )
+            {
+                return false;
+            }
+            continue;
+        }
+
+        arib_data_unit_t units[2];
+        size_t i_units = 0;
+        if( p_gen->i_drcs > 0 )
+        {
+            units[i_units].i_parameter = ARIB_DATA_UNIT_DRCS_2BYTE;
+            units[i_units].p_data = drcs;
+            units[i_units++].i_data = gen_drcs( p_gen, drcs );
+        }
+        units[i_units].i_parameter = ARIB_DATA_UNIT_STATEMENT_BODY;
+        units[i_units].p_data = p_gen->p_body;
+        units[i_units++].i_data = p_gen->i_body;
+        arib_caption_group_t statement = {
+            .i_group_id = 0x01, .i_tmd = ARIB_TMD_FREE,
+            .p_units = units, .i_units = i_units,
+        };
+        if( !gen_write_pes( fp, &statement, i_pts ) )
+        {
+            return false;
+        }
+        i_pts += 90000 * gen_range( p_gen, 1, 5 );
+    }
+    return true;
+}
+
+/*****************************************************************************
+ * Options
+ *****************************************************************************/
+/* "name=weight,..." over the given names, the others get 0 */
+static bool gen_parse_weights( const char *psz, const char * const *ppsz_names,
+                               int i_count, int *p_weights )
+{
+    memset( p_weights, 0, i_count * sizeof(*p_weights) );
+    int i_total = 0;
+    while( *psz )
+    {
+        size_t i_len = strcspn( psz, "=," );
+        int i;
+        for( i = 0; i < i_count; i++ )
+        {
+            if( strlen( ppsz_names[i] ) == i_len && !strncmp( psz, ppsz_names[i], i_len ) )
+            {
+                break;
+            }
+        }
+        if( i == i_count )
+        {
+            fprintf( stderr, "unknown name in %s\n", psz );
+            return false;
+        }
+        psz += i_len;
+        p_weights[i] = 1;
+        if( *psz == '=' )
+        {
+            p_weights[i] = strtol( psz + 1, (char**) &psz, 10 );
+        }
+        if( p_weights[i] < 0 )
+        {
+            return false;
+        }
+        i_total += p_weights[i];
+        if( *psz == ',' )
+        {
+            psz++;
+        }
+        else if( *psz )
+        {
+            return false;
+        }
+    }
+    return i_total > 0;
+}
+
+static void gen_usage( const char *psz_name )
+{
+    fprintf( stderr,
+        "usage: %s [options] output\n"
+        "  -s seed        random seed (1)\n"
+        "  -n count       statements (100)\n"
+        "  -c min[-max]   characters per statement (16-48)\n"
+        "  -t mix         text weights over kanji, hiragana, katakana, alnum, drcs\n"
+        "                 (kanji=5,hiragana=4,katakana=1)\n"
+        "  -x mix         control weights over c0, c1, csi, szx, esc, macro, time\n"
+        "                 (c0=4,c1=4,szx=1)\n"
+        "  -p rate        controls per 100 characters (10)\n"
+        "  -d count       DRCS patterns per statement, 0-%d (0)\n"
+        "  -r count       extra one character regions per statement (0)\n"
+        "  -m count       statements between management data, 0 for none (20)\n"
+        "  -b             bare statement bodies instead of PES packets\n",
+        psz_name, GEN_DRCS_MAX );
+}
+
+int main( int argc, char **argv )
+{
+    gen_t gen;
+    memset( &gen, 0, sizeof(gen) );
+    unsigned long long i_seed = 1;
+    gen.i_statements = 100;
+    gen.i_chars_min = 16;
+    gen.i_chars_max = 48;
+    gen.i_control_rate = 10;
+    gen.text_weights[TEXT_KANJI] = 5;
+    gen.text_weights[TEXT_HIRAGANA] = 4;
+    gen.text_weights[TEXT_KATAKANA] = 1;
+    gen.control_weights[CONTROL_C0] = 4;
+    gen.control_weights[CONTROL_C1] = 4;
+    gen.control_weights[CONTROL_SZX] = 1;
+    gen.i_management = 20;
+
+    int c;
+    char *psz_end;
+    while( (c = getopt( argc, argv, "s:n:c:t:x:p:d:r:m:b" )) != -1 )
+    {
+        bool b_ok = true;
+        switch( c )
+        {
+            case 's':
+                i_seed = strtoull( optarg, &psz_end, 0 );
+                b_ok = !*psz_end;
+                break;
+            case 'n':
+                gen.i_statements = atoi( optarg );
+                break;
+            case 'c':
+                gen.i_chars_min = gen.i_chars_max = strtol( optarg, &psz_end, 10 );
+                if( *psz_end == '-' )
+                {
+                    gen.i_chars_max = strtol( psz_end + 1, &psz_end, 10 );
+                }
+                b_ok = !*psz_end && gen.i_chars_min >= 0 &&
+                       gen.i_chars_max >= gen.i_chars_min;
+                break;
+            case 't':
+                b_ok = gen_parse_weights( optarg, text_names, TEXT_COUNT,
+                                          gen.text_weights );
+                break;
+            case 'x':
+                b_ok = gen_parse_weights( optarg, control_names, CONTROL_COUNT,
+                                          gen.control_weights );
+                break;
+            case 'p':
+                gen.i_control_rate = atoi( optarg );
+                break;
+            case 'd':
+                gen.i_drcs = atoi( optarg );
+                b_ok = gen.i_drcs >= 0 && gen.i_drcs <= GEN_DRCS_MAX;
+                break;
+            case 'r':
+                gen.i_regions = atoi( optarg );
+                break;
+            case 'm':
+                gen.i_management = atoi( optarg );
+                break;
+            case 'b':
+                gen.b_body = true;
+                break;
+            default:
+                b_ok = false;
+                break;
+        }
+        if( !b_ok )
+        {
+            gen_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( optind + 1 != argc )
+    {
+        gen_usage( argv[0] );
+        return 1;
+    }
+    /* xorshift never leaves 0 */
+    gen.i_rng = i_seed * UINT64_C(0x9e3779b97f4a7c15) + 1;
+
+    FILE *fp = fopen( argv[optind], "wb" );
+    if( fp == NULL )
+    {
+        fprintf( stderr, "cannot create %s\n", argv[optind] );
+        return 1;
+    }
+    bool b_ok = gen_run( &gen, fp );
+    if( fclose( fp ) != 0 )
+    {
+        b_ok = false;
+    }
+    free( gen.p_body );
+    if( !b_ok )
+    {
+        fprintf( stderr, "failed writing %s\n", argv[optind] );
+        remove( argv[optind] );
+        return 1;
+    }
+    return 0;
+}
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include "aribb24/aribb24.h"
 #include "aribb24_private.h"
@@ -35,43 +36,120 @@
 #include "aribb24/decoder.h"
 #include "decoder_private.h"
 
-void arib_log( arib_instance_t *p_instance, const char *psz_format, ... )
+void arib_log_message( arib_instance_t *p_instance, const char *psz_format, ... )
 {
-#ifdef HAVE_VASPRINTF
+    char psz_message[ARIB_LOG_MESSAGE_SIZE];
     va_list args;
-    free( p_instance->p->psz_last_error );
     va_start( args, psz_format );
-    if ( vasprintf( &p_instance->p->psz_last_error, psz_format, args ) < 0 )
+    int i_ret = vsnprintf( psz_message, sizeof(psz_message), psz_format, args );
+    va_end( args );
+    if( i_ret < 0 )
     {
-        p_instance->p->psz_last_error = NULL;
         return;
     }
 
-    if ( p_instance->p->pf_messages )
+    p_instance->p->pf_messages( p_instance->p->p_opaque, psz_message );
+}
+
+uint64_t arib_clock_ns( void )
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    if( clock_gettime( CLOCK_MONOTONIC, &ts ) == 0 )
     {
-        p_instance->p->pf_messages( p_instance->p->p_opaque,
-                                    p_instance->p->psz_last_error );
+        return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
     }
-    else
+#endif
+    return 0;
+}
+
+char * arib_strdup( arib_instance_t *p_instance, const char *psz )
+{
+    size_t i_size = strlen( psz ) + 1;
+    char *psz_dup = arib_malloc( p_instance, i_size );
+    if( psz_dup != NULL )
     {
-        // vprintf ?
+        memcpy( psz_dup, psz, i_size );
     }
+    return psz_dup;
+}
+
+int arib_asprintf( arib_instance_t *p_instance, char **ppsz,
+                   const char *psz_format, ... )
+{
+    va_list args;
+    va_start( args, psz_format );
+    int i_len = vsnprintf( NULL, 0, psz_format, args );
     va_end( args );
-#endif
+    if( i_len < 0 )
+    {
+        return -1;
+    }
+    char *psz = arib_malloc( p_instance, (size_t) i_len + 1 );
+    if( psz == NULL )
+    {
+        return -1;
+    }
+    va_start( args, psz_format );
+    vsnprintf( psz, (size_t) i_len + 1, psz_format, args );
+    va_end( args );
+    *ppsz = psz;
+    return i_len;
+}
+
+static void * arib_default_malloc( void *p_opaque, size_t i_size )
+{
+    (void) p_opaque;
+    return malloc( i_size );
+}
+
+static void * arib_default_realloc( void *p_opaque, void *p, size_t i_size )
+{
+    (void) p_opaque;
+    return realloc( p, i_size );
+}
+
+static void arib_default_free( void *p_opaque, void *p )
+{
+    (void) p_opaque;
+    free( p );
 }
 
 arib_instance_t * arib_instance_new( void *p_opaque )
 {
-    arib_instance_t *p_instance = calloc( 1, sizeof(*p_instance) );
+    return arib_instance_new_with_allocator( p_opaque, arib_default_malloc,
+                                             arib_default_realloc,
+                                             arib_default_free, NULL );
+}
+
+arib_instance_t * arib_instance_new_with_allocator( void *p_opaque,
+        arib_malloc_callback_t pf_malloc, arib_realloc_callback_t pf_realloc,
+        arib_free_callback_t pf_free, void *p_alloc_opaque )
+{
+    const arib_allocator_t allocator =
+    {
+        .pf_malloc = pf_malloc,
+        .pf_realloc = pf_realloc,
+        .pf_free = pf_free,
+        .p_opaque = p_alloc_opaque,
+    };
+    arib_instance_t *p_instance =
+        arib_allocator_calloc( &allocator, 1, sizeof(*p_instance) );
     if ( !p_instance )
         return NULL;
-    p_instance->p = calloc( 1, sizeof(*(p_instance->p)) );
+    p_instance->p = arib_allocator_calloc( &allocator, 1, sizeof(*(p_instance->p)) );
     if (!p_instance->p)
     {
-        free( p_instance );
+        arib_allocator_free( &allocator, p_instance );
         return NULL;
     }
+    p_instance->p->allocator = allocator;
     p_instance->p->p_opaque = p_opaque;
+    p_instance->p->i_log_level = ARIB_LOG_DEBUG;
+    for( int i = 0; i < ARIB_STAT_COUNT; i++ )
+    {
+        atomic_init( &p_instance->p->stats[i], 0 );
+    }
     p_instance->b_use_private_conv = true;
     return p_instance;
 }
@@ -82,18 +160,19 @@ void arib_instance_destroy( arib_instance_t *p_instance )
         arib_decoder_free( p_instance->p->p_decoder ); 
     if ( p_instance->p->p_parser )
         arib_parser_free( p_instance->p->p_parser ); 
-    free( p_instance->p->psz_base_path );
-    free( p_instance->p->psz_last_error );
+    arib_free( p_instance, p_instance->p->psz_base_path );
 
     drcs_conversion_t *p_drcs_conv, *p_next;
     for( p_drcs_conv = p_instance->p->p_drcs_conv; p_drcs_conv; p_drcs_conv = p_next )
     {
         p_next = p_drcs_conv->p_next;
-        free( p_drcs_conv );
+        arib_free( p_instance, p_drcs_conv );
     }
+    free_drcs_glyphs( &p_instance->p->allocator, &p_instance->p->drcs );
 
-    free( p_instance->p );
-    free( p_instance );
+    const arib_allocator_t allocator = p_instance->p->allocator;
+    arib_allocator_free( &allocator, p_instance->p );
+    arib_allocator_free( &allocator, p_instance );
 }
 
 void arib_register_messages_callback( arib_instance_t *p_arib_instance,
@@ -102,11 +181,50 @@ void arib_register_messages_callback( arib_instance_t *p_arib_instance,
     p_arib_instance->p->pf_messages = pf_callback;
 }
 
+void arib_set_log_level( arib_instance_t *p_instance, arib_log_level_t i_level )
+{
+    p_instance->p->i_log_level = i_level;
+}
+
+static uint64_t instance_stat( arib_instance_t *p_instance, int i_stat )
+{
+    return atomic_load_explicit( &p_instance->p->stats[i_stat],
+                                 memory_order_relaxed );
+}
+
+void arib_instance_get_stats( arib_instance_t *p_instance,
+                              arib_instance_stats_t *p_stats )
+{
+    p_stats->i_parsed_bytes = instance_stat( p_instance, ARIB_STAT_PARSED_BYTES );
+    p_stats->i_statement_units = instance_stat( p_instance, ARIB_STAT_STATEMENT_UNITS );
+    p_stats->i_drcs_1byte_units = instance_stat( p_instance, ARIB_STAT_DRCS_1BYTE_UNITS );
+    p_stats->i_drcs_2byte_units = instance_stat( p_instance, ARIB_STAT_DRCS_2BYTE_UNITS );
+    p_stats->i_other_units = instance_stat( p_instance, ARIB_STAT_OTHER_UNITS );
+    p_stats->i_statement_bytes = instance_stat( p_instance, ARIB_STAT_STATEMENT_BYTES );
+    p_stats->i_drcs_patterns = instance_stat( p_instance, ARIB_STAT_DRCS_PATTERNS );
+    p_stats->i_drcs_conv_hits = instance_stat( p_instance, ARIB_STAT_DRCS_CONV_HITS );
+    p_stats->i_drcs_conv_misses = instance_stat( p_instance, ARIB_STAT_DRCS_CONV_MISSES );
+    p_stats->i_png_writes = instance_stat( p_instance, ARIB_STAT_PNG_WRITES );
+    p_stats->i_parse_ns = instance_stat( p_instance, ARIB_STAT_PARSE_NS );
+
+    p_stats->i_kanji_chars = instance_stat( p_instance, ARIB_STAT_KANJI_CHARS );
+    p_stats->i_alnum_chars = instance_stat( p_instance, ARIB_STAT_ALNUM_CHARS );
+    p_stats->i_hiragana_chars = instance_stat( p_instance, ARIB_STAT_HIRAGANA_CHARS );
+    p_stats->i_katakana_chars = instance_stat( p_instance, ARIB_STAT_KATAKANA_CHARS );
+    p_stats->i_drcs_chars = instance_stat( p_instance, ARIB_STAT_DRCS_CHARS );
+    p_stats->i_regions = instance_stat( p_instance, ARIB_STAT_REGIONS );
+    p_stats->i_decode_failures = instance_stat( p_instance, ARIB_STAT_DECODE_FAILURES );
+    p_stats->i_decode_ns = instance_stat( p_instance, ARIB_STAT_DECODE_NS );
+
+    p_stats->i_allocations = instance_stat( p_instance, ARIB_STAT_ALLOCATIONS ) +
+                             instance_stat( p_instance, ARIB_STAT_DECODER_ALLOCATIONS );
+}
+
 void arib_set_base_path( arib_instance_t *p_instance, const char *psz_path )
 {
     if ( p_instance->p->psz_base_path )
-        free( p_instance->p->psz_base_path );
-    p_instance->p->psz_base_path = psz_path ? strdup( psz_path ): NULL;
+        arib_free( p_instance, p_instance->p->psz_base_path );
+    p_instance->p->psz_base_path = psz_path ? arib_strdup( p_instance, psz_path ): NULL;
 }
 
 arib_parser_t * arib_get_parser( arib_instance_t *p_instance )
@@ -24,6 +24,8 @@
 #define ARIBB24_MAIN_H 1
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* If building or using aribb24 as a DLL, define ARIBB24_DLL.
  */
@@ -64,6 +66,10 @@ typedef struct arib_instance_private_t arib_instance_private_t;
 typedef struct arib_instance_t 
 {
     bool b_generate_drcs;
+    /* conversion options: the decoder reads them in
+     * arib_initialize_decoder() and the encoder on every call. The parser
+     * reads b_replace_ellipsis when it converts the DRCS patterns of a
+     * DRCS data unit, the caption packets carry the converted table. */
     bool b_use_private_conv;
     bool b_replace_ellipsis;
     arib_instance_private_t *p;
@@ -72,9 +78,35 @@ typedef struct arib_parser_t arib_parser_t;
 typedef struct arib_decoder_t arib_decoder_t;
 typedef void(* arib_messages_callback_t)(void *, const char *);
 
+typedef enum
+{
+    ARIB_LOG_ERROR = 0,
+    ARIB_LOG_WARNING,
+    ARIB_LOG_INFO,
+    ARIB_LOG_DEBUG,
+} arib_log_level_t;
+
 ARIB_API arib_instance_t * arib_instance_new( void * );
 ARIB_API void arib_instance_destroy( arib_instance_t * ); 
 
+/* Allocator callbacks, called with the opaque pointer given along them.
+ * The free callback is never called with NULL. */
+typedef void * (* arib_malloc_callback_t)( void *, size_t );
+typedef void * (* arib_realloc_callback_t)( void *, void *, size_t );
+typedef void (* arib_free_callback_t)( void *, void * );
+
+/* As arib_instance_new(), with every allocation of the instance and of
+ * the objects created from it through the given callbacks: parser,
+ * decoder, caption packets, decode caches, renderers and their FreeType
+ * library, exporters, encoders, and libpng when it has user memory
+ * support. The callbacks are called from whichever thread uses one of
+ * these objects. None of them may be NULL.
+ * Not covered: packet queues and engines, which belong to no instance,
+ * and what the C library allocates for the DRCS conversion file. */
+ARIB_API arib_instance_t * arib_instance_new_with_allocator( void *p_opaque,
+        arib_malloc_callback_t pf_malloc, arib_realloc_callback_t pf_realloc,
+        arib_free_callback_t pf_free, void *p_alloc_opaque );
+
 ARIB_API void arib_set_base_path( arib_instance_t *, const char * );
 
 ARIB_API arib_parser_t * arib_get_parser( arib_instance_t * );
@@ -82,5 +114,43 @@ ARIB_API arib_decoder_t * arib_get_decoder( arib_instance_t * );
 
 ARIB_API void arib_register_messages_callback( arib_instance_t *,
                                       arib_messages_callback_t );
+/* Messages less severe than the level are dropped before being formatted.
+ * Defaults to ARIB_LOG_DEBUG, which passes everything to the callback. */
+ARIB_API void arib_set_log_level( arib_instance_t *, arib_log_level_t );
+
+/* Counters since the instance was created. Parsing and decoding may run
+ * on two threads: each counter is exact, but a snapshot taken while they
+ * run may mix counters from before and after a given PES. Times are
+ * sampled from one call in 32, and only estimates. */
+typedef struct arib_instance_stats_s
+{
+    /* parser */
+    uint64_t i_parsed_bytes;      /* PES data packets */
+    uint64_t i_statement_units;   /* data units, by type */
+    uint64_t i_drcs_1byte_units;
+    uint64_t i_drcs_2byte_units;
+    uint64_t i_other_units;
+    uint64_t i_statement_bytes;   /* statement body data units */
+    uint64_t i_drcs_patterns;
+    uint64_t i_drcs_conv_hits;    /* patterns found in the conversion table */
+    uint64_t i_drcs_conv_misses;
+    uint64_t i_png_writes;
+    uint64_t i_parse_ns;          /* in arib_parse_pes*() */
+
+    /* decoder */
+    uint64_t i_kanji_chars;       /* characters output, by set */
+    uint64_t i_alnum_chars;
+    uint64_t i_hiragana_chars;
+    uint64_t i_katakana_chars;
+    uint64_t i_drcs_chars;
+    uint64_t i_regions;
+    uint64_t i_decode_failures;   /* undecodable statements */
+    uint64_t i_decode_ns;         /* in arib_decode_buffer*() */
+
+    uint64_t i_allocations;       /* heap allocations by parser and decoder */
+} arib_instance_stats_t;
+
+/* May be called from any thread */
+ARIB_API void arib_instance_get_stats( arib_instance_t *, arib_instance_stats_t * );
 
 #endif
@@ -0,0 +1,64 @@
+/*****************************************************************************
+ * cache.h : ARIB STD-B24 decoded caption cache
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_CACHE_H
+#define ARIBB24_CACHE_H 1
+
+#include "aribb24.h"
+#include "decoder.h"
+
+#include <stdint.h>
+
+typedef struct arib_decode_cache_t arib_decode_cache_t;
+
+/* Decoded statement body, owned by the cache */
+typedef struct arib_decoded_caption_s
+{
+    const char *psz_text; /* UTF-8, NUL terminated */
+    size_t i_text;
+
+    const arib_buf_region_t *p_regions; /* linked list into psz_text */
+
+    const arib_styled_run_t *p_runs;
+    size_t i_runs;
+
+    bool b_clear_screen; /* as arib_decoder_get_clear_screen() */
+    size_t i_clear_offset;
+} arib_decoded_caption_t;
+
+/* Keeps up to i_max_entries decoded statement bodies, least recently used
+ * first out. */
+ARIB_API arib_decode_cache_t * arib_decode_cache_new( arib_instance_t *,
+                                                      size_t i_max_entries );
+ARIB_API void arib_decode_cache_free( arib_decode_cache_t * );
+
+/* Same as arib_decode_buffer() on a whole statement body, looked up by the
+ * decoder state, DRCS mappings and body bytes. On a hit the decoder is
+ * moved to the state the decoding left it in, without decoding again.
+ * The decoder regions are dropped: use the returned ones, valid until the
+ * next call on this cache. Returns NULL on allocation failure. */
+ARIB_API const arib_decoded_caption_t * arib_decode_cached( arib_decode_cache_t *,
+                                                            arib_decoder_t *,
+                                                            const unsigned char *buf,
+                                                            size_t count );
+
+ARIB_API void arib_decode_cache_get_stats( arib_decode_cache_t *,
+                                           uint64_t *pi_hits, uint64_t *pi_misses );
+
+#endif
@@ -58,8 +58,93 @@ typedef struct arib_buf_region_s
     int i_horadj;
 
     struct arib_buf_region_s *p_next;
+
+    /* Same span as p_start/p_end, typed for arib_decode_buffer16() and
+     * arib_decode_buffer32() output. NULL for the other encodings. */
+    uint16_t *p_start16;
+    uint16_t *p_end16;
+    uint32_t *p_start32;
+    uint32_t *p_end32;
+
+    /* TIME waits before the region, in 90 kHz units: it is presented at
+     * arib_caption_timing_t.i_start + i_time */
+    int64_t i_time;
 } arib_buf_region_t;
 
+/* Fixed size, plain data copy of the decoder state (G0-G3 designations,
+ * invocations, cursor, font size, colors...), in native endianness.
+ * It can be memcpy'd and persisted, and restored on any decoder of the same
+ * library version. Decoded regions and MACRO definitions are not part of
+ * it: macros invoked after a restore use the definitions of the decoder
+ * restored to, so a stream restored on another decoder decodes the same
+ * only once its macros have been defined again. */
+#define ARIB_DECODER_STATE_SIZE 63
+typedef struct arib_decoder_state_s
+{
+    uint32_t i_version;
+    int32_t  i_data[ARIB_DECODER_STATE_SIZE];
+} arib_decoder_state_t;
+
+/* Fields of arib_styled_run_t.i_style. Colors are CMLA indices
+ * (palette number * 16 + color), ARIB STD-B24 VOLUME 1 Part 2 Table 7-9 */
+#define ARIB_STYLE_FOREGROUND_SHIFT     0
+#define ARIB_STYLE_BACKGROUND_SHIFT     7
+#define ARIB_STYLE_ORNAMENT_COLOR_SHIFT 14
+#define ARIB_STYLE_ORNAMENT_SHIFT       21 /* ORN: none, hemming, shade, hollow */
+#define ARIB_STYLE_HIGHLIGHT_SHIFT      23 /* HLC enclosure bits */
+#define ARIB_STYLE_FLASHING_SHIFT       27 /* ARIB_FLASHING_* */
+#define ARIB_STYLE_POLARITY_SHIFT       29 /* POL: normal, inverted 1, inverted 2 */
+#define ARIB_STYLE_CONCEAL_SHIFT        31 /* CDC */
+
+#define ARIB_STYLE_COLOR_MASK           0x7f
+#define ARIB_STYLE_FOREGROUND_MASK      ARIB_STYLE_COLOR_MASK
+#define ARIB_STYLE_BACKGROUND_MASK      ARIB_STYLE_COLOR_MASK
+#define ARIB_STYLE_ORNAMENT_COLOR_MASK  ARIB_STYLE_COLOR_MASK
+#define ARIB_STYLE_ORNAMENT_MASK        0x03
+#define ARIB_STYLE_HIGHLIGHT_MASK       0x0f
+#define ARIB_STYLE_FLASHING_MASK        0x03
+#define ARIB_STYLE_POLARITY_MASK        0x03
+#define ARIB_STYLE_CONCEAL_MASK         0x01
+
+#define ARIB_STYLE_GET( style, field ) \
+    ( ( (style) >> ARIB_STYLE_##field##_SHIFT ) & ARIB_STYLE_##field##_MASK )
+
+#define ARIB_FLASHING_NONE     0
+#define ARIB_FLASHING_NORMAL   1
+#define ARIB_FLASHING_INVERTED 2
+
+/* Run of characters sharing the same style and region */
+typedef struct arib_styled_run_s
+{
+    uint32_t i_offset; /* text span, in code units of the output buffer */
+    uint32_t i_length;
+    uint32_t i_style;
+
+    /* same geometry as arib_buf_region_t */
+    int16_t i_charleft;
+    int16_t i_charbottom;
+
+    int16_t i_fontwidth;
+    int16_t i_fontheight;
+
+    int16_t i_horint;
+    int16_t i_verint;
+
+    int16_t i_veradj;
+    int16_t i_horadj;
+
+    /* 1 + DRCS code of a single DRCS character run, 0 otherwise */
+    int16_t i_drcs;
+} arib_styled_run_t;
+
+typedef enum arib_decode_status_e
+{
+    ARIB_DECODE_OK = 0,
+    ARIB_DECODE_OUTPUT_FULL, /* ubuf is full, resume at buf + consumed */
+    ARIB_DECODE_ERROR,       /* undecodable input at buf + consumed */
+    ARIB_DECODE_NEED_MORE,   /* input ends inside a control sequence */
+} arib_decode_status_t;
+
 ARIB_API void arib_initialize_decoder( arib_decoder_t* decoder );
 
 ARIB_API void arib_initialize_decoder_a_profile( arib_decoder_t* decoder );
@@ -72,8 +157,75 @@ ARIB_API size_t arib_decode_buffer( arib_decoder_t* decoder,
                                     const unsigned char *buf, size_t count,
                                     char *ubuf, size_t ucount );
 
+/* UTF-8 decoding with explicit status.
+ * *pi_written is the number of bytes already in ubuf from an interrupted
+ * call (0 otherwise) and is updated with the total output size, excluding
+ * the terminating NUL which is always written. *pi_consumed receives the
+ * number of input bytes consumed. On ARIB_DECODE_OUTPUT_FULL, grow ubuf
+ * (keeping its content, as realloc does) and call again with
+ * buf + consumed; regions are moved to the new buffer.
+ * With ubuf == NULL nothing is written and the decoder state is left
+ * untouched, macros defined by the input included: *pi_written receives
+ * the exact output size for the input. */
+ARIB_API arib_decode_status_t arib_decode_buffer_ex( arib_decoder_t* decoder,
+                                            const unsigned char *buf, size_t count,
+                                            char *ubuf, size_t ucount,
+                                            size_t *pi_consumed, size_t *pi_written );
+
+/* Same as arib_decode_buffer_ex(), for statement bodies fed in arbitrary
+ * chunks. A control sequence cut by the end of a chunk is kept by the
+ * decoder (ARIB_DECODE_NEED_MORE, the whole chunk is consumed) and applied
+ * once the next chunk completes it. Pass the same ubuf and *pi_written for
+ * every chunk to get the output of a single arib_decode_buffer_ex() call.
+ * Measuring with ubuf == NULL includes the pending sequence, and returns
+ * ARIB_DECODE_NEED_MORE when the chunk ends in another one.
+ * arib_initialize_decoder() drops any pending sequence. */
+ARIB_API arib_decode_status_t arib_decode_buffer_stream( arib_decoder_t* decoder,
+                                                const unsigned char *buf, size_t count,
+                                                char *ubuf, size_t ucount,
+                                                size_t *pi_consumed, size_t *pi_written );
+
+/* Same as arib_decode_buffer() but writes UTF-16 (native endian) or UTF-32
+ * code units. ucount is in code units, the output is NUL terminated and the
+ * number of code units written is returned. */
+ARIB_API size_t arib_decode_buffer16( arib_decoder_t* decoder,
+                                      const unsigned char *buf, size_t count,
+                                      uint16_t *ubuf, size_t ucount );
+
+ARIB_API size_t arib_decode_buffer32( arib_decoder_t* decoder,
+                                      const unsigned char *buf, size_t count,
+                                      uint32_t *ubuf, size_t ucount );
+
+ARIB_API void arib_decoder_snapshot( arib_decoder_t *, arib_decoder_state_t * );
+
+/* Returns false, leaving the decoder untouched, if the state is invalid or
+ * comes from another state version. A control sequence pending from
+ * arib_decode_buffer_stream() is dropped. The decoder keeps its own MACRO
+ * definitions: the default macros plus those it has decoded since it was
+ * created. */
+ARIB_API bool arib_decoder_restore( arib_decoder_t *, const arib_decoder_state_t * );
+
+/* TIME waits since arib_initialize_decoder(), in microseconds.
+ * Prefer arib_decoder_get_control_time(). */
 ARIB_API time_t arib_decoder_get_time( arib_decoder_t *decoder );
 
+/* TIME waits since arib_initialize_decoder(), in 90 kHz units */
+ARIB_API int64_t arib_decoder_get_control_time( arib_decoder_t *decoder );
+
 ARIB_API const arib_buf_region_t * arib_decoder_get_regions( arib_decoder_t * ); 
 
+/* Returns true if the caption decoded since arib_initialize_decoder() or
+ * arib_finalize_decoder() contains a clear screen (CS). *pi_offset
+ * receives the output position of the last one, in code units: text
+ * before it is no longer displayed. */
+ARIB_API bool arib_decoder_get_clear_screen( arib_decoder_t *, size_t *pi_offset );
+
+/* Styled runs decoded since arib_initialize_decoder() or
+ * arib_finalize_decoder(), in a decoder owned array valid until the next
+ * decoding call. Offsets are relative to the output buffer given to the
+ * arib_decode_buffer*() call (the same buffer across resumed
+ * arib_decode_buffer_ex() / _stream() calls). */
+ARIB_API const arib_styled_run_t * arib_decoder_get_runs( arib_decoder_t *,
+                                                          size_t *pi_count );
+
 #endif
@@ -0,0 +1,60 @@
+/*****************************************************************************
+ * encoder.h : ARIB STD-B24 JIS 8bit character code encoder
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_ENCODER_H
+#define ARIBB24_ENCODER_H 1
+
+#include "aribb24.h"
+
+#include <stddef.h>
+
+typedef struct arib_encoder_t arib_encoder_t;
+
+typedef enum arib_encode_status_e
+{
+    ARIB_ENCODE_OK = 0,
+    ARIB_ENCODE_OUTPUT_FULL, /* buf is full, resume at psz_text + consumed */
+    ARIB_ENCODE_ERROR,       /* invalid UTF-8 or character without an ARIB
+                                code at psz_text + consumed */
+} arib_encode_status_t;
+
+ARIB_API arib_encoder_t * arib_encoder_new( arib_instance_t * );
+
+ARIB_API void arib_encoder_free( arib_encoder_t * );
+
+/* Start a statement body, with the G sets of a decoder initialized by
+ * arib_initialize_decoder_a_profile() or _c_profile(). */
+ARIB_API void arib_initialize_encoder_a_profile( arib_encoder_t * );
+
+ARIB_API void arib_initialize_encoder_c_profile( arib_encoder_t * );
+
+/* Encodes i_text bytes of UTF-8 as a statement body fragment that the
+ * decoder turns back into the same text, except for ASCII: spaces are
+ * encoded as SP and other ASCII characters with the alphanumeric set, so
+ * both decode as their fullwidth forms (U+3000, U+FF01-U+FF5E). Newlines
+ * are encoded as APR. G set designations and invocations are chosen to
+ * keep the output short, and carry over to the next call. *pi_consumed
+ * receives the number of input bytes encoded and *pi_written the number
+ * of bytes written into buf. */
+ARIB_API arib_encode_status_t arib_encode_buffer( arib_encoder_t *,
+                                                  const char *psz_text, size_t i_text,
+                                                  unsigned char *buf, size_t i_size,
+                                                  size_t *pi_consumed, size_t *pi_written );
+
+#endif
@@ -0,0 +1,86 @@
+/*****************************************************************************
+ * engine.h : ARIB STD-B24 multi-channel caption engine
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_ENGINE_H
+#define ARIBB24_ENGINE_H 1
+
+#include "aribb24.h"
+#include "parser.h"
+#include "decoder.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Parses and decodes the captions of many channels on a fixed pool of
+ * worker threads. Each channel has its own instance, and is handled by
+ * one worker at a time, in the order its PES were pushed. */
+typedef struct arib_engine_t arib_engine_t;
+
+typedef enum
+{
+    ARIB_ENGINE_PROFILE_A = 0,
+    ARIB_ENGINE_PROFILE_C,
+} arib_engine_profile_t;
+
+/* Decoded statement, valid during the callback only */
+typedef struct arib_engine_caption_s
+{
+    int i_channel;
+    arib_caption_timing_t timing;
+
+    const char *psz_text; /* UTF-8, NUL terminated */
+    size_t i_text;
+    const arib_buf_region_t *p_regions;
+    const arib_styled_run_t *p_runs;
+    size_t i_runs;
+
+    bool b_clear_screen; /* as arib_decoder_get_clear_screen() */
+    size_t i_clear_offset;
+} arib_engine_caption_t;
+
+/* Called on a worker thread, never concurrently for one channel */
+typedef void (* arib_engine_callback_t)( void *p_opaque,
+                                         const arib_engine_caption_t * );
+
+/* i_workers 0 starts one worker per online processor */
+ARIB_API arib_engine_t * arib_engine_new( int i_channels, int i_workers,
+                                          arib_engine_callback_t pf_callback,
+                                          void *p_opaque );
+/* Delivers what was pushed, then stops the workers */
+ARIB_API void arib_engine_free( arib_engine_t * );
+
+/* Instance of a channel, to set its options, base path and messages
+ * callback before its first PES is pushed */
+ARIB_API arib_instance_t * arib_engine_get_instance( arib_engine_t *,
+                                                     int i_channel );
+/* Profile the channel captions are decoded with, A by default. Set it
+ * before the first PES is pushed. */
+ARIB_API void arib_engine_set_profile( arib_engine_t *, int i_channel,
+                                       arib_engine_profile_t );
+
+/* Queues a copy of a PES data packet, as arib_parse_pes_pts() takes it.
+ * May be called from any thread. False on allocation failure. */
+ARIB_API bool arib_engine_push_pes( arib_engine_t *, int i_channel,
+                                    const void *p_data, size_t i_data,
+                                    int64_t i_pts );
+
+/* Waits until every PES pushed so far has been handled */
+ARIB_API void arib_engine_flush( arib_engine_t * );
+
+#endif
@@ -0,0 +1,70 @@
+/*****************************************************************************
+ * export.h : ARIB STD-B24 caption to subtitle file exporter
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_EXPORT_H
+#define ARIBB24_EXPORT_H 1
+
+#include "aribb24.h"
+#include "decoder.h"
+
+#include <stdint.h>
+
+typedef struct arib_exporter_t arib_exporter_t;
+
+typedef enum arib_export_format_e
+{
+    ARIB_EXPORT_SRT = 0,
+    ARIB_EXPORT_WEBVTT,
+    ARIB_EXPORT_ASS,    /* one positioned event per region */
+    ARIB_EXPORT_TTML,   /* one positioned <p> per region */
+} arib_export_format_t;
+
+/* Receives the exported file content in order. Returns false on failure. */
+typedef bool (* arib_export_write_callback_t)( void *p_opaque,
+                                               const char *p_data, size_t i_data );
+
+ARIB_API arib_exporter_t * arib_exporter_new( arib_instance_t *,
+                                              arib_export_format_t,
+                                              arib_export_write_callback_t,
+                                              void *p_opaque );
+
+/* Same as arib_exporter_new(), writing to a file descriptor left open */
+ARIB_API arib_exporter_t * arib_exporter_new_fd( arib_instance_t *,
+                                                 arib_export_format_t, int fd );
+
+/* Adds the caption last decoded by arib_decode_buffer() into psz_text,
+ * displayed from i_pts (90 kHz, as in the PES header; cue times are
+ * relative to the first pushed caption). The displayed cue ends when the
+ * next caption clears the screen or adds text; a caption without a CS
+ * adds its text to the displayed cue. Call it before
+ * arib_finalize_decoder(). */
+ARIB_API bool arib_exporter_push( arib_exporter_t *, arib_decoder_t *,
+                                  const char *psz_text, int64_t i_pts );
+
+/* Ends the displayed cue at i_pts and writes any pending output, the end
+ * of the document for TTML. Every format is written cue by cue: ASS and
+ * TTML declare the palette 0 colors in each character size, and the
+ * styles and positions of the first cue, in a header written with it.
+ * Those first seen later are written inline in each event using them
+ * (ASS override tags, TTML inline styling and inline regions). */
+ARIB_API bool arib_exporter_finish( arib_exporter_t *, int64_t i_pts );
+
+ARIB_API void arib_exporter_free( arib_exporter_t * );
+
+#endif
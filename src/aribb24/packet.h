@@ -0,0 +1,80 @@
+/*****************************************************************************
+ * packet.h : ARIB STD-B24 caption packets handed from parser to decoder
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_PACKET_H
+#define ARIBB24_PACKET_H 1
+
+#include "aribb24.h"
+#include "parser.h"
+#include "decoder.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Thread ownership
+ *
+ * Parsing and decoding of one instance may run on two threads:
+ *  - the parser thread calls arib_parse_pes*(), arib_parser_get_*() and
+ *    arib_parser_get_packet(), and owns the DRCS patterns of the instance;
+ *  - the decoder thread calls the arib_decode*(), arib_initialize_decoder*()
+ *    and arib_decoder_get_*() functions, the renderer and the decode cache,
+ *    and only reaches DRCS patterns through the packet being decoded.
+ * Both get their objects with arib_get_parser() and arib_get_decoder(),
+ * and set the instance options and base path, before the threads start.
+ * The messages callback may be called from either thread.
+ *
+ * A packet is immutable once created, and owned by whoever holds it: the
+ * parser thread hands it over through a queue, the decoder thread frees
+ * it after its last use. */
+typedef struct arib_caption_packet_t arib_caption_packet_t;
+
+/* Copy of the last parsed statement body, its timing and the DRCS patterns
+ * it may refer to. NULL if no statement was parsed, or on allocation
+ * failure. */
+ARIB_API arib_caption_packet_t * arib_parser_get_packet( arib_parser_t * );
+ARIB_API void arib_caption_packet_free( arib_caption_packet_t * );
+
+ARIB_API const unsigned char * arib_caption_packet_get_data( const arib_caption_packet_t *,
+                                                             size_t *pi_size );
+ARIB_API void arib_caption_packet_get_timing( const arib_caption_packet_t *,
+                                              arib_caption_timing_t * );
+
+/* Makes the decoder use the DRCS patterns of the packet, for decoding and
+ * rendering, until the next call. The packet must outlive that use. NULL
+ * goes back to the patterns of the instance, for single thread use. */
+ARIB_API void arib_decoder_set_packet( arib_decoder_t *,
+                                       const arib_caption_packet_t * );
+
+/* Lock-free queue of packets from exactly one producer thread to exactly
+ * one consumer thread. */
+typedef struct arib_packet_queue_t arib_packet_queue_t;
+
+/* i_size is rounded up to a power of 2 */
+ARIB_API arib_packet_queue_t * arib_packet_queue_new( size_t i_size );
+/* Frees the queue and the packets left in it */
+ARIB_API void arib_packet_queue_free( arib_packet_queue_t * );
+
+/* Producer side: false when the queue is full, the packet is still the
+ * caller's then */
+ARIB_API bool arib_packet_queue_push( arib_packet_queue_t *,
+                                      arib_caption_packet_t * );
+/* Consumer side: NULL when the queue is empty */
+ARIB_API arib_caption_packet_t * arib_packet_queue_pop( arib_packet_queue_t * );
+
+#endif
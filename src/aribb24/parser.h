@@ -25,14 +25,45 @@
 
 #include "aribb24.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define DEBUG_ARIBSUB 1
 
 /****************************************************************************
  * Local structures
  ****************************************************************************/
 
+/* Caption timing, ARIB STD-B24 VOLUME 1 Part 3 Chapter 9.3.
+ * Times are in 90 kHz units, -1 when unknown. */
+#define ARIB_TMD_FREE     0 /* presented on arrival */
+#define ARIB_TMD_REALTIME 1 /* STM is a JST time of day */
+#define ARIB_TMD_OFFSET   2 /* STM and OTM are offsets in the program */
+
+#define ARIB_PTS_MASK ( ( INT64_C(1) << 33 ) - 1 )
+
+typedef struct arib_caption_timing_s
+{
+    int i_tmd;       /* ARIB_TMD_* of the statement */
+    int64_t i_pts;   /* PTS of the statement PES */
+    int64_t i_stm;   /* STM of the statement */
+    int64_t i_otm;   /* OTM of the last management data */
+
+    /* Presentation time of the statement: the PTS, or in offset time mode
+     * the STM mapped through the OTM and the PTS it was received with.
+     * TIME controls delay regions further, see arib_buf_region_t.i_time */
+    int64_t i_start;
+} arib_caption_timing_t;
+
 ARIB_API void arib_parse_pes( arib_parser_t *, const void *p_data, size_t i_data );
+
+/* Same as arib_parse_pes(), with the PTS of the PES packet, in 90 kHz */
+ARIB_API void arib_parse_pes_pts( arib_parser_t *, const void *p_data, size_t i_data,
+                                  int64_t i_pts );
 ARIB_API const unsigned char * arib_parser_get_data( arib_parser_t *, size_t * );
 
+/* Timing of the last parsed statement */
+ARIB_API void arib_parser_get_timing( arib_parser_t *, arib_caption_timing_t * );
+
 
 #endif
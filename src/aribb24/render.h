@@ -0,0 +1,58 @@
+/*****************************************************************************
+ * render.h : ARIB STD-B24 caption rasterizer
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_RENDER_H
+#define ARIBB24_RENDER_H 1
+
+#include "aribb24.h"
+#include "decoder.h"
+
+#include <stdint.h>
+
+typedef struct arib_renderer_t arib_renderer_t;
+
+typedef enum arib_surface_format_e
+{
+    ARIB_SURFACE_ARGB32 = 0, /* native endian uint32_t 0xAARRGGBB, premultiplied */
+    ARIB_SURFACE_A8,         /* coverage only, colors are ignored */
+} arib_surface_format_t;
+
+typedef struct arib_surface_s
+{
+    uint8_t *p_pixels;
+    int i_width;
+    int i_height;
+    int i_pitch; /* bytes per line */
+    arib_surface_format_t i_format;
+} arib_surface_t;
+
+/* psz_font_file is a font file loaded with FreeType. With NULL, or when
+ * the library is built without FreeType, only DRCS characters, backgrounds
+ * and highlights are drawn. */
+ARIB_API arib_renderer_t * arib_renderer_new( arib_instance_t *,
+                                              const char *psz_font_file );
+ARIB_API void arib_renderer_free( arib_renderer_t * );
+
+/* Draws the caption last decoded by arib_decode_buffer() into psz_text,
+ * using its styled runs, over the surface content. The caption plane is
+ * scaled to the whole surface. Returns the number of characters drawn. */
+ARIB_API int arib_render( arib_renderer_t *, arib_decoder_t *,
+                          const char *psz_text, arib_surface_t * );
+
+#endif
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ * writer.h : ARIB STD-B24 caption bitstream writer
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_WRITER_H
+#define ARIBB24_WRITER_H 1
+
+#include "aribb24.h"
+#include "parser.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* data_unit_parameter, ARIB STD-B24 VOLUME 1 Part 3 Chapter 9.4 */
+#define ARIB_DATA_UNIT_STATEMENT_BODY 0x20
+#define ARIB_DATA_UNIT_DRCS_1BYTE     0x30
+#define ARIB_DATA_UNIT_DRCS_2BYTE     0x31
+
+/* data_identifier of independent PES */
+#define ARIB_PES_SYNCHRONIZED  0x80 /* captions */
+#define ARIB_PES_ASYNCHRONOUS  0x81 /* superimposed text */
+
+typedef struct arib_data_unit_s
+{
+    uint8_t i_parameter; /* ARIB_DATA_UNIT_* */
+    const uint8_t *p_data;
+    size_t i_data;
+} arib_data_unit_t;
+
+/* Language of the caption management data, Chapter 9.3.1 */
+typedef struct arib_caption_language_s
+{
+    uint8_t i_language_tag; /* 0-7, statements use data group id + 1 */
+    uint8_t i_dmf;          /* display mode */
+    uint8_t i_dc;           /* display condition, with DMF 0xc-0xe only */
+    char language_code[3];  /* ISO 639-2, "jpn" */
+    uint8_t i_format;       /* display format, 0x8: 960x540 horizontal */
+    uint8_t i_tcs;          /* 0: 8-unit codes */
+    uint8_t i_rollup_mode;
+} arib_caption_language_t;
+
+/* Caption management data when i_group_id is 0x00 or 0x20, caption
+ * statement data of language i_group_id & 0x0f otherwise */
+typedef struct arib_caption_group_s
+{
+    uint8_t i_group_id;  /* 0x00-0x08, or 0x20-0x28 for group B */
+    uint8_t i_version;   /* data_group_version, 0-3 */
+    int i_tmd;           /* ARIB_TMD_* */
+    int64_t i_time;      /* OTM or STM in 90 kHz, with ARIB_TMD_OFFSET and,
+                            for statements, ARIB_TMD_REALTIME */
+    const arib_caption_language_t *p_languages; /* management data only */
+    int i_languages;
+    const arib_data_unit_t *p_units;
+    size_t i_units;
+} arib_caption_group_t;
+
+/* The writers fill the caller buffer and return the number of bytes
+ * written, or 0 if it is too small. They do not allocate. */
+
+/* Data group, Chapter 9.2, ending with its CRC_16 */
+ARIB_API size_t arib_write_data_group( const arib_caption_group_t *,
+                                       uint8_t *p_buf, size_t i_size );
+
+/* PES data packet of the independent PES transmission protocol, as
+ * arib_parse_pes() takes it */
+ARIB_API size_t arib_write_pes_data( const arib_caption_group_t *,
+                                     uint8_t i_data_identifier,
+                                     uint8_t *p_buf, size_t i_size );
+
+/* Whole PES packet: synchronized, in private_stream_1 with a PTS, when
+ * i_pts >= 0 (90 kHz), asynchronous in private_stream_2 otherwise */
+ARIB_API size_t arib_write_pes( const arib_caption_group_t *, int64_t i_pts,
+                                uint8_t *p_buf, size_t i_size );
+
+#endif
@@ -23,23 +23,173 @@
 #ifndef ARIBB24_PRIVATE_H
 #define ARIBB24_PRIVATE_H 1
 
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+/* see arib_instance_new_with_allocator() */
+typedef struct
+{
+    arib_malloc_callback_t pf_malloc;
+    arib_realloc_callback_t pf_realloc;
+    arib_free_callback_t pf_free;
+    void *p_opaque;
+} arib_allocator_t;
+
 #include "drcs.h"
 
+/* Counters of arib_instance_stats_t, the decoder allocations are summed
+ * into i_allocations */
+enum
+{
+    ARIB_STAT_PARSED_BYTES,
+    ARIB_STAT_STATEMENT_UNITS,
+    ARIB_STAT_DRCS_1BYTE_UNITS,
+    ARIB_STAT_DRCS_2BYTE_UNITS,
+    ARIB_STAT_OTHER_UNITS,
+    ARIB_STAT_STATEMENT_BYTES,
+    ARIB_STAT_DRCS_PATTERNS,
+    ARIB_STAT_DRCS_CONV_HITS,
+    ARIB_STAT_DRCS_CONV_MISSES,
+    ARIB_STAT_PNG_WRITES,
+    ARIB_STAT_PARSE_NS,
+    ARIB_STAT_KANJI_CHARS,
+    ARIB_STAT_ALNUM_CHARS,
+    ARIB_STAT_HIRAGANA_CHARS,
+    ARIB_STAT_KATAKANA_CHARS,
+    ARIB_STAT_DRCS_CHARS,
+    ARIB_STAT_REGIONS,
+    ARIB_STAT_DECODE_FAILURES,
+    ARIB_STAT_DECODE_NS,
+    ARIB_STAT_ALLOCATIONS,
+    ARIB_STAT_DECODER_ALLOCATIONS,
+    ARIB_STAT_COUNT
+};
+
 struct arib_instance_private_t
 {
     void *p_opaque;
+    /* every allocation made for the instance, see arib_malloc() */
+    arib_allocator_t allocator;
     arib_messages_callback_t pf_messages;
     arib_decoder_t *p_decoder;
     arib_parser_t *p_parser;
     char *psz_base_path;
-    char *psz_last_error;
+    int i_log_level; /* messages above it are neither formatted nor sent */
 
     drcs_conversion_t *p_drcs_conv;
-    int i_drcs_num;
-    unsigned int drcs_conv_table[188];
-    char drcs_hash_table[188][32 + 1];
+    /* written by the parser, see arib_caption_packet_t for other threads */
+    drcs_set_t drcs;
+
+    /* bumped by each MACRO definition */
+    unsigned int i_macro_generation;
+
+    /* ARIB_STAT_*, each written by either the parser or the decoder */
+    atomic_uint_least64_t stats[ARIB_STAT_COUNT];
 };
 
-void arib_log( arib_instance_t *, const char *, ... );
+/* longer messages are truncated */
+#define ARIB_LOG_MESSAGE_SIZE 1024
+
+void arib_log_message( arib_instance_t *, const char *, ... );
+
+#define arib_log_enabled( p_instance, i_level ) \
+    ( (p_instance)->p->pf_messages != NULL && \
+      (int)(i_level) <= (p_instance)->p->i_log_level )
+
+/* Arguments are not even evaluated when nobody gets the message */
+#define arib_log( p_instance, i_level, ... ) \
+    do \
+    { \
+        if( arib_log_enabled( p_instance, i_level ) ) \
+        { \
+            arib_log_message( p_instance, __VA_ARGS__ ); \
+        } \
+    } while( 0 )
+
+/* A counter has a single writer, the thread parsing or the one decoding:
+ * a relaxed load and store keep it readable from any thread without the
+ * cost of a locked add */
+static inline void arib_stats_add( arib_instance_t *p_instance, int i_stat,
+                                   uint64_t i_value )
+{
+    atomic_uint_least64_t *p_stat = &p_instance->p->stats[i_stat];
+    atomic_store_explicit( p_stat,
+        atomic_load_explicit( p_stat, memory_order_relaxed ) + i_value,
+        memory_order_relaxed );
+}
+
+/* Allocations through an allocator, for memory that may outlive its
+ * instance, such as caption packets */
+static inline void * arib_allocator_malloc( const arib_allocator_t *p_alloc,
+                                            size_t i_size )
+{
+    return p_alloc->pf_malloc( p_alloc->p_opaque, i_size );
+}
+
+static inline void * arib_allocator_calloc( const arib_allocator_t *p_alloc,
+                                            size_t i_count, size_t i_size )
+{
+    if( i_size != 0 && i_count > SIZE_MAX / i_size )
+    {
+        return NULL;
+    }
+    void *p = p_alloc->pf_malloc( p_alloc->p_opaque, i_count * i_size );
+    if( p != NULL )
+    {
+        memset( p, 0, i_count * i_size );
+    }
+    return p;
+}
+
+static inline void * arib_allocator_realloc( const arib_allocator_t *p_alloc,
+                                             void *p, size_t i_size )
+{
+    return p_alloc->pf_realloc( p_alloc->p_opaque, p, i_size );
+}
+
+static inline void arib_allocator_free( const arib_allocator_t *p_alloc, void *p )
+{
+    if( p != NULL )
+    {
+        p_alloc->pf_free( p_alloc->p_opaque, p );
+    }
+}
+
+/* Allocations of the instance, its parser and decoder */
+#define arib_malloc( p_instance, i_size ) \
+    arib_allocator_malloc( &(p_instance)->p->allocator, i_size )
+#define arib_calloc( p_instance, i_count, i_size ) \
+    arib_allocator_calloc( &(p_instance)->p->allocator, i_count, i_size )
+#define arib_realloc( p_instance, p_ptr, i_size ) \
+    arib_allocator_realloc( &(p_instance)->p->allocator, p_ptr, i_size )
+#define arib_free( p_instance, p_ptr ) \
+    arib_allocator_free( &(p_instance)->p->allocator, p_ptr )
+
+char * arib_strdup( arib_instance_t *, const char * );
+/* as asprintf(), -1 and *ppsz undefined on failure */
+int arib_asprintf( arib_instance_t *, char **ppsz, const char *psz_format, ... );
+
+/* monotonic clock for the time counters, 0 where there is none */
+uint64_t arib_clock_ns( void );
+
+/* Reading the clock costs about as much as parsing a small PES: one call
+ * in ARIB_STATS_TIME_PERIOD is timed, and counted for the whole period */
+#define ARIB_STATS_TIME_PERIOD 32
+
+static inline uint64_t arib_stats_time_begin( unsigned int *pi_calls )
+{
+    return ( (*pi_calls)++ % ARIB_STATS_TIME_PERIOD ) == 0 ? arib_clock_ns() : 0;
+}
+
+static inline void arib_stats_time_end( arib_instance_t *p_instance, int i_stat,
+                                        uint64_t i_start )
+{
+    if( i_start != 0 )
+    {
+        arib_stats_add( p_instance, i_stat,
+                        ( arib_clock_ns() - i_start ) * ARIB_STATS_TIME_PERIOD );
+    }
+}
 
 #endif
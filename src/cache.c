@@ -0,0 +1,361 @@
+/*****************************************************************************
+ * cache.c : ARIB STD-B24 decoded caption cache
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aribb24/cache.h"
+#include "aribb24_private.h"
+#include "decoder_private.h"
+
+/* An entry is a single allocation: the struct, then its regions, runs,
+ * key bytes and text */
+typedef struct cache_entry_s
+{
+    uint64_t i_hash;
+    size_t i_key;
+    const uint8_t *p_key;
+
+    arib_decoder_state_t end_state;
+    arib_decoded_caption_t caption;
+
+    struct cache_entry_s *p_hash_next;
+    struct cache_entry_s *p_lru_prev;
+    struct cache_entry_s *p_lru_next;
+} cache_entry_t;
+
+struct arib_decode_cache_t
+{
+    arib_instance_t *p_instance;
+
+    size_t i_max_entries;
+    size_t i_entries;
+    cache_entry_t **pp_buckets;
+    size_t i_buckets; /* power of 2 */
+
+    /* most recently used first */
+    cache_entry_t *p_lru_first;
+    cache_entry_t *p_lru_last;
+
+    /* key of the current lookup, reused */
+    uint8_t *p_key;
+    size_t i_key_alloc;
+
+    uint64_t i_hits;
+    uint64_t i_misses;
+};
+
+#define CACHE_ALIGN( x ) ( ( (x) + sizeof(void*) - 1 ) & ~( sizeof(void*) - 1 ) )
+
+static uint64_t cache_hash( const uint8_t *p_data, size_t i_data )
+{
+    uint64_t i_hash = 0xcbf29ce484222325ULL ^ i_data;
+    while( i_data >= 8 )
+    {
+        uint64_t i_word;
+        memcpy( &i_word, p_data, 8 );
+        i_hash = ( i_hash ^ i_word ) * 0x9e3779b97f4a7c15ULL;
+        i_hash ^= i_hash >> 32;
+        p_data += 8;
+        i_data -= 8;
+    }
+    while( i_data-- > 0 )
+    {
+        i_hash = ( i_hash ^ *p_data++ ) * 0x100000001b3ULL;
+    }
+    return i_hash ^ ( i_hash >> 29 );
+}
+
+/* Everything the decoding output depends on besides the body */
+static bool cache_make_key( arib_decode_cache_t *p_cache, arib_decoder_t *p_decoder,
+                            const unsigned char *buf, size_t count, size_t *pi_key )
+{
+    arib_instance_t *p_instance = p_cache->p_instance;
+    arib_decoder_state_t state;
+    arib_decoder_snapshot( p_decoder, &state );
+
+    const drcs_set_t *p_drcs = decoder_get_drcs( p_decoder );
+    uint8_t flags[2] = { p_instance->b_use_private_conv, p_instance->b_replace_ellipsis };
+    /* a body defining a macro bumps the generation, so it never hits */
+    unsigned int i_generation = p_instance->p->i_macro_generation;
+    size_t i_conv = p_drcs->i_num * sizeof(unsigned int);
+    size_t i_key = sizeof(state) + sizeof(flags) + sizeof(i_generation) + i_conv + count;
+
+    if( i_key > p_cache->i_key_alloc )
+    {
+        uint8_t *p_key = (uint8_t*) arib_realloc( p_instance, p_cache->p_key, i_key );
+        if( p_key == NULL )
+        {
+            return false;
+        }
+        p_cache->p_key = p_key;
+        p_cache->i_key_alloc = i_key;
+    }
+
+    uint8_t *p = p_cache->p_key;
+    memcpy( p, &state, sizeof(state) );
+    p += sizeof(state);
+    memcpy( p, flags, sizeof(flags) );
+    p += sizeof(flags);
+    memcpy( p, &i_generation, sizeof(i_generation) );
+    p += sizeof(i_generation);
+    memcpy( p, p_drcs->conv_table, i_conv );
+    p += i_conv;
+    memcpy( p, buf, count );
+
+    *pi_key = i_key;
+    return true;
+}
+
+static void cache_lru_unlink( arib_decode_cache_t *p_cache, cache_entry_t *p_entry )
+{
+    if( p_entry->p_lru_prev )
+        p_entry->p_lru_prev->p_lru_next = p_entry->p_lru_next;
+    else
+        p_cache->p_lru_first = p_entry->p_lru_next;
+    if( p_entry->p_lru_next )
+        p_entry->p_lru_next->p_lru_prev = p_entry->p_lru_prev;
+    else
+        p_cache->p_lru_last = p_entry->p_lru_prev;
+}
+
+static void cache_lru_push( arib_decode_cache_t *p_cache, cache_entry_t *p_entry )
+{
+    p_entry->p_lru_prev = NULL;
+    p_entry->p_lru_next = p_cache->p_lru_first;
+    if( p_cache->p_lru_first )
+        p_cache->p_lru_first->p_lru_prev = p_entry;
+    else
+        p_cache->p_lru_last = p_entry;
+    p_cache->p_lru_first = p_entry;
+}
+
+static void cache_evict( arib_decode_cache_t *p_cache, cache_entry_t *p_entry )
+{
+    cache_entry_t **pp = &p_cache->pp_buckets[p_entry->i_hash & ( p_cache->i_buckets - 1 )];
+    while( *pp != p_entry )
+    {
+        pp = &(*pp)->p_hash_next;
+    }
+    *pp = p_entry->p_hash_next;
+    cache_lru_unlink( p_cache, p_entry );
+    p_cache->i_entries--;
+    arib_free( p_cache->p_instance, p_entry );
+}
+
+/* Decodes the body and copies the result in a new entry */
+static cache_entry_t * cache_decode( arib_decode_cache_t *p_cache,
+                                     arib_decoder_t *p_decoder,
+                                     const unsigned char *buf, size_t count,
+                                     size_t i_key )
+{
+    size_t i_consumed, i_text = 0;
+    arib_decode_buffer_ex( p_decoder, buf, count, NULL, 0, &i_consumed, &i_text );
+
+    size_t i_runs_before;
+    arib_decoder_get_runs( p_decoder, &i_runs_before );
+
+    char *psz_text = (char*) arib_malloc( p_cache->p_instance, i_text + 1 );
+    if( psz_text == NULL )
+    {
+        return NULL;
+    }
+    size_t i_written = 0;
+    arib_decode_buffer_ex( p_decoder, buf, count, psz_text, i_text + 1,
+                           &i_consumed, &i_written );
+
+    size_t i_regions = 0;
+    const arib_buf_region_t *p_region;
+    for( p_region = arib_decoder_get_regions( p_decoder ); p_region;
+         p_region = p_region->p_next )
+    {
+        i_regions++;
+    }
+    size_t i_runs_total;
+    const arib_styled_run_t *p_runs = arib_decoder_get_runs( p_decoder, &i_runs_total );
+    size_t i_runs = i_runs_total - i_runs_before;
+
+    size_t i_size = CACHE_ALIGN( sizeof(cache_entry_t) );
+    size_t i_regions_offset = i_size;
+    i_size += CACHE_ALIGN( i_regions * sizeof(arib_buf_region_t) );
+    size_t i_runs_offset = i_size;
+    i_size += CACHE_ALIGN( i_runs * sizeof(arib_styled_run_t) );
+    size_t i_key_offset = i_size;
+    i_size += i_key;
+    size_t i_text_offset = i_size;
+    i_size += i_written + 1;
+
+    uint8_t *p_block = (uint8_t*) arib_malloc( p_cache->p_instance, i_size );
+    if( p_block == NULL )
+    {
+        arib_free( p_cache->p_instance, psz_text );
+        return NULL;
+    }
+    cache_entry_t *p_entry = (cache_entry_t*) p_block;
+    memset( p_entry, 0, sizeof(*p_entry) );
+
+    char *p_text = (char*) p_block + i_text_offset;
+    memcpy( p_text, psz_text, i_written + 1 );
+
+    arib_buf_region_t *p_copy = (arib_buf_region_t*) ( p_block + i_regions_offset );
+    size_t i = 0;
+    for( p_region = arib_decoder_get_regions( p_decoder ); p_region;
+         p_region = p_region->p_next, i++ )
+    {
+        p_copy[i] = *p_region;
+        p_copy[i].p_start = p_text + ( p_region->p_start - psz_text );
+        p_copy[i].p_end = p_text + ( p_region->p_end - psz_text );
+        p_copy[i].p_next = i + 1 < i_regions ? &p_copy[i + 1] : NULL;
+    }
+    arib_free( p_cache->p_instance, psz_text );
+
+    arib_styled_run_t *p_runs_copy = (arib_styled_run_t*) ( p_block + i_runs_offset );
+    if( i_runs > 0 )
+    {
+        memcpy( p_runs_copy, p_runs + i_runs_before, i_runs * sizeof(arib_styled_run_t) );
+    }
+
+    memcpy( p_block + i_key_offset, p_cache->p_key, i_key );
+    p_entry->p_key = p_block + i_key_offset;
+    p_entry->i_key = i_key;
+
+    p_entry->caption.psz_text = p_text;
+    p_entry->caption.i_text = i_written;
+    p_entry->caption.p_regions = i_regions ? p_copy : NULL;
+    p_entry->caption.p_runs = p_runs_copy;
+    p_entry->caption.i_runs = i_runs;
+    p_entry->caption.b_clear_screen =
+        arib_decoder_get_clear_screen( p_decoder, &p_entry->caption.i_clear_offset );
+
+    arib_decoder_snapshot( p_decoder, &p_entry->end_state );
+    return p_entry;
+}
+
+arib_decode_cache_t * arib_decode_cache_new( arib_instance_t *p_instance,
+                                             size_t i_max_entries )
+{
+    arib_decode_cache_t *p_cache = arib_calloc( p_instance, 1, sizeof(*p_cache) );
+    if( p_cache == NULL )
+    {
+        return NULL;
+    }
+    p_cache->p_instance = p_instance;
+    p_cache->i_max_entries = i_max_entries ? i_max_entries : 1;
+
+    p_cache->i_buckets = 16;
+    while( p_cache->i_buckets < p_cache->i_max_entries * 2 )
+    {
+        p_cache->i_buckets *= 2;
+    }
+    p_cache->pp_buckets = arib_calloc( p_instance, p_cache->i_buckets,
+                                       sizeof(cache_entry_t*) );
+    if( p_cache->pp_buckets == NULL )
+    {
+        arib_free( p_instance, p_cache );
+        return NULL;
+    }
+    return p_cache;
+}
+
+void arib_decode_cache_free( arib_decode_cache_t *p_cache )
+{
+    if( p_cache == NULL )
+    {
+        return;
+    }
+    arib_instance_t *p_instance = p_cache->p_instance;
+    cache_entry_t *p_entry, *p_next;
+    for( p_entry = p_cache->p_lru_first; p_entry; p_entry = p_next )
+    {
+        p_next = p_entry->p_lru_next;
+        arib_free( p_instance, p_entry );
+    }
+    arib_free( p_instance, p_cache->pp_buckets );
+    arib_free( p_instance, p_cache->p_key );
+    arib_free( p_instance, p_cache );
+}
+
+const arib_decoded_caption_t * arib_decode_cached( arib_decode_cache_t *p_cache,
+                                                   arib_decoder_t *p_decoder,
+                                                   const unsigned char *buf,
+                                                   size_t count )
+{
+    size_t i_key;
+    if( !cache_make_key( p_cache, p_decoder, buf, count, &i_key ) )
+    {
+        return NULL;
+    }
+    uint64_t i_hash = cache_hash( p_cache->p_key, i_key );
+
+    /* regions of previous statements are not part of the result */
+    arib_finalize_decoder( p_decoder );
+
+    cache_entry_t *p_entry = p_cache->pp_buckets[i_hash & ( p_cache->i_buckets - 1 )];
+    for( ; p_entry; p_entry = p_entry->p_hash_next )
+    {
+        if( p_entry->i_hash == i_hash && p_entry->i_key == i_key &&
+            memcmp( p_entry->p_key, p_cache->p_key, i_key ) == 0 )
+        {
+            break;
+        }
+    }
+
+    if( p_entry != NULL )
+    {
+        p_cache->i_hits++;
+        arib_decoder_restore( p_decoder, &p_entry->end_state );
+        cache_lru_unlink( p_cache, p_entry );
+        cache_lru_push( p_cache, p_entry );
+        return &p_entry->caption;
+    }
+
+    p_cache->i_misses++;
+    p_entry = cache_decode( p_cache, p_decoder, buf, count, i_key );
+    if( p_entry == NULL )
+    {
+        arib_log( p_cache->p_instance, ARIB_LOG_ERROR,
+                  "Failed caching decoded caption" );
+        return NULL;
+    }
+    /* the decoder regions point to a freed buffer */
+    arib_finalize_decoder( p_decoder );
+
+    if( p_cache->i_entries == p_cache->i_max_entries )
+    {
+        cache_evict( p_cache, p_cache->p_lru_last );
+    }
+    p_entry->i_hash = i_hash;
+    cache_entry_t **pp_bucket = &p_cache->pp_buckets[i_hash & ( p_cache->i_buckets - 1 )];
+    p_entry->p_hash_next = *pp_bucket;
+    *pp_bucket = p_entry;
+    cache_lru_push( p_cache, p_entry );
+    p_cache->i_entries++;
+
+    return &p_entry->caption;
+}
+
+void arib_decode_cache_get_stats( arib_decode_cache_t *p_cache,
+                                  uint64_t *pi_hits, uint64_t *pi_misses )
+{
+    *pi_hits = p_cache->i_hits;
+    *pi_misses = p_cache->i_misses;
+}
@@ -68,6 +68,8 @@ static const unsigned int decoder_katakana_table[] = {
     0x30fc, 0x3002, 0x300c, 0x300d, 0x3001, 0x30fb,
 };
 
+#ifdef CONVTABLE_KANJI
+/* Only read by gen_convtable, the decoder uses the generated convtable16.h */
 static const unsigned int decoder_kanji_table[][94] = {
     {
         0x3000, 0x3001, 0x3002, 0xff0c, 0xff0e, 0x30fb, 0xff1a, 0xff1b,
@@ -1290,4 +1292,6 @@ static const unsigned int decoder_private_conv_table[][94] = {
     },
 };
 
+#endif /* CONVTABLE_KANJI */
+
 #endif
@@ -24,13 +24,19 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include "aribb24/decoder.h"
+#include "aribb24/packet.h"
 #include "aribb24_private.h"
 #include "decoder_private.h"
+#include "packet_private.h"
 #include "convtable.h"
+#include "convtable16.h"
 #include "decoder_macro.h"
+#include "decoder_layout.h"
 #include "drcs.h"
+#include "probes.h"
 
 #if 0
 /*****************************************************************************
@@ -67,21 +73,76 @@ typedef struct
 /*****************************************************************************
  * ARIB STD-B24 JIS 8bit character code decoder
  *****************************************************************************/
+/* Longest control sequence kept across arib_decode_buffer_stream() calls */
+#define DECODER_CARRY_SIZE 256
+
+/* Macro codes 0x21-0x7e, and how deep macro bodies may invoke each other */
+#define DECODER_MACRO_COUNT 94
+#define DECODER_MACRO_DEPTH 4
+
+/* Graphic sets designated to G0-G3, indices into decoder_handle_set[] */
+enum
+{
+    DECODER_SET_KANJI = 0,
+    DECODER_SET_ALNUM,
+    DECODER_SET_HIRAGANA,
+    DECODER_SET_KATAKANA,
+    DECODER_SET_DRCS,
+    DECODER_SET_MACRO,
+    DECODER_SET_COUNT
+};
+
+/* A macro body, with the effect of the common designation only bodies
+ * decoded once so that invoking them is a state copy */
+typedef struct
+{
+    const unsigned char *p_body; /* NULL if the macro is undefined */
+    size_t i_body;
+    bool b_owned; /* p_body was allocated for a MACRO definition */
+    bool b_state_only;
+    int8_t i_gset[4]; /* DECODER_SET_* designated by the body, -1 if none */
+    int8_t i_gl;
+    int8_t i_gr;
+} decoder_macro_t;
+
+typedef struct
+{
+    const unsigned char *buf;
+    size_t count;
+} decoder_input_t;
+
+enum
+{
+    DECODER_ENCODING_UTF8 = 0,
+    DECODER_ENCODING_UTF16,
+    DECODER_ENCODING_UTF32,
+};
+
 struct arib_decoder_t
 {
     arib_instance_t *p_instance;
     const unsigned char *buf;
     size_t count;
-    char *ubuf;
-    size_t ucount;
-    int (**handle_gl)(arib_decoder_t *, int);
-    int (**handle_gl_single)(arib_decoder_t *, int);
-    int (**handle_gr)(arib_decoder_t *, int);
-    int (*handle_g0)(arib_decoder_t *, int);
-    int (*handle_g1)(arib_decoder_t *, int);
-    int (*handle_g2)(arib_decoder_t *, int);
-    int (*handle_g3)(arib_decoder_t *, int);
+    char *ubuf; /* output cursor, code units of i_encoding */
+    size_t ucount; /* bytes left in ubuf */
+    int i_encoding;
+    char *ubuf_base; /* start of the last arib_decode_buffer_ex() output */
+    bool b_output_full;
+    bool b_need_more;
+
+    /* incomplete control sequence left by the previous stream chunk */
+    unsigned char carry[DECODER_CARRY_SIZE];
+    size_t i_carry;
+    int i_gl; /* G set invoked in GL */
+    int i_gl_single; /* G set single shifted in GL, -1 if none */
+    int i_gr; /* G set invoked in GR */
+    int i_gset[4]; /* DECODER_SET_* designated to G0-G3 */
     int kanji_ku;
+    /* DRCS set of the caption packet being decoded, or of the instance */
+    const drcs_set_t *p_drcs;
+    /* conversion tables for the instance options, bound at initialization */
+    const uint16_t *p_kanji_table;
+    const uint32_t *p_kanji_supplementary;
 
     int i_control_time;
 
@@ -119,10 +180,59 @@ struct arib_decoder_t
     int i_charleft;
     int i_charbottom;
 
+    int i_veradj_table[LAYOUT_ADJ_COUNT];
+    int i_horadj_table[LAYOUT_ADJ_COUNT];
+
+    int i_palette;
+    uint32_t i_style; /* ARIB_STYLE_* fields */
+
     arib_buf_region_t *p_region;
+    arib_buf_region_t *p_region_last; /* tail of p_region, NULL if empty */
     bool b_need_next_region;
+
+    /* styled runs of the current caption, kept across captions */
+    arib_styled_run_t *p_runs;
+    size_t i_runs;
+    size_t i_runs_alloc;
+    int i_drcs; /* 1 + DRCS code being pushed, 0 otherwise */
+
+    /* output position of the last CS of the caption */
+    bool b_clear_screen;
+    size_t i_clear_offset;
+
+    /* DECODER_MACRO_COUNT entries, kept until redefined */
+    decoder_macro_t *p_macros;
+    /* inputs interrupted by the macro bodies being decoded, innermost last */
+    decoder_input_t macro_stack[DECODER_MACRO_DEPTH];
+    int i_macro_depth;
+    /* false with the C profile, whose decode loop never enters a body */
+    bool b_macros;
+    /* decoder before the outermost macro producing text, to undo it on a
+     * full output */
+    struct decoder_macro_undo_t *p_macro_undo;
+
+    /* counted during one decode call, then added to the instance stats */
+    uint64_t i_stat_chars[DECODER_SET_DRCS + 1]; /* by DECODER_SET_* */
+    uint64_t i_stat_regions;
+    uint64_t i_stat_allocations;
+    unsigned int i_stat_calls;
 };
 
+typedef struct decoder_macro_undo_t
+{
+    arib_decoder_t decoder;
+    arib_buf_region_t *p_tail; /* last region, NULL if none */
+    arib_buf_region_t tail;
+    arib_styled_run_t last_run;
+} decoder_macro_undo_t;
+
+static void decoder_set_style( arib_decoder_t *decoder,
+                               int i_shift, uint32_t i_mask, uint32_t i_value )
+{
+    decoder->i_style = ( decoder->i_style & ~( i_mask << i_shift ) ) |
+                       ( ( i_value & i_mask ) << i_shift );
+}
+
 static void decoder_adjust_position( arib_decoder_t *decoder )
 {
 #if 0
@@ -145,6 +255,38 @@ static void decoder_adjust_position( arib_decoder_t *decoder )
     decoder->b_need_next_region = true;
 }
 
+static void decoder_update_layout_adjust( arib_decoder_t *decoder )
+{
+    const int i_fontwidth = decoder->i_fontwidth;
+    const int i_fontheight = decoder->i_fontheight;
+    int *ver = decoder->i_veradj_table;
+    int *hor = decoder->i_horadj_table;
+
+    memset( ver, 0, sizeof(decoder->i_veradj_table) );
+    memset( hor, 0, sizeof(decoder->i_horadj_table) );
+    ver[LAYOUT_ADJ_V_1_3] = i_fontheight * 1 / 3;
+    ver[LAYOUT_ADJ_V_2_3] = i_fontheight * 2 / 3;
+    ver[LAYOUT_ADJ_V_1_2] = i_fontheight * 1 / 2;
+    ver[LAYOUT_ADJ_V_1_4] = i_fontheight * 1 / 4;
+    ver[LAYOUT_ADJ_V_1_6] = i_fontheight * 1 / 6;
+    hor[LAYOUT_ADJ_H_1_6] = i_fontwidth * 1 / 6;
+    ver[LAYOUT_ADJ_V_1_3_H_1_6] = i_fontheight * 1 / 3;
+    hor[LAYOUT_ADJ_V_1_3_H_1_6] = i_fontwidth * 1 / 6;
+}
+
+static void decoder_set_font_size( arib_decoder_t *decoder,
+                                   int i_wmul, int i_wdiv,
+                                   int i_hmul, int i_hdiv )
+{
+    decoder->i_fontwidth_cur = decoder->i_fontwidth * i_wmul / i_wdiv;
+    decoder->i_fontheight_cur = decoder->i_fontheight * i_hmul / i_hdiv;
+    decoder->i_horint_cur = decoder->i_horint * i_wmul / i_wdiv;
+    decoder->i_verint_cur = decoder->i_verint * i_hmul / i_hdiv;
+    decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
+    decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+    decoder_update_layout_adjust( decoder );
+}
+
 static int u8_uctomb_aux( unsigned char *s, unsigned int uc, int n )
 {
     int count;
@@ -198,17 +340,98 @@ static int u8_uctomb( unsigned char *s, unsigned int uc, int n )
     }
 }
 
+static int u16_uctomb( unsigned char *s, unsigned int uc, int n )
+{
+    uint16_t *p = (uint16_t*) s;
+
+    if( uc < 0x10000 )
+    {
+        if( n < 2 )
+        {
+            return -2;
+        }
+        p[0] = uc;
+        return 2;
+    }
+    else if( uc < 0x110000 )
+    {
+        if( n < 4 )
+        {
+            return -2;
+        }
+        uc -= 0x10000;
+        p[0] = 0xd800 | ( uc >> 10 );
+        p[1] = 0xdc00 | ( uc & 0x3ff );
+        return 4;
+    }
+    return -1;
+}
+
+static int u32_uctomb( unsigned char *s, unsigned int uc, int n )
+{
+    if( uc >= 0x110000 )
+    {
+        return -1;
+    }
+    if( n < 4 )
+    {
+        return -2;
+    }
+    *(uint32_t*) s = uc;
+    return 4;
+}
+
+static int decoder_uclen( arib_decoder_t *decoder, unsigned int uc )
+{
+    if( uc >= 0x110000 )
+    {
+        return -1;
+    }
+    switch( decoder->i_encoding )
+    {
+        case DECODER_ENCODING_UTF16:
+            return uc < 0x10000 ? 2 : 4;
+        case DECODER_ENCODING_UTF32:
+            return 4;
+        default:
+            return uc < 0x80 ? 1 : uc < 0x800 ? 2 : uc < 0x10000 ? 3 : 4;
+    }
+}
+
+static int decoder_uctomb( arib_decoder_t *decoder, unsigned int uc )
+{
+    unsigned char *s = (unsigned char*) decoder->ubuf;
+    if( s == NULL )
+    {
+        /* measuring only */
+        return decoder_uclen( decoder, uc );
+    }
+    switch( decoder->i_encoding )
+    {
+        case DECODER_ENCODING_UTF16:
+            return u16_uctomb( s, uc, decoder->ucount );
+        case DECODER_ENCODING_UTF32:
+            return u32_uctomb( s, uc, decoder->ucount );
+        default:
+            return u8_uctomb( s, uc, decoder->ucount );
+    }
+}
+
 static arib_buf_region_t *prepare_new_region( arib_decoder_t *decoder,
                                               char *p_start,
                                               int i_veradj,
                                               int i_horadj )
 {
     arib_buf_region_t *p_region =
-        (arib_buf_region_t*) calloc( 1, sizeof(arib_buf_region_t) );
+        (arib_buf_region_t*) arib_calloc( decoder->p_instance, 1,
+                                          sizeof(arib_buf_region_t) );
     if( p_region == NULL )
     {
         return NULL;
     }
+    decoder->i_stat_regions++;
+    decoder->i_stat_allocations++;
+    ARIB_PROBE3( region_new, decoder, decoder->i_charleft, decoder->i_charbottom );
     p_region->p_start = p_start;
     p_region->i_foreground_color = decoder->i_foreground_color;
     p_region->i_background_color = decoder->i_background_color;
@@ -228,6 +451,8 @@ static arib_buf_region_t *prepare_new_region( arib_decoder_t *decoder,
     p_region->i_charleft = decoder->i_charleft;
     p_region->i_charbottom = decoder->i_charbottom;
 
+    p_region->i_time = (int64_t) decoder->i_control_time * 9000;
+
     p_region->i_veradj = i_veradj;
     p_region->i_horadj = i_horadj;
 
@@ -238,15 +463,86 @@ static arib_buf_region_t *prepare_new_region( arib_decoder_t *decoder,
     return p_region;
 }
 
+/* offset of p in the output buffer, in code units of the output encoding */
+static size_t decoder_unit_offset( arib_decoder_t *decoder, const char *p )
+{
+    const int i_shift = decoder->i_encoding == DECODER_ENCODING_UTF32 ? 2 :
+                        decoder->i_encoding == DECODER_ENCODING_UTF16 ? 1 : 0;
+    return (size_t) ( p - decoder->ubuf_base ) >> i_shift;
+}
+
+static int decoder_push_run( arib_decoder_t *decoder,
+                             const char *p_start, const char *p_end,
+                             bool b_new_region, int i_veradj, int i_horadj )
+{
+    uint32_t i_offset = decoder_unit_offset( decoder, p_start );
+    uint32_t i_length = decoder_unit_offset( decoder, p_end ) - i_offset;
+
+    if( decoder->i_runs > 0 && !b_new_region && decoder->i_drcs == 0 )
+    {
+        arib_styled_run_t *p_run = &decoder->p_runs[decoder->i_runs - 1];
+        if( p_run->i_style == decoder->i_style && p_run->i_drcs == 0 &&
+            p_run->i_offset + p_run->i_length == i_offset )
+        {
+            p_run->i_length += i_length;
+            if( p_run->i_veradj > i_veradj )
+            {
+                p_run->i_veradj = i_veradj;
+            }
+            return 1;
+        }
+    }
+
+    if( decoder->i_runs == decoder->i_runs_alloc )
+    {
+        size_t i_alloc = decoder->i_runs_alloc ? decoder->i_runs_alloc * 2 : 64;
+        arib_styled_run_t *p_runs = (arib_styled_run_t*) arib_realloc(
+                decoder->p_instance, decoder->p_runs,
+                i_alloc * sizeof(arib_styled_run_t) );
+        if( p_runs == NULL )
+        {
+            return 0;
+        }
+        decoder->i_stat_allocations++;
+        decoder->p_runs = p_runs;
+        decoder->i_runs_alloc = i_alloc;
+    }
+
+    arib_styled_run_t *p_run = &decoder->p_runs[decoder->i_runs++];
+    p_run->i_offset = i_offset;
+    p_run->i_length = i_length;
+    p_run->i_style = decoder->i_style;
+    p_run->i_charleft = decoder->i_charleft;
+    p_run->i_charbottom = decoder->i_charbottom;
+    p_run->i_fontwidth = decoder->i_fontwidth_cur;
+    p_run->i_fontheight = decoder->i_fontheight_cur;
+    p_run->i_horint = decoder->i_horint_cur;
+    p_run->i_verint = decoder->i_verint_cur;
+    p_run->i_veradj = i_veradj;
+    p_run->i_horadj = i_horadj;
+    p_run->i_drcs = decoder->i_drcs;
+    return 1;
+}
+
 static int decoder_push( arib_decoder_t *decoder, unsigned int uc )
 {
     char *p_start = decoder->ubuf;
 
-    if( decoder->p_instance->b_replace_ellipsis && uc == 0x2026 )
+    /* Encode first so that a full output buffer leaves no state changed */
+    int i_cnt = decoder_uctomb( decoder, uc );
+    if( i_cnt <= 0 )
+    {
+        if( i_cnt == -2 )
+        {
+            decoder->b_output_full = true;
+        }
+        return 0;
+    }
+
+    if( decoder->ubuf == NULL )
     {
-        // U+2026: HORIZONTAL ELLIPSIS
-        // U+22EF: MIDLINE HORIZONTAL ELLIPSIS
-        uc = 0x22ef;
+        decoder->ucount -= i_cnt;
+        return 1;
     }
 
     if( decoder->i_foreground_color_prev != decoder->i_foreground_color )
@@ -263,122 +559,17 @@ static int decoder_push( arib_decoder_t *decoder, unsigned int uc )
         decoder->b_need_next_region = true;
     }
 
-    /* Ignore making new region */
+    /* Ignore making new region and adjust for some characters */
+    uint8_t i_attr = decoder_layout_attr( uc );
     bool b_skip_making_new_region = false;
-    if( decoder->b_need_next_region )
-    {
-        switch( uc )
-        {
-            //case 0x2026: /* HORIZONTAL ELLIPSIS */
-            //case 0x22EF: /* MIDLINE HORIZONTAL ELLIPSIS */
-            case 0x2192: /* RIGHTWARDS ARROW */
-            case 0x3001: /* IDEOGRAPHIC COMMA */
-            case 0x3002: /* IDEOGRAPHIC FULL STOP */
-            case 0xFF0C: /* FULLWIDTH COMMA */
-            case 0xFF0E: /* FULLWIDTH FULL STOP */
-                decoder->b_need_next_region = false;
-                b_skip_making_new_region = true;
-                break;
-            default:
-                break;
-        }
-    }
-
-    /* Adjust for somme characters */
-    int i_veradj;
-    int i_horadj;
-    switch( uc )
+    if( decoder->b_need_next_region && ( i_attr & LAYOUT_NO_REGION_BREAK ) )
     {
-        case 0x2026: /* HORIZONTAL ELLIPSIS */
-        case 0x22EF: /* MIDLINE HORIZONTAL ELLIPSIS */
-        case 0x2192: /* RIGHTWARDS ARROW */
-        case 0x2212: /* MINUS SIGN */
-        case 0xFF0D: /* FULLWIDTH MINUS SIGN */
-            i_veradj = decoder->i_fontheight * 1 / 3;
-            i_horadj = 0;
-            break;
-        case 0x3000: /* IDEOGRAPHIC SPACE */
-            i_veradj = decoder->i_fontheight * 2 / 3;
-            i_horadj = 0;
-            break;
-        case 0x3001: /* IDEOGRAPHIC COMMA */
-        case 0x3002: /* IDEOGRAPHIC FULL STOP */
-            i_veradj = decoder->i_fontheight * 1 / 2;
-            i_horadj = 0;
-            break;
-        case 0xFF1C: /* FULLWIDTH LESS-THAN SIGN */
-        case 0xFF1E: /* FULLWIDTH GREATER-THAN SIGN */
-        case 0x226A: /* MUCH LESS-THAN */
-        case 0x226B: /* MUCH GREATER-THAN */
-        //case 0x300A: /* LEFT DOUBLE ANGLE BRACKET */
-        //case 0x300B: /* RIGHT DOUBLE ANGLE BRACKET */
-            i_veradj = decoder->i_fontheight * 1 / 4;
-            i_horadj = 0;
-            break;
-        case 0x300C: /* LEFT CORNER BRACKET */
-        case 0x300E: /* LEFT WHITE CORNER BRACKET */
-            i_veradj = 0;
-            i_horadj = decoder->i_fontwidth * 1 / 6;
-            break;
-        case 0x300D: /* RIGHT CORNER BRACKET */
-        case 0x300F: /* RIGHT WHITE CORNER BRACKET */
-            i_veradj = decoder->i_fontheight * 1 / 6;
-            i_horadj = 0;
-            break;
-        case 0x3063: /* HIRAGANA LETTER SMALL TU */
-        case 0x30C3: /* KATAKANA LETTER SMALL TU */
-            i_veradj = decoder->i_fontheight * 1 / 3;
-            i_horadj = 0;
-            break;
-        case 0x3041: /* HIRAGANA LETTER SMALL A */
-        case 0x30A1: /* KATAKANA LETTER SMALL A */
-        case 0x3043: /* HIRAGANA LETTER SMALL I */
-        case 0x30A3: /* KATAKANA LETTER SMALL I */
-        case 0x3045: /* HIRAGANA LETTER SMALL U */
-        case 0x30A5: /* KATAKANA LETTER SMALL U */
-        case 0x3047: /* HIRAGANA LETTER SMALL E */
-        case 0x30A7: /* KATAKANA LETTER SMALL E */
-        case 0x3049: /* HIRAGANA LETTER SMALL O */
-        case 0x30A9: /* KATAKANA LETTER SMALL O */
-        case 0x3083: /* HIRAGANA LETTER SMALL YA */
-        case 0x3085: /* HIRAGANA LETTER SMALL YU */
-        case 0x3087: /* HIRAGANA LETTER SMALL YO */
-        case 0x30E3: /* KATAKANA LETTER SMALL YA */
-        case 0x30E5: /* KATAKANA LETTER SMALL YU */
-        case 0x30E7: /* KATAKANA LETTER SMALL YO */
-            i_veradj = decoder->i_fontheight * 1 / 6;
-            i_horadj = 0;
-            break;
-        case 0x301C: /* WAVE DASH */
-        case 0x30FC: /* KATAKANA-HIRAGANA PROLONGED SOUND MARK */
-            i_veradj = decoder->i_fontheight * 1 / 3;
-            i_horadj = 0;
-            break;
-        case 0x30FB: /* KATAKANA MIDDLE DOT */
-            i_veradj = decoder->i_fontheight * 1 / 3;
-            i_horadj = decoder->i_fontwidth * 1 / 6;
-            break;
-        case 0xFF08: /* FULLWIDTH LEFT PARENTHESIS */
-        case 0xFF09: /* FULLWIDTH RIGHT PARENTHESIS */
-            i_veradj = 0;
-            i_horadj = decoder->i_fontwidth * 1 / 6;
-            break;
-        case 0xFF0C: /* FULLWIDTH COMMA */
-        case 0xFF0E: /* FULLWIDTH FULL STOP */
-            i_veradj = decoder->i_fontheight * 1 / 2;
-            i_horadj = 0;
-            break;
-        default:
-            i_veradj = 0;
-            i_horadj = 0;
-            break;
+        decoder->b_need_next_region = false;
+        b_skip_making_new_region = true;
     }
 
-    int i_cnt = u8_uctomb( (unsigned char*)decoder->ubuf, uc, decoder->ucount );
-    if( i_cnt <= 0 )
-    {
-        return 0;
-    }
+    int i_veradj = decoder->i_veradj_table[i_attr & LAYOUT_ADJ_MASK];
+    int i_horadj = decoder->i_horadj_table[i_attr & LAYOUT_ADJ_MASK];
 
     decoder->ubuf += i_cnt;
     decoder->ucount -= i_cnt;
@@ -387,21 +578,18 @@ static int decoder_push( arib_decoder_t *decoder, unsigned int uc )
 
     decoder->i_charleft += decoder->i_charwidth;
 
-    arib_buf_region_t *p_region = decoder->p_region;
+    bool b_new_region = decoder->b_need_next_region;
+    arib_buf_region_t *p_region = decoder->p_region_last;
     if( p_region == NULL )
     {
+        b_new_region = true;
         p_region = decoder->p_region =
             prepare_new_region( decoder, p_start, i_veradj, i_horadj );
         if( p_region == NULL )
         {
             return 0;
         }
-    }
-
-    arib_buf_region_t *p_next;
-    while( (p_next = p_region->p_next) != NULL )
-    {
-        p_region = p_next;
+        decoder->p_region_last = p_region;
     }
 
     if( decoder->b_need_next_region )
@@ -412,6 +600,7 @@ static int decoder_push( arib_decoder_t *decoder, unsigned int uc )
         {
             return 0;
         }
+        decoder->p_region_last = p_region;
     }
     else
     {
@@ -422,6 +611,12 @@ static int decoder_push( arib_decoder_t *decoder, unsigned int uc )
     }
     p_region->p_end = p_end;
 
+    if( !decoder_push_run( decoder, p_start, p_end,
+                           b_new_region, i_veradj, i_horadj ) )
+    {
+        return 0;
+    }
+
     if( b_skip_making_new_region )
     {
         decoder->b_need_next_region = true;
@@ -434,6 +629,7 @@ static int decoder_pull( arib_decoder_t *decoder, int *c )
 {
     if( decoder->count == 0 )
     {
+        decoder->b_need_more = true;
         return 0;
     }
 
@@ -449,9 +645,9 @@ static int decoder_handle_drcs( arib_decoder_t *decoder, int c )
     unsigned int uc;
 
     uc = 0;
-    if( c < decoder->p_instance->p->i_drcs_num )
+    if( c < decoder->p_drcs->i_num )
     {
-        uc = decoder->p_instance->p->drcs_conv_table[c];
+        uc = decoder->p_drcs->conv_table[c];
     }
     if( uc == 0 )
     {
@@ -460,7 +656,12 @@ static int decoder_handle_drcs( arib_decoder_t *decoder, int c )
         uc = 0x3013; /* geta */
     }
 
-    return decoder_push( decoder, uc );
+    /* keep the pattern reachable for rendering */
+    decoder->i_drcs = c + 1;
+    int i_ret = decoder_push( decoder, uc );
+    decoder->i_drcs = 0;
+    decoder->i_stat_chars[DECODER_SET_DRCS] += i_ret;
+    return i_ret;
 }
 
 static int decoder_handle_alnum( arib_decoder_t *decoder, int c )
@@ -468,21 +669,27 @@ static int decoder_handle_alnum( arib_decoder_t *decoder, int c )
     unsigned int uc;
     uc = decoder_alnum_table[c];
     uc += 0xfee0; /* FULLWIDTH */;
-    return decoder_push( decoder, uc );
+    int i_ret = decoder_push( decoder, uc );
+    decoder->i_stat_chars[DECODER_SET_ALNUM] += i_ret;
+    return i_ret;
 }
 
 static int decoder_handle_hiragana( arib_decoder_t *decoder, int c )
 {
     unsigned int uc;
     uc = decoder_hiragana_table[c];
-    return decoder_push( decoder, uc );
+    int i_ret = decoder_push( decoder, uc );
+    decoder->i_stat_chars[DECODER_SET_HIRAGANA] += i_ret;
+    return i_ret;
 }
 
 static int decoder_handle_katakana( arib_decoder_t *decoder, int c )
 {
     unsigned int uc;
     uc = decoder_katakana_table[c];
-    return decoder_push( decoder, uc );
+    int i_ret = decoder_push( decoder, uc );
+    decoder->i_stat_chars[DECODER_SET_KATAKANA] += i_ret;
+    return i_ret;
 }
 
 static int decoder_handle_kanji( arib_decoder_t *decoder, int c )
@@ -500,22 +707,36 @@ static int decoder_handle_kanji( arib_decoder_t *decoder, int c )
 
     ten = c;
 
-    uc = decoder_kanji_table[ku][ten];
-    if (decoder->p_instance->b_use_private_conv && ku >= 89)
+    uc = decoder->p_kanji_table[ku * 94 + ten];
+    if( uc >= DECODER_KANJI_SUPPLEMENTARY && uc < 0xe000 )
     {
-        uc = decoder_private_conv_table[ku -89][ten];
+        uc = decoder->p_kanji_supplementary[uc - DECODER_KANJI_SUPPLEMENTARY];
     }
     if( uc == 0 )
     {
         return 0;
     }
 
-    return decoder_push( decoder, uc );
+    int i_ret = decoder_push( decoder, uc );
+    decoder->i_stat_chars[DECODER_SET_KANJI] += i_ret;
+    return i_ret;
 }
 
+static int decoder_handle_macro_code( arib_decoder_t *decoder, int c );
+
+static int (* const decoder_handle_set[DECODER_SET_COUNT])(arib_decoder_t *, int) =
+{
+    [DECODER_SET_KANJI]    = decoder_handle_kanji,
+    [DECODER_SET_ALNUM]    = decoder_handle_alnum,
+    [DECODER_SET_HIRAGANA] = decoder_handle_hiragana,
+    [DECODER_SET_KATAKANA] = decoder_handle_katakana,
+    [DECODER_SET_DRCS]     = decoder_handle_drcs,
+    [DECODER_SET_MACRO]    = decoder_handle_macro_code,
+};
+
 static int decoder_handle_gl( arib_decoder_t *decoder, int c )
 {
-    int (*handle)(arib_decoder_t *, int);
+    int i_g;
 
     if( c == 0x20 || c == 0x7f )
     {
@@ -523,40 +744,36 @@ static int decoder_handle_gl( arib_decoder_t *decoder, int c )
         return decoder_push( decoder, c );
     }
 
-    if( decoder->handle_gl_single == NULL )
+    if( decoder->i_gl_single < 0 )
     {
-        handle = *decoder->handle_gl;
+        i_g = decoder->i_gl;
     }
     else
     {
-        handle = *decoder->handle_gl_single;
+        i_g = decoder->i_gl_single;
     }
-    decoder->handle_gl_single = NULL;
+    decoder->i_gl_single = -1;
 
 
-    return handle( decoder, c - 0x21 );
+    return decoder_handle_set[decoder->i_gset[i_g]]( decoder, c - 0x21 );
 }
 
 static int decoder_handle_gr( arib_decoder_t *decoder, int c )
 {
-    int (*handle)(arib_decoder_t *, int);
-
     if( c == 0xa0 || c == 0xff )
     {
         return 0;
     }
 
-    handle = *decoder->handle_gr;
-
-    return handle( decoder, c - 0xa1 );
+    return decoder_handle_set[decoder->i_gset[decoder->i_gr]]( decoder, c - 0xa1 );
 }
 
 static int decoder_handle_esc( arib_decoder_t *decoder )
 {
     int c;
-    int (**handle)(arib_decoder_t *, int);
+    int i_g;
 
-    handle = &decoder->handle_g0;
+    i_g = 0;
     while( decoder_pull( decoder, &c ) != 0 )
     {
         switch( c )
@@ -567,30 +784,30 @@ static int decoder_handle_esc( arib_decoder_t *decoder )
             case 0x28:
                 break;
             case 0x29:
-                handle = &decoder->handle_g1;
+                i_g = 1;
                 break;
             case 0x2a:
-                handle = &decoder->handle_g2;
+                i_g = 2;
                 break;
             case 0x2b:
-                handle = &decoder->handle_g3;
+                i_g = 3;
                 break;
             case 0x30:
             case 0x37:
-                *handle = decoder_handle_hiragana;
+                decoder->i_gset[i_g] = DECODER_SET_HIRAGANA;
                 return 1;
             case 0x31:
             case 0x38:
-                *handle = decoder_handle_katakana;
+                decoder->i_gset[i_g] = DECODER_SET_KATAKANA;
                 return 1;
             case 0x39:
             case 0x3b:
             case 0x42:
-                *handle = decoder_handle_kanji;
+                decoder->i_gset[i_g] = DECODER_SET_KANJI;
                 return 1;
             case 0x36:
             case 0x4a:
-                *handle = decoder_handle_alnum;
+                decoder->i_gset[i_g] = DECODER_SET_ALNUM;
                 return 1;
             case 0x40:
             case 0x41:
@@ -608,24 +825,25 @@ static int decoder_handle_esc( arib_decoder_t *decoder )
             case 0x4d:
             case 0x4e:
             case 0x4f:
-                *handle = decoder_handle_drcs;
+                decoder->i_gset[i_g] = DECODER_SET_DRCS;
                 return 1;
             case 0x6e: //LS2
-                decoder->handle_gl = &decoder->handle_g2;
+                decoder->i_gl = 2;
                 return 1;
             case 0x6f: //LS3
-                decoder->handle_gl = &decoder->handle_g3;
+                decoder->i_gl = 3;
                 return 1;
             case 0x70: //macro
+                decoder->i_gset[i_g] = DECODER_SET_MACRO;
                 return 1;
             case 0x7c: //LS3R
-                decoder->handle_gr = &decoder->handle_g3;
+                decoder->i_gr = 3;
                 return 1;
             case 0x7d: //LS2R
-                decoder->handle_gr = &decoder->handle_g2;
+                decoder->i_gr = 2;
                 return 1;
             case 0x7e: //LS1R
-                decoder->handle_gr = &decoder->handle_g1;
+                decoder->i_gr = 1;
                 return 1;
             default:
                 return 0;
@@ -652,8 +870,9 @@ static int decoder_handle_papf( arib_decoder_t *decoder )
     {
         decoder->i_charleft += decoder->i_charwidth * ( buf[0] & 0x3f );
         decoder_adjust_position( decoder );
+        return 1;
     }
-    return 1;
+    return 0;
 }
 
 static int decoder_handle_aps( arib_decoder_t *decoder )
@@ -675,8 +894,9 @@ static int decoder_handle_aps( arib_decoder_t *decoder )
         decoder->i_charbottom = decoder->i_top + decoder->i_charheight * ( 1 + ( buf[0] & 0x3f ) ) - 1;
         decoder->i_charleft = decoder->i_left + decoder->i_charwidth * ( buf[1] & 0x3f );
         decoder_adjust_position( decoder );
+        return 1;
     }
-    return 1;
+    return 0;
 }
 
 static int decoder_handle_c0( arib_decoder_t *decoder, int c )
@@ -705,6 +925,11 @@ static int decoder_handle_c0( arib_decoder_t *decoder, int c )
             decoder_adjust_position( decoder );
             return 1;
         case 0x0c: //CS
+            if( decoder->ubuf != NULL )
+            {
+                decoder->b_clear_screen = true;
+                decoder->i_clear_offset = decoder_unit_offset( decoder, decoder->ubuf );
+            }
             decoder->i_charleft = decoder->i_left;
             decoder->i_charbottom = decoder->i_top + decoder->i_charheight - 1;
             decoder_adjust_position( decoder );
@@ -715,10 +940,10 @@ static int decoder_handle_c0( arib_decoder_t *decoder, int c )
             decoder_adjust_position( decoder );
             return 1;
         case 0x0e: //LS1
-            decoder->handle_gl = &decoder->handle_g1;
+            decoder->i_gl = 1;
             return 1;
         case 0x0f: //LS0
-            decoder->handle_gl = &decoder->handle_g0;
+            decoder->i_gl = 0;
             return 1;
         case 0x16: //PAPF
             return decoder_handle_papf( decoder );
@@ -726,14 +951,14 @@ static int decoder_handle_c0( arib_decoder_t *decoder, int c )
         case 0x18: //CAN
             return 1;
         case 0x19: //SS2
-            decoder->handle_gl_single = &decoder->handle_g2;
+            decoder->i_gl_single = 2;
             return 1;
         case 0x1b: //ESC
             return decoder_handle_esc( decoder );
         case 0x1c: //APS
             return decoder_handle_aps( decoder );
         case 0x1d: //SS3
-            decoder->handle_gl_single = &decoder->handle_g3;
+            decoder->i_gl_single = 3;
             return 1;
         case 0x1e: //RS
         case 0x1f: //US
@@ -751,49 +976,24 @@ static int decoder_handle_szx( arib_decoder_t *decoder )
         switch( c )
         {
             case 0x60:
-                decoder->i_fontwidth_cur = decoder->i_fontwidth / 4;
-                decoder->i_fontheight_cur = decoder->i_fontheight / 6;
-                decoder->i_horint_cur = decoder->i_horint / 4;
-                decoder->i_verint_cur = decoder->i_verint / 6;
-                decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
-                decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+                decoder_set_font_size( decoder, 1, 4, 1, 6 );
                 decoder->b_need_next_region = true;
                 return 1;
             case 0x41:
-                decoder->i_fontwidth_cur = decoder->i_fontwidth;
-                decoder->i_fontheight_cur = decoder->i_fontheight * 2;
-                decoder->i_horint_cur = decoder->i_horint;
-                decoder->i_verint_cur = decoder->i_verint * 2;
-                decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
-                decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+                decoder_set_font_size( decoder, 1, 1, 2, 1 );
                 decoder->b_need_next_region = true;
                 return 1;
             case 0x44:
-                decoder->i_fontwidth_cur = decoder->i_fontwidth * 2;
-                decoder->i_fontheight_cur = decoder->i_fontheight;
-                decoder->i_horint_cur = decoder->i_horint * 2;
-                decoder->i_verint_cur = decoder->i_verint;
-                decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
-                decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+                decoder_set_font_size( decoder, 2, 1, 1, 1 );
                 decoder->b_need_next_region = true;
                 return 1;
             case 0x45:
-                decoder->i_fontwidth_cur = decoder->i_fontwidth * 2;
-                decoder->i_fontheight_cur = decoder->i_fontheight * 2;
-                decoder->i_horint_cur = decoder->i_horint * 2;
-                decoder->i_verint_cur = decoder->i_verint * 2;
-                decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
-                decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+                decoder_set_font_size( decoder, 2, 1, 2, 1 );
                 decoder->b_need_next_region = true;
                 return 1;
             case 0x6b:
             case 0x64:
-                decoder->i_fontwidth_cur = decoder->i_fontwidth;
-                decoder->i_fontheight_cur = decoder->i_fontheight;
-                decoder->i_horint_cur = decoder->i_horint;
-                decoder->i_verint_cur = decoder->i_verint;
-                decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
-                decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+                decoder_set_font_size( decoder, 1, 1, 1, 1 );
                 decoder->b_need_next_region = true;
                 return 1;
             default:
@@ -806,16 +1006,39 @@ static int decoder_handle_szx( arib_decoder_t *decoder )
 static int decoder_handle_col( arib_decoder_t *decoder )
 {
     int c;
+    bool b_palette = false;
     while( decoder_pull( decoder, &c ) != 0 )
     {
         switch( c )
         {
             case 0x20:
+                b_palette = true;
                 break;
-            case 0x48:
-                decoder->i_foreground_alpha = 0xff; // fully transparent
-                return 1;
             default:
+                if( b_palette )
+                {
+                    decoder->i_palette = c & 0x0f;
+                    return 1;
+                }
+                if( c == 0x48 )
+                {
+                    decoder->i_foreground_alpha = 0xff; // fully transparent
+                }
+                switch( c & 0x70 )
+                {
+                    case 0x40: /* foreground */
+                        decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                                           ARIB_STYLE_COLOR_MASK,
+                                           decoder->i_palette * 16 + ( c & 0x0f ) );
+                        break;
+                    case 0x50: /* background */
+                        decoder_set_style( decoder, ARIB_STYLE_BACKGROUND_SHIFT,
+                                           ARIB_STYLE_COLOR_MASK,
+                                           decoder->i_palette * 16 + ( c & 0x0f ) );
+                        break;
+                    default: /* half intermediate colors */
+                        break;
+                }
                 return 1;
         }
     }
@@ -830,8 +1053,16 @@ static int decoder_handle_flc( arib_decoder_t *decoder )
         switch( c )
         {
             case 0x40:
+                decoder_set_style( decoder, ARIB_STYLE_FLASHING_SHIFT,
+                                   ARIB_STYLE_FLASHING_MASK, ARIB_FLASHING_NORMAL );
+                return 1;
             case 0x47:
+                decoder_set_style( decoder, ARIB_STYLE_FLASHING_SHIFT,
+                                   ARIB_STYLE_FLASHING_MASK, ARIB_FLASHING_INVERTED );
+                return 1;
             case 0x4f:
+                decoder_set_style( decoder, ARIB_STYLE_FLASHING_SHIFT,
+                                   ARIB_STYLE_FLASHING_MASK, ARIB_FLASHING_NONE );
                 return 1;
             default:
                 return 0;
@@ -847,9 +1078,11 @@ static int decoder_handle_cdc( arib_decoder_t *decoder )
     {
         switch( c )
         {
-            case 0x20:
+            case 0x20: /* replacing conceal, followed by its type */
                 break;
             default:
+                decoder_set_style( decoder, ARIB_STYLE_CONCEAL_SHIFT,
+                                   ARIB_STYLE_CONCEAL_MASK, c != 0x4f );
                 return 1;
         }
     }
@@ -866,6 +1099,8 @@ static int decoder_handle_pol( arib_decoder_t *decoder )
             case 0x40:
             case 0x41:
             case 0x42:
+                decoder_set_style( decoder, ARIB_STYLE_POLARITY_SHIFT,
+                                   ARIB_STYLE_POLARITY_MASK, c - 0x40 );
                 return 1;
             default:
                 return 0;
@@ -892,22 +1127,136 @@ static int decoder_handle_wmm( arib_decoder_t *decoder )
     return 0;
 }
 
-static int decoder_handle_macro( arib_decoder_t *decoder )
+static void decoder_compile_macro( decoder_macro_t *p_macro )
 {
+    /* replay the body on a scratch decoder, which only records G sets */
+    arib_decoder_t scratch;
+    memset( &scratch, 0, sizeof(scratch) );
+    for( int i = 0; i < 4; i++ )
+    {
+        scratch.i_gset[i] = -1;
+    }
+    scratch.i_gl = -1;
+    scratch.i_gr = -1;
+    scratch.buf = p_macro->p_body;
+    scratch.count = p_macro->i_body;
+
     int c;
-    while( decoder_pull( decoder, &c ) != 0 )
+    p_macro->b_state_only = true;
+    while( decoder_pull( &scratch, &c ) != 0 )
     {
-        switch( c )
+        if( c == 0x0e ) //LS1
         {
-            case 0x40:
-            case 0x41:
-            case 0x4f:
-                return 1;
-            default:
-                return 0;
+            scratch.i_gl = 1;
+        }
+        else if( c == 0x0f ) //LS0
+        {
+            scratch.i_gl = 0;
+        }
+        else if( c == 0x1b )
+        {
+            /* decoding a body stops at its first invalid sequence */
+            if( decoder_handle_esc( &scratch ) == 0 )
+            {
+                break;
+            }
+        }
+        else
+        {
+            p_macro->b_state_only = false;
+            break;
         }
     }
-    return 0;
+
+    for( int i = 0; i < 4; i++ )
+    {
+        p_macro->i_gset[i] = scratch.i_gset[i];
+    }
+    p_macro->i_gl = scratch.i_gl;
+    p_macro->i_gr = scratch.i_gr;
+}
+
+static bool decoder_define_macro( arib_decoder_t *decoder, int i_code,
+                                  const unsigned char *p_body, size_t i_body,
+                                  bool b_copy )
+{
+    decoder_macro_t *p_macro = &decoder->p_macros[i_code];
+    if( decoder->ubuf == NULL )
+    {
+        /* measuring: the input outlives the private macro table */
+        b_copy = false;
+    }
+    if( b_copy )
+    {
+        unsigned char *p_copy = (unsigned char*) arib_malloc(
+                decoder->p_instance, i_body ? i_body : 1 );
+        if( p_copy == NULL )
+        {
+            return false;
+        }
+        decoder->i_stat_allocations++;
+        memcpy( p_copy, p_body, i_body );
+        p_body = p_copy;
+    }
+    if( p_macro->b_owned )
+    {
+        arib_free( decoder->p_instance, (void*) p_macro->p_body );
+    }
+    p_macro->p_body = p_body;
+    p_macro->i_body = i_body;
+    p_macro->b_owned = b_copy;
+    decoder_compile_macro( p_macro );
+    return true;
+}
+
+static int decoder_handle_macro( arib_decoder_t *decoder )
+{
+    int c, i_code;
+    if( decoder_pull( decoder, &c ) == 0 )
+    {
+        return 0;
+    }
+    if( c == 0x4f )
+    {
+        /* end of a definition, already consumed with it */
+        return 1;
+    }
+    if( ( c != 0x40 && c != 0x41 ) || decoder_pull( decoder, &i_code ) == 0 ||
+        i_code < 0x21 || i_code > 0x7e )
+    {
+        return 0;
+    }
+
+    /* the definition runs up to MACRO 0x4f */
+    size_t i_body;
+    for( i_body = 0; i_body + 1 < decoder->count; i_body++ )
+    {
+        if( decoder->buf[i_body] == 0x95 && decoder->buf[i_body + 1] == 0x4f )
+        {
+            break;
+        }
+    }
+    if( i_body + 1 >= decoder->count )
+    {
+        decoder->b_need_more = true;
+        return 0;
+    }
+    if( !decoder_define_macro( decoder, i_code - 0x21, decoder->buf, i_body, true ) )
+    {
+        return 0;
+    }
+    if( decoder->ubuf != NULL )
+    {
+        decoder->p_instance->p->i_macro_generation++;
+    }
+    decoder->buf += i_body + 2;
+    decoder->count -= i_body + 2;
+
+    if( c == 0x41 )
+    {
+        return decoder_handle_macro_code( decoder, i_code - 0x21 );
+    }
+    return 1;
 }
 
 static int decoder_handle_hlc( arib_decoder_t *decoder )
@@ -933,6 +1282,8 @@ static int decoder_handle_hlc( arib_decoder_t *decoder )
             case 0x4d:
             case 0x4e:
             case 0x4f:
+                decoder_set_style( decoder, ARIB_STYLE_HIGHLIGHT_SHIFT,
+                                   ARIB_STYLE_HIGHLIGHT_MASK, c & 0x0f );
                 return 1;
             default:
                 return 0;
@@ -955,6 +1306,34 @@ static int decoder_handle_rpc( arib_decoder_t *decoder )
     return 0;
 }
 
+static void decoder_csi_params( const int *buf, int idx,
+                                int *pi_param1, int *pi_param2 )
+{
+    int i_sep = 0;
+    for( int i = 0; i < idx; i++ )
+    {
+        if( buf[i] == 0x0b )
+        {
+            i_sep = i;
+            break;
+        }
+    }
+    int i_param1 = 0;
+    for( int i = 0; i < i_sep; i++ )
+    {
+        i_param1 = i_param1 * 10;
+        i_param1 = i_param1 + buf[i];
+    }
+    int i_param2 = 0;
+    for( int i = i_sep + 1; i < idx; i++ )
+    {
+        i_param2 = i_param2 * 10;
+        i_param2 = i_param2 + buf[i];
+    }
+    *pi_param1 = i_param1;
+    *pi_param2 = i_param2;
+}
+
 static int decoder_handle_csi( arib_decoder_t *decoder )
 {
     int idx = 0;
@@ -990,27 +1369,8 @@ static int decoder_handle_csi( arib_decoder_t *decoder )
             case 0x54: //CCC
             case 0x56: //SDF
                 {
-                    int i_sep = 0;
-                    for( int i = 0; i < idx; i++ )
-                    {
-                        if( buf[i] == 0x0b )
-                        {
-                            i_sep = i;
-                            break;
-                        }
-                    }
-                    int i_param1 = 0;
-                    for( int i = 0; i < i_sep; i++ )
-                    {
-                        i_param1 = i_param1 * 10;
-                        i_param1 = i_param1 + buf[i];
-                    }
-                    int i_param2 = 0;
-                    for( int i = i_sep + 1; i < idx; i++ )
-                    {
-                        i_param2 = i_param2 * 10;
-                        i_param2 = i_param2 + buf[i];
-                    }
+                    int i_param1, i_param2;
+                    decoder_csi_params( buf, idx, &i_param1, &i_param2 );
                     decoder->i_width = i_param1;
                     decoder->i_height = i_param2;
                     decoder->i_right = decoder->i_left + decoder->i_width;
@@ -1025,27 +1385,8 @@ static int decoder_handle_csi( arib_decoder_t *decoder )
                 return 1;
             case 0x5f: //SDP
                 {
-                    int i_sep = 0;
-                    for( int i = 0; i < idx; i++ )
-                    {
-                        if( buf[i] == 0x0b )
-                        {
-                            i_sep = i;
-                            break;
-                        }
-                    }
-                    int i_param1 = 0;
-                    for( int i = 0; i < i_sep; i++ )
-                    {
-                        i_param1 = i_param1 * 10;
-                        i_param1 = i_param1 + buf[i];
-                    }
-                    int i_param2 = 0;
-                    for( int i = i_sep + 1; i < idx; i++ )
-                    {
-                        i_param2 = i_param2 * 10;
-                        i_param2 = i_param2 + buf[i];
-                    }
+                    int i_param1, i_param2;
+                    decoder_csi_params( buf, idx, &i_param1, &i_param2 );
                     decoder->i_left = i_param1;
                     decoder->i_top = i_param2;
                     decoder->i_right = decoder->i_left + decoder->i_width;
@@ -1056,35 +1397,31 @@ static int decoder_handle_csi( arib_decoder_t *decoder )
                 return 1;
             case 0x61: //ACPS
                 {
-                    int i_sep = 0;
-                    for( int i = 0; i < idx; i++ )
-                    {
-                        if( buf[i] == 0x0b )
-                        {
-                            i_sep = i;
-                            break;
-                        }
-                    }
-                    int i_param1 = 0;
-                    for( int i = 0; i < i_sep; i++ )
-                    {
-                        i_param1 = i_param1 * 10;
-                        i_param1 = i_param1 + buf[i];
-                    }
-                    int i_param2 = 0;
-                    for( int i = i_sep + 1; i < idx; i++ )
-                    {
-                        i_param2 = i_param2 * 10;
-                        i_param2 = i_param2 + buf[i];
-                    }
+                    int i_param1, i_param2;
+                    decoder_csi_params( buf, idx, &i_param1, &i_param2 );
                     decoder->i_charleft = i_param1;
                     decoder->i_charbottom = i_param2;
                 }
                 decoder->b_need_next_region = true;
                 return 1;
-            case 0x62: //TCC
             case 0x63: //ORN
-            case 0x64: //MDF
+                {
+                    int i_param1, i_param2;
+                    decoder_csi_params( buf, idx, &i_param1, &i_param2 );
+                    if( idx == 1 )
+                    {
+                        i_param1 = buf[0];
+                    }
+                    decoder_set_style( decoder, ARIB_STYLE_ORNAMENT_SHIFT,
+                                       ARIB_STYLE_ORNAMENT_MASK, i_param1 );
+                    /* P2: palette number and color, two digits each */
+                    decoder_set_style( decoder, ARIB_STYLE_ORNAMENT_COLOR_SHIFT,
+                                       ARIB_STYLE_COLOR_MASK,
+                                       ( i_param2 / 100 ) * 16 + i_param2 % 100 );
+                }
+                return 1;
+            case 0x62: //TCC
+            case 0x64: //MDF
             case 0x65: //CFS
             case 0x66: //XCS
             case 0x68: //PRA
@@ -1099,6 +1436,17 @@ static int decoder_handle_csi( arib_decoder_t *decoder )
     return 0;
 }
 
+/* TIME wait, in 0.1s: the text that follows is presented later, in a new
+ * region */
+static void decoder_add_wait( arib_decoder_t *decoder, int i_wait )
+{
+    if( i_wait > 0 )
+    {
+        decoder->i_control_time += i_wait;
+        decoder->b_need_next_region = true;
+    }
+}
+
 static int decoder_handle_time( arib_decoder_t *decoder )
 {
     int c;
@@ -1135,14 +1483,15 @@ static int decoder_handle_time( arib_decoder_t *decoder )
             case 0x41:
             case 0x42:
             case 0x43:
+                if( i_mode == 1 )
+                    decoder_add_wait( decoder, c & 0x3f );
                 if( i_mode != 0 )
                     return 1;
                 break;
             default:
                 if( i_mode == 1 && c >= 0x40 && c <= 0x7F )
-                    decoder->i_control_time += c & 0x3f;
-                    return 1;
-                return 0;
+                    decoder_add_wait( decoder, c & 0x3f );
+                return 1;
         }
         if( i_mode == 0 )
             return 0;
@@ -1160,67 +1509,68 @@ static int decoder_handle_c1( arib_decoder_t *decoder, int c )
             decoder->i_foreground_color_prev = decoder->i_foreground_color;
             decoder->i_foreground_color = 0x000000;
             decoder->i_color_map |= 0x0000;
+            decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                               ARIB_STYLE_COLOR_MASK, decoder->i_palette * 16 + 0 );
             return 1;
         case 0x81: //RDF
             decoder->i_foreground_color_prev = decoder->i_foreground_color;
             decoder->i_foreground_color = 0xFF0000;
             decoder->i_color_map |= 0x0001;
+            decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                               ARIB_STYLE_COLOR_MASK, decoder->i_palette * 16 + 1 );
             return 1;
         case 0x82: //GRF
             decoder->i_foreground_color_prev = decoder->i_foreground_color;
             decoder->i_foreground_color = 0x00FF00;
             decoder->i_color_map |= 0x0002;
+            decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                               ARIB_STYLE_COLOR_MASK, decoder->i_palette * 16 + 2 );
             return 1;
         case 0x83: //YLF
             decoder->i_foreground_color_prev = decoder->i_foreground_color;
             decoder->i_foreground_color = 0xFFFF00;
             decoder->i_color_map |= 0x0003;
+            decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                               ARIB_STYLE_COLOR_MASK, decoder->i_palette * 16 + 3 );
             return 1;
         case 0x84: //BLF
             decoder->i_foreground_color_prev = decoder->i_foreground_color;
             decoder->i_foreground_color = 0x0000FF;
             decoder->i_color_map |= 0x0004;
+            decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                               ARIB_STYLE_COLOR_MASK, decoder->i_palette * 16 + 4 );
             return 1;
         case 0x85: //MGF
             decoder->i_foreground_color_prev = decoder->i_foreground_color;
             decoder->i_foreground_color = 0xFF00FF;
             decoder->i_color_map |= 0x0005;
+            decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                               ARIB_STYLE_COLOR_MASK, decoder->i_palette * 16 + 5 );
             return 1;
         case 0x86: //CNF
             decoder->i_foreground_color_prev = decoder->i_foreground_color;
             decoder->i_foreground_color = 0x00FFFF;
             decoder->i_color_map |= 0x0006;
+            decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                               ARIB_STYLE_COLOR_MASK, decoder->i_palette * 16 + 6 );
             return 1;
         case 0x87: //WHF
             decoder->i_foreground_color_prev = decoder->i_foreground_color;
             decoder->i_foreground_color = 0xFFFFFF;
             decoder->i_color_map |= 0x0007;
+            decoder_set_style( decoder, ARIB_STYLE_FOREGROUND_SHIFT,
+                               ARIB_STYLE_COLOR_MASK, decoder->i_palette * 16 + 7 );
             return 1;
         case 0x88: //SSZ
-            decoder->i_fontwidth_cur = decoder->i_fontwidth / 2;
-            decoder->i_fontheight_cur = decoder->i_fontheight / 2;
-            decoder->i_horint_cur = decoder->i_horint / 2;
-            decoder->i_verint_cur = decoder->i_verint / 2;
-            decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
-            decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+            decoder_set_font_size( decoder, 1, 2, 1, 2 );
             decoder->b_need_next_region = true;
             return 1;
         case 0x89: //MSZ
-            decoder->i_fontwidth_cur = decoder->i_fontwidth / 2;
-            decoder->i_fontheight_cur = decoder->i_fontheight;
-            decoder->i_horint_cur = decoder->i_horint / 2;
-            decoder->i_verint_cur = decoder->i_verint;
-            decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
-            decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+            decoder_set_font_size( decoder, 1, 2, 1, 1 );
             decoder->b_need_next_region = true;
             return 1;
         case 0x8a: //NSZ
-            decoder->i_fontwidth_cur = decoder->i_fontwidth;
-            decoder->i_fontheight_cur = decoder->i_fontheight;
-            decoder->i_horint_cur = decoder->i_horint;
-            decoder->i_verint_cur = decoder->i_verint;
-            decoder->i_charwidth = decoder->i_fontwidth_cur + decoder->i_horint_cur;
-            decoder->i_charheight = decoder->i_fontheight_cur + decoder->i_verint_cur;
+            decoder_set_font_size( decoder, 1, 1, 1, 1 );
             decoder->b_need_next_region = true;
             return 1;
         case 0x8b: //SZX
@@ -1253,113 +1603,191 @@ static int decoder_handle_c1( arib_decoder_t *decoder, int c )
     }
 }
 
-static int arib_decode( arib_decoder_t *decoder );
-static int decoder_handle_default_macro( arib_decoder_t *decoder, int c )
+static const decoder_input_t decoder_default_macros[16] =
 {
-    c=c+0x21;
-    if( c >= 0x60 && c <= 0x6f )
+    { decoder_default_macro_0, sizeof(decoder_default_macro_0) },
+    { decoder_default_macro_1, sizeof(decoder_default_macro_1) },
+    { decoder_default_macro_2, sizeof(decoder_default_macro_2) },
+    { decoder_default_macro_3, sizeof(decoder_default_macro_3) },
+    { decoder_default_macro_4, sizeof(decoder_default_macro_4) },
+    { decoder_default_macro_5, sizeof(decoder_default_macro_5) },
+    { decoder_default_macro_6, sizeof(decoder_default_macro_6) },
+    { decoder_default_macro_7, sizeof(decoder_default_macro_7) },
+    { decoder_default_macro_8, sizeof(decoder_default_macro_8) },
+    { decoder_default_macro_9, sizeof(decoder_default_macro_9) },
+    { decoder_default_macro_a, sizeof(decoder_default_macro_a) },
+    { decoder_default_macro_b, sizeof(decoder_default_macro_b) },
+    { decoder_default_macro_c, sizeof(decoder_default_macro_c) },
+    { decoder_default_macro_d, sizeof(decoder_default_macro_d) },
+    { decoder_default_macro_e, sizeof(decoder_default_macro_e) },
+    { decoder_default_macro_f, sizeof(decoder_default_macro_f) },
+};
+
+static int decoder_handle_macro_code( arib_decoder_t *decoder, int c )
+{
+    const decoder_macro_t *p_macro = &decoder->p_macros[c];
+    if( p_macro->p_body == NULL )
     {
-        const unsigned char* macro;
-        int size;
-        switch( c )
+        return 0;
+    }
+
+    if( p_macro->b_state_only )
+    {
+        for( int i = 0; i < 4; i++ )
         {
-            case 0x60:
-                macro = decoder_default_macro_0;
-                size = sizeof(decoder_default_macro_0);
-                break;
-            case 0x61:
-                macro = decoder_default_macro_1;
-                size = sizeof(decoder_default_macro_1);
-                break;
-            case 0x62:
-                macro = decoder_default_macro_2;
-                size = sizeof(decoder_default_macro_2);
-                break;
-            case 0x63:
-                macro = decoder_default_macro_3;
-                size = sizeof(decoder_default_macro_3);
-                break;
-            case 0x64:
-                macro = decoder_default_macro_4;
-                size = sizeof(decoder_default_macro_4);
-                break;
-            case 0x65:
-                macro = decoder_default_macro_5;
-                size = sizeof(decoder_default_macro_5);
-                break;
-            case 0x66:
-                macro = decoder_default_macro_6;
-                size = sizeof(decoder_default_macro_6);
-                break;
-            case 0x67:
-                macro = decoder_default_macro_7;
-                size = sizeof(decoder_default_macro_7);
-                break;
-            case 0x68:
-                macro = decoder_default_macro_8;
-                size = sizeof(decoder_default_macro_8);
-                break;
-            case 0x69:
-                macro = decoder_default_macro_9;
-                size = sizeof(decoder_default_macro_9);
-                break;
-            case 0x6a:
-                macro = decoder_default_macro_a;
-                size = sizeof(decoder_default_macro_a);
-                break;
-            case 0x6b:
-                macro = decoder_default_macro_b;
-                size = sizeof(decoder_default_macro_b);
-                break;
-            case 0x6c:
-                macro = decoder_default_macro_c;
-                size = sizeof(decoder_default_macro_c);
-                break;
-            case 0x6d:
-                macro = decoder_default_macro_d;
-                size = sizeof(decoder_default_macro_d);
-                break;
-            case 0x6e:
-                macro = decoder_default_macro_e;
-                size = sizeof(decoder_default_macro_e);
-                break;
-            case 0x6f:
-                macro = decoder_default_macro_f;
-                size = sizeof(decoder_default_macro_f);
-                break;
+            if( p_macro->i_gset[i] >= 0 )
+            {
+                decoder->i_gset[i] = p_macro->i_gset[i];
+            }
+        }
+        if( p_macro->i_gl >= 0 )
+        {
+            decoder->i_gl = p_macro->i_gl;
         }
+        if( p_macro->i_gr >= 0 )
         {
-            const unsigned char* buf = decoder->buf;
-            size_t count = decoder->count;
-            decoder->buf = macro;
-            decoder->count = size;
-            arib_decode( decoder );
-            decoder->buf = buf;
-            decoder->count = count;
+            decoder->i_gr = p_macro->i_gr;
         }
         return 1;
     }
-    return 0;
+
+    if( !decoder->b_macros )
+    {
+        /* not used by the C profile */
+        return 1;
+    }
+
+    if( decoder->i_macro_depth == DECODER_MACRO_DEPTH )
+    {
+        arib_log( decoder->p_instance, ARIB_LOG_WARNING,
+                  "ARIB macros nested too deeply" );
+        return 0;
+    }
+
+    if( decoder->i_macro_depth == 0 && decoder->ubuf != NULL )
+    {
+        decoder_macro_undo_t *p_undo = decoder->p_macro_undo;
+        if( p_undo == NULL )
+        {
+            p_undo = decoder->p_macro_undo =
+                (decoder_macro_undo_t*) arib_malloc( decoder->p_instance,
+                                                     sizeof(*p_undo) );
+            if( p_undo == NULL )
+            {
+                return 0;
+            }
+            decoder->i_stat_allocations++;
+        }
+        p_undo->decoder = *decoder;
+        p_undo->p_tail = decoder->p_region_last;
+        if( p_undo->p_tail != NULL )
+        {
+            p_undo->tail = *p_undo->p_tail;
+        }
+        if( decoder->i_runs > 0 )
+        {
+            p_undo->last_run = decoder->p_runs[decoder->i_runs - 1];
+        }
+    }
+
+    decoder_input_t *p_input = &decoder->macro_stack[decoder->i_macro_depth++];
+    p_input->buf = decoder->buf;
+    p_input->count = decoder->count;
+    decoder->buf = p_macro->p_body;
+    decoder->count = p_macro->i_body;
+    return 1;
 }
 
+/* Drop what the outermost macro being decoded added, leaving the decoder as
+ * it was before the macro was invoked */
+static void decoder_macro_undo( arib_decoder_t *decoder )
+{
+    decoder_macro_undo_t *p_undo = decoder->p_macro_undo;
+    arib_buf_region_t *p_region, *p_region_next;
+
+    p_region = p_undo->p_tail ? p_undo->p_tail->p_next : decoder->p_region;
+    for( ; p_region; p_region = p_region_next )
+    {
+        p_region_next = p_region->p_next;
+        arib_free( decoder->p_instance, p_region );
+    }
+    if( p_undo->p_tail != NULL )
+    {
+        *p_undo->p_tail = p_undo->tail;
+    }
+
+    arib_styled_run_t *p_runs = decoder->p_runs;
+    size_t i_runs_alloc = decoder->i_runs_alloc;
+    *decoder = p_undo->decoder;
+    decoder->p_runs = p_runs;
+    decoder->i_runs_alloc = i_runs_alloc;
+    if( decoder->i_runs > 0 )
+    {
+        decoder->p_runs[decoder->i_runs - 1] = p_undo->last_run;
+    }
+    decoder->b_output_full = true;
+}
+
+/* bytes shown before the position decoding stopped at */
+#define DECODER_DUMP_SIZE 64
+
 static void dump( arib_instance_t *p_instance,
                   const unsigned char *start, const unsigned char *end )
 {
-    arib_log( p_instance, "could not decode ARIB string:" );
+    if( !arib_log_enabled( p_instance, ARIB_LOG_WARNING ) )
+    {
+        return;
+    }
+
+    char psz_hex[3 * DECODER_DUMP_SIZE + 1];
+    char *p = psz_hex;
+    const char *psz_more = "";
+    if( end - start > DECODER_DUMP_SIZE )
+    {
+        start = end - DECODER_DUMP_SIZE;
+        psz_more = "... ";
+    }
+    *p = '\0';
     while( start < end )
     {
-        arib_log( p_instance, "%02x ", *start++ );
+        p += sprintf( p, "%02x ", *start++ );
     }
-    arib_log( p_instance, "<- here" );
+    arib_log_message( p_instance, "could not decode ARIB string: %s%s<- here",
+                      psz_more, psz_hex );
 }
 
-static int arib_decode( arib_decoder_t *decoder )
+/* Instantiated once per value of b_macros, so that the C profile loop
+ * carries no macro bookkeeping */
+static inline int decoder_decode_loop( arib_decoder_t *decoder,
+                                       const bool b_macros )
 {
     int (*handle)(arib_decoder_t *, int);
     int c;
+    const unsigned char *p_char = decoder->buf;
+    int i_gl_single = decoder->i_gl_single;
     /* ARIB STD-B24 VOLUME 1 Part 2 Chapter 7 Figure 7-1 Code Table */
-    while( decoder_pull( decoder, &c ) != 0 )
+    for( ;; )
     {
+        if( b_macros && decoder->count == 0 && decoder->i_macro_depth > 0 )
+        {
+            /* end of a macro body, back to the input that invoked it */
+            decoder_input_t *p_input = &decoder->macro_stack[--decoder->i_macro_depth];
+            decoder->buf = p_input->buf;
+            decoder->count = p_input->count;
+            continue;
+        }
+        if( decoder_pull( decoder, &c ) == 0 )
+        {
+            break;
+        }
+        const unsigned char *p_elem = decoder->buf - 1;
+        if( decoder->kanji_ku < 0 && ( !b_macros || decoder->i_macro_depth == 0 ) )
+        {
+            /* character boundary, where decoding resumes on a full output;
+             * macros are resumed from their invocation */
+            p_char = p_elem;
+            i_gl_single = decoder->i_gl_single;
+        }
         if( c < 0x20 )
         {
             handle = decoder_handle_c0;
@@ -1376,28 +1804,88 @@ static int arib_decode( arib_decoder_t *decoder )
         {
             handle = decoder_handle_gr;
         }
+        decoder->b_need_more = false;
         if( handle( decoder, c )  == 0 )
         {
+            if( b_macros && decoder->i_macro_depth > 0 )
+            {
+                if( !decoder->b_output_full )
+                {
+                    /* invalid or truncated macro body, skip the rest of it */
+                    decoder->count = 0;
+                    decoder->kanji_ku = -1;
+                    continue;
+                }
+                decoder_macro_undo( decoder );
+            }
+            if( decoder->b_output_full )
+            {
+                decoder->count += decoder->buf - p_char;
+                decoder->buf = p_char;
+                decoder->kanji_ku = -1;
+                decoder->i_gl_single = i_gl_single;
+            }
+            else if( decoder->b_need_more )
+            {
+                /* the input ends inside a control sequence, which control
+                 * handlers only apply once complete: rewind to its start */
+                decoder->count += decoder->buf - p_elem;
+                decoder->buf = p_elem;
+            }
             return 0;
         }
     }
     return 1;
 }
 
+static int decoder_decode_macros( arib_decoder_t *decoder )
+{
+    return decoder_decode_loop( decoder, true );
+}
+
+static int decoder_decode_plain( arib_decoder_t *decoder )
+{
+    return decoder_decode_loop( decoder, false );
+}
+
+static int arib_decode( arib_decoder_t *decoder )
+{
+    return decoder->b_macros ? decoder_decode_macros( decoder ) :
+                               decoder_decode_plain( decoder );
+}
+
+/* Resolve the instance options once instead of for every character */
+static void decoder_bind_tables( arib_decoder_t *decoder )
+{
+    decoder->p_kanji_table = decoder->p_instance->b_use_private_conv ?
+                             decoder_kanji_private_table16 :
+                             decoder_kanji_table16;
+    decoder->p_kanji_supplementary =
+        decoder_kanji_supplementary[decoder->p_instance->b_replace_ellipsis];
+}
+
 void arib_initialize_decoder( arib_decoder_t* decoder )
 {
     arib_finalize_decoder( decoder );
+    decoder_bind_tables( decoder );
     decoder->buf = NULL;
     decoder->count = 0;
     decoder->ubuf = NULL;
     decoder->ucount = 0;
-    decoder->handle_gl = &decoder->handle_g0;
-    decoder->handle_gl_single = NULL;
-    decoder->handle_gr = &decoder->handle_g2;
-    decoder->handle_g0 = decoder_handle_kanji;
-    decoder->handle_g1 = decoder_handle_alnum;
-    decoder->handle_g2 = decoder_handle_hiragana;
-    decoder->handle_g3 = decoder_handle_katakana;
+    decoder->i_encoding = DECODER_ENCODING_UTF8;
+    decoder->ubuf_base = NULL;
+    decoder->b_output_full = false;
+    decoder->b_need_more = false;
+    decoder->i_carry = 0;
+    decoder->i_macro_depth = 0;
+    decoder->b_macros = true;
+    decoder->i_gl = 0;
+    decoder->i_gl_single = -1;
+    decoder->i_gr = 2;
+    decoder->i_gset[0] = DECODER_SET_KANJI;
+    decoder->i_gset[1] = DECODER_SET_ALNUM;
+    decoder->i_gset[2] = DECODER_SET_HIRAGANA;
+    decoder->i_gset[3] = DECODER_SET_KATAKANA;
     decoder->kanji_ku = -1;
 
     decoder->i_control_time = 0;
@@ -1436,36 +1924,79 @@ void arib_initialize_decoder( arib_decoder_t* decoder )
     decoder->i_charleft = 0;
     decoder->i_charbottom = 0;
 
-    memset( decoder->p_instance->p->drcs_conv_table, 0,
-            sizeof(decoder->p_instance->p->drcs_conv_table) );
+    decoder_update_layout_adjust( decoder );
 
-    apply_drcs_conversion_table( decoder->p_instance );
+    decoder->i_palette = 0;
+    decoder->i_style = ( 7 << ARIB_STYLE_FOREGROUND_SHIFT ) |
+                       ( 8 << ARIB_STYLE_BACKGROUND_SHIFT );
 
     decoder->p_region = NULL;
+    decoder->p_region_last = NULL;
     decoder->b_need_next_region = true;
+    decoder->i_runs = 0;
 }
 
-static void arib_initialize_decoder_size_related( arib_decoder_t* decoder,
-        int i_planewidth, int i_planeheight, int i_width, int i_height, int i_left, int i_top,
-        int i_fontwidth, int i_fontheight, int i_horint, int i_verint
-        )
+/* Initial designations and geometry of a profile */
+typedef struct
+{
+    int i_gset[4];
+    bool b_macros;
+    int i_planewidth;
+    int i_planeheight;
+    int i_width;
+    int i_height;
+    int i_left;
+    int i_top;
+    int i_fontwidth;
+    int i_fontheight;
+    int i_horint;
+    int i_verint;
+} decoder_profile_t;
+
+static const decoder_profile_t decoder_profile_a =
 {
-    decoder->i_planewidth = i_planewidth;
-    decoder->i_planeheight = i_planeheight;
+    .i_gset = { DECODER_SET_KANJI, DECODER_SET_ALNUM,
+                DECODER_SET_HIRAGANA, DECODER_SET_MACRO },
+    .b_macros = true,
+    .i_planewidth = 960, .i_planeheight = 540,
+    .i_width = 620, .i_height = 480, .i_left = 170, .i_top = 30,
+    .i_fontwidth = 36, .i_fontheight = 36, .i_horint = 4, .i_verint = 24,
+};
 
-    decoder->i_width = i_width;
-    decoder->i_height = i_height;
-    decoder->i_left = i_left;
-    decoder->i_top = i_top;
+/* 1seg captions use neither macros nor the default macro set */
+static const decoder_profile_t decoder_profile_c =
+{
+    .i_gset = { DECODER_SET_DRCS, DECODER_SET_ALNUM,
+                DECODER_SET_KANJI, DECODER_SET_KATAKANA },
+    .b_macros = false,
+    .i_planewidth = 320, .i_planeheight = 180,
+    .i_width = 300, .i_height = 160, .i_left = 0, .i_top = 0,
+    .i_fontwidth = 18, .i_fontheight = 18, .i_horint = 2, .i_verint = 12,
+};
 
-    decoder->i_fontwidth = decoder->i_fontwidth_cur = i_fontwidth;
-    decoder->i_fontheight = decoder->i_fontheight_cur = i_fontheight;
+static void decoder_initialize_profile( arib_decoder_t* decoder,
+                                        const decoder_profile_t *p_profile )
+{
+    arib_initialize_decoder( decoder );
+
+    memcpy( decoder->i_gset, p_profile->i_gset, sizeof(decoder->i_gset) );
+    decoder->b_macros = p_profile->b_macros;
+
+    decoder->i_planewidth = p_profile->i_planewidth;
+    decoder->i_planeheight = p_profile->i_planeheight;
+
+    decoder->i_width = p_profile->i_width;
+    decoder->i_height = p_profile->i_height;
+    decoder->i_left = p_profile->i_left;
+    decoder->i_top = p_profile->i_top;
 
-    decoder->i_horint = decoder->i_horint_cur = i_horint;
-    decoder->i_verint = decoder->i_verint_cur = i_verint;
+    decoder->i_fontwidth = decoder->i_fontwidth_cur = p_profile->i_fontwidth;
+    decoder->i_fontheight = decoder->i_fontheight_cur = p_profile->i_fontheight;
 
-    decoder->i_charwidth = decoder->i_fontwidth + decoder->i_horint;
-    decoder->i_charheight = decoder->i_fontheight + decoder->i_verint;
+    decoder->i_horint = decoder->i_horint_cur = p_profile->i_horint;
+    decoder->i_verint = decoder->i_verint_cur = p_profile->i_verint;
+
+    decoder_set_font_size( decoder, 1, 1, 1, 1 );
 
     decoder->i_right = decoder->i_left + decoder->i_width;
     decoder->i_bottom = decoder->i_top + decoder->i_height;
@@ -1476,25 +2007,12 @@ static void arib_initialize_decoder_size_related( arib_decoder_t* decoder,
 
 void arib_initialize_decoder_a_profile( arib_decoder_t* decoder )
 {
-    arib_initialize_decoder( decoder );
-
-    decoder->handle_g3 = decoder_handle_default_macro;
-
-    arib_initialize_decoder_size_related( decoder,
-                960, 540, 620, 480, 170, 30,
-                36, 36, 4, 24);
+    decoder_initialize_profile( decoder, &decoder_profile_a );
 }
 
 void arib_initialize_decoder_c_profile( arib_decoder_t* decoder )
 {
-    arib_initialize_decoder( decoder );
-
-    decoder->handle_g0 = decoder_handle_drcs;
-    decoder->handle_g2 = decoder_handle_kanji;
-
-    arib_initialize_decoder_size_related( decoder,
-            320, 180, 300, 160, 0, 0,
-            18, 18, 2, 12);
+    decoder_initialize_profile( decoder, &decoder_profile_c );
 }
 
 void arib_finalize_decoder( arib_decoder_t* decoder )
@@ -1503,53 +2021,581 @@ void arib_finalize_decoder( arib_decoder_t* decoder )
     for( p_region = decoder->p_region; p_region; p_region = p_region_next )
     {
         p_region_next = p_region->p_next;
-        free( p_region );
+        arib_free( decoder->p_instance, p_region );
     }
     decoder->p_region = NULL;
+    decoder->p_region_last = NULL;
+    decoder->i_runs = 0;
+    decoder->b_clear_screen = false;
+    decoder->i_clear_offset = 0;
 }
 
-size_t arib_decode_buffer( arib_decoder_t* decoder,
-                           const unsigned char *buf, size_t count,
-                           char *ubuf, size_t ucount )
+static void decoder_stats_begin( arib_decoder_t *decoder )
+{
+    memset( decoder->i_stat_chars, 0, sizeof(decoder->i_stat_chars) );
+    decoder->i_stat_regions = 0;
+    decoder->i_stat_allocations = 0;
+}
+
+/* Counters are added to the instance once per call, not per character */
+static void decoder_stats_end( arib_decoder_t *decoder, bool b_failed,
+                               uint64_t i_start )
+{
+    arib_instance_t *p_instance = decoder->p_instance;
+    static const int stat_chars[DECODER_SET_DRCS + 1] =
+    {
+        [DECODER_SET_KANJI]    = ARIB_STAT_KANJI_CHARS,
+        [DECODER_SET_ALNUM]    = ARIB_STAT_ALNUM_CHARS,
+        [DECODER_SET_HIRAGANA] = ARIB_STAT_HIRAGANA_CHARS,
+        [DECODER_SET_KATAKANA] = ARIB_STAT_KATAKANA_CHARS,
+        [DECODER_SET_DRCS]     = ARIB_STAT_DRCS_CHARS,
+    };
+    for( int i = 0; i <= DECODER_SET_DRCS; i++ )
+    {
+        if( decoder->i_stat_chars[i] )
+        {
+            arib_stats_add( p_instance, stat_chars[i], decoder->i_stat_chars[i] );
+        }
+    }
+    if( decoder->i_stat_regions )
+    {
+        arib_stats_add( p_instance, ARIB_STAT_REGIONS, decoder->i_stat_regions );
+    }
+    if( decoder->i_stat_allocations )
+    {
+        arib_stats_add( p_instance, ARIB_STAT_DECODER_ALLOCATIONS,
+                        decoder->i_stat_allocations );
+    }
+    if( b_failed )
+    {
+        arib_stats_add( p_instance, ARIB_STAT_DECODE_FAILURES, 1 );
+    }
+    arib_stats_time_end( p_instance, ARIB_STAT_DECODE_NS, i_start );
+}
+
+static int decoder_decode_buffer( arib_decoder_t* decoder,
+                                  const unsigned char *buf, size_t count,
+                                  void *ubuf, size_t ucount,
+                                  int i_encoding )
 {
+    uint64_t i_start = arib_stats_time_begin( &decoder->i_stat_calls );
+    decoder_stats_begin( decoder );
+    ARIB_PROBE2( decode_entry, decoder, count );
     decoder->buf = buf;
     decoder->count = count;
     decoder->ubuf = ubuf;
     decoder->ucount = ucount;
+    decoder->i_encoding = i_encoding;
+    decoder->b_output_full = false;
 
-    if( arib_decode( decoder ) == 0 )
+    int i_ret = arib_decode( decoder );
+    bool b_failed = i_ret == 0 && !decoder->b_output_full;
+    if( b_failed )
     {
+        ARIB_PROBE2( decode_failure, decoder, decoder->buf - buf );
         dump( decoder->p_instance, buf, decoder->buf );
     }
+    ARIB_PROBE3( decode_exit, decoder, count - decoder->count,
+                 ucount - decoder->ucount );
+    decoder_stats_end( decoder, b_failed, i_start );
+    return i_ret;
+}
+
+static void decoder_rebase_regions( arib_decoder_t *decoder,
+                                    const char *p_old, size_t i_size,
+                                    char *p_new )
+{
+    uintptr_t i_old = (uintptr_t) p_old;
+    arib_buf_region_t *p_region;
+    for( p_region = decoder->p_region; p_region; p_region = p_region->p_next )
+    {
+        uintptr_t i_start = (uintptr_t) p_region->p_start;
+        uintptr_t i_end = (uintptr_t) p_region->p_end;
+        if( i_start >= i_old && i_end <= i_old + i_size )
+        {
+            p_region->p_start = p_new + ( i_start - i_old );
+            p_region->p_end = p_new + ( i_end - i_old );
+        }
+    }
+}
+
+/* Sets the typed pointers of the regions a call created or extended, given
+ * the last region before it and where that one ended. Regions of earlier
+ * calls keep the pointers into their own buffer. */
+static void decoder_type_regions( arib_decoder_t *decoder,
+                                  arib_buf_region_t *p_last,
+                                  const char *p_last_end, int i_encoding )
+{
+    arib_buf_region_t *p_region = p_last;
+    if( p_region == NULL )
+    {
+        p_region = decoder->p_region;
+    }
+    else if( p_region->p_end == p_last_end )
+    {
+        p_region = p_region->p_next;
+    }
+
+    bool b_utf16 = i_encoding == DECODER_ENCODING_UTF16;
+    bool b_utf32 = i_encoding == DECODER_ENCODING_UTF32;
+    for( ; p_region; p_region = p_region->p_next )
+    {
+        p_region->p_start16 = b_utf16 ? (uint16_t*) p_region->p_start : NULL;
+        p_region->p_end16 = b_utf16 ? (uint16_t*) p_region->p_end : NULL;
+        p_region->p_start32 = b_utf32 ? (uint32_t*) p_region->p_start : NULL;
+        p_region->p_end32 = b_utf32 ? (uint32_t*) p_region->p_end : NULL;
+    }
+}
+
+static int decoder_decode_stream( arib_decoder_t* decoder,
+                                  const unsigned char *buf, size_t count,
+                                  char *ubuf, size_t ucount,
+                                  size_t *pi_consumed )
+{
+    uint64_t i_start = arib_stats_time_begin( &decoder->i_stat_calls );
+    decoder_stats_begin( decoder );
+    ARIB_PROBE2( decode_entry, decoder, count );
+    decoder->ubuf = ubuf;
+    decoder->ucount = ucount;
+    decoder->i_encoding = DECODER_ENCODING_UTF8;
+    decoder->b_output_full = false;
+
+    size_t i_consumed = 0;
+    if( decoder->i_carry > 0 )
+    {
+        /* complete the pending control sequence from the new input */
+        size_t i_old = decoder->i_carry;
+        size_t i_add = sizeof(decoder->carry) - i_old;
+        if( i_add > count )
+        {
+            i_add = count;
+        }
+        memcpy( decoder->carry + i_old, buf, i_add );
+        decoder->buf = decoder->carry;
+        decoder->count = i_old + i_add;
+        if( arib_decode( decoder ) == 0 )
+        {
+            if( decoder->b_output_full ||
+                ( decoder->b_need_more && i_add == count ) )
+            {
+                memmove( decoder->carry, decoder->buf, decoder->count );
+                decoder->i_carry = decoder->count;
+                *pi_consumed = i_add;
+                ARIB_PROBE3( decode_exit, decoder, i_add, ucount - decoder->ucount );
+                decoder_stats_end( decoder, false, i_start );
+                return 0;
+            }
+            /* undecodable, or longer than DECODER_CARRY_SIZE */
+            ARIB_PROBE2( decode_failure, decoder, decoder->buf - decoder->carry );
+            dump( decoder->p_instance, decoder->carry, decoder->buf );
+            size_t i_used = i_old + i_add - decoder->count;
+            decoder->i_carry = 0;
+            decoder->b_need_more = false;
+            *pi_consumed = i_used > i_old ? i_used - i_old : 0;
+            ARIB_PROBE3( decode_exit, decoder, *pi_consumed,
+                         ucount - decoder->ucount );
+            decoder_stats_end( decoder, true, i_start );
+            return 0;
+        }
+        decoder->i_carry = 0;
+        i_consumed = i_add;
+    }
+
+    decoder->buf = buf + i_consumed;
+    decoder->count = count - i_consumed;
+    int i_ret = arib_decode( decoder );
+    bool b_failed = false;
+    if( i_ret == 0 && decoder->b_need_more &&
+        decoder->count <= sizeof(decoder->carry) )
+    {
+        memcpy( decoder->carry, decoder->buf, decoder->count );
+        decoder->i_carry = decoder->count;
+        decoder->buf += decoder->count;
+        decoder->count = 0;
+    }
+    else if( i_ret == 0 && !decoder->b_output_full )
+    {
+        decoder->b_need_more = false;
+        ARIB_PROBE2( decode_failure, decoder, decoder->buf - buf );
+        dump( decoder->p_instance, buf, decoder->buf );
+        b_failed = true;
+    }
+    *pi_consumed = count - decoder->count;
+    ARIB_PROBE3( decode_exit, decoder, *pi_consumed, ucount - decoder->ucount );
+    decoder_stats_end( decoder, b_failed, i_start );
+    return i_ret;
+}
+
+/* Decodes on a copy of the decoder and of its macro table, so that the
+ * decoder state is left untouched, macro definitions included */
+static arib_decode_status_t decoder_measure( arib_decoder_t* decoder,
+                                             const unsigned char *buf, size_t count,
+                                             size_t *pi_consumed, size_t *pi_written,
+                                             bool b_stream )
+{
+    decoder_macro_t macros[DECODER_MACRO_COUNT];
+    memcpy( macros, decoder->p_macros, sizeof(macros) );
+    for( int i = 0; i < DECODER_MACRO_COUNT; i++ )
+    {
+        /* the bodies stay owned by the real table */
+        macros[i].b_owned = false;
+    }
+
+    /* a sequence left pending by the previous stream chunk comes first */
+    size_t i_carry = b_stream ? decoder->i_carry : 0;
+    unsigned char *p_input = NULL;
+    if( i_carry > 0 )
+    {
+        p_input = (unsigned char*) arib_malloc( decoder->p_instance,
+                                                i_carry + count );
+        if( p_input == NULL )
+        {
+            return ARIB_DECODE_ERROR;
+        }
+        memcpy( p_input, decoder->carry, i_carry );
+        memcpy( p_input + i_carry, buf, count );
+    }
+
+    arib_decoder_t measure = *decoder;
+    measure.p_macros = macros;
+    measure.buf = p_input ? p_input : buf;
+    measure.count = i_carry + count;
+    measure.ubuf = NULL;
+    measure.ucount = SIZE_MAX;
+    measure.i_encoding = DECODER_ENCODING_UTF8;
+    measure.b_need_more = false;
+    measure.i_carry = 0;
+    int i_ret = arib_decode( &measure );
+    size_t i_used = i_carry + count - measure.count;
+    *pi_consumed = i_used > i_carry ? i_used - i_carry : 0;
+    *pi_written = SIZE_MAX - measure.ucount;
+    arib_free( decoder->p_instance, p_input );
+
+    if( i_ret == 0 && b_stream && measure.b_need_more )
+    {
+        return ARIB_DECODE_NEED_MORE;
+    }
+    return i_ret ? ARIB_DECODE_OK : ARIB_DECODE_ERROR;
+}
+
+static arib_decode_status_t decoder_decode_ex( arib_decoder_t* decoder,
+                                               const unsigned char *buf, size_t count,
+                                               char *ubuf, size_t ucount,
+                                               size_t *pi_consumed, size_t *pi_written,
+                                               bool b_stream )
+{
+    if( ubuf == NULL )
+    {
+        return decoder_measure( decoder, buf, count, pi_consumed, pi_written,
+                                b_stream );
+    }
+
+    size_t i_done = *pi_written;
+    if( i_done > 0 && decoder->ubuf_base != NULL && decoder->ubuf_base != ubuf )
+    {
+        /* the caller grew the buffer of an interrupted decode */
+        decoder_rebase_regions( decoder, decoder->ubuf_base, i_done, ubuf );
+    }
+    decoder->ubuf_base = ubuf;
+
+    if( ucount <= i_done + 1 )
+    {
+        *pi_consumed = 0;
+        if( ucount > i_done )
+            ubuf[ i_done ] = 0;
+        return count ? ARIB_DECODE_OUTPUT_FULL : ARIB_DECODE_OK;
+    }
+
+    /* keep room for the terminating NUL */
+    size_t i_size = ucount - i_done - 1;
+    arib_buf_region_t *p_last = decoder->p_region_last;
+    const char *p_last_end = p_last ? p_last->p_end : NULL;
+    int i_ret;
+    if( b_stream )
+    {
+        i_ret = decoder_decode_stream( decoder, buf, count,
+                                       ubuf + i_done, i_size, pi_consumed );
+    }
+    else
+    {
+        i_ret = decoder_decode_buffer( decoder, buf, count,
+                                       ubuf + i_done, i_size,
+                                       DECODER_ENCODING_UTF8 );
+        *pi_consumed = count - decoder->count;
+    }
+    *pi_written = i_done + i_size - decoder->ucount;
+    ubuf[ *pi_written ] = 0;
+    decoder_type_regions( decoder, p_last, p_last_end, DECODER_ENCODING_UTF8 );
+
+    if( decoder->b_output_full )
+    {
+        return ARIB_DECODE_OUTPUT_FULL;
+    }
+    if( i_ret == 0 && b_stream && decoder->b_need_more )
+    {
+        return ARIB_DECODE_NEED_MORE;
+    }
+    return i_ret ? ARIB_DECODE_OK : ARIB_DECODE_ERROR;
+}
+
+arib_decode_status_t arib_decode_buffer_ex( arib_decoder_t* decoder,
+                                            const unsigned char *buf, size_t count,
+                                            char *ubuf, size_t ucount,
+                                            size_t *pi_consumed, size_t *pi_written )
+{
+    return decoder_decode_ex( decoder, buf, count, ubuf, ucount,
+                              pi_consumed, pi_written, false );
+}
+
+arib_decode_status_t arib_decode_buffer_stream( arib_decoder_t* decoder,
+                                                const unsigned char *buf, size_t count,
+                                                char *ubuf, size_t ucount,
+                                                size_t *pi_consumed, size_t *pi_written )
+{
+    return decoder_decode_ex( decoder, buf, count, ubuf, ucount,
+                              pi_consumed, pi_written, true );
+}
+
+size_t arib_decode_buffer( arib_decoder_t* decoder,
+                           const unsigned char *buf, size_t count,
+                           char *ubuf, size_t ucount )
+{
+    arib_buf_region_t *p_last = decoder->p_region_last;
+    const char *p_last_end = p_last ? p_last->p_end : NULL;
+    decoder->ubuf_base = ubuf;
+    decoder_decode_buffer( decoder, buf, count, ubuf, ucount,
+                           DECODER_ENCODING_UTF8 );
     size_t i_size = ucount - decoder->ucount;
     if ( ucount )
         ubuf[ i_size ] = 0;
+    decoder_type_regions( decoder, p_last, p_last_end, DECODER_ENCODING_UTF8 );
+    return i_size;
+}
+
+size_t arib_decode_buffer16( arib_decoder_t* decoder,
+                             const unsigned char *buf, size_t count,
+                             uint16_t *ubuf, size_t ucount )
+{
+    if( ucount == 0 )
+    {
+        return 0;
+    }
+    /* keep room for the terminating NUL unit */
+    size_t i_size = ( ucount - 1 ) * sizeof(*ubuf);
+    arib_buf_region_t *p_last = decoder->p_region_last;
+    const char *p_last_end = p_last ? p_last->p_end : NULL;
+    decoder->ubuf_base = (char*) ubuf;
+    decoder_decode_buffer( decoder, buf, count, ubuf, i_size,
+                           DECODER_ENCODING_UTF16 );
+    i_size = ( i_size - decoder->ucount ) / sizeof(*ubuf);
+    ubuf[ i_size ] = 0;
+    decoder_type_regions( decoder, p_last, p_last_end, DECODER_ENCODING_UTF16 );
+    return i_size;
+}
+
+size_t arib_decode_buffer32( arib_decoder_t* decoder,
+                             const unsigned char *buf, size_t count,
+                             uint32_t *ubuf, size_t ucount )
+{
+    if( ucount == 0 )
+    {
+        return 0;
+    }
+    /* keep room for the terminating NUL unit */
+    size_t i_size = ( ucount - 1 ) * sizeof(*ubuf);
+    arib_buf_region_t *p_last = decoder->p_region_last;
+    const char *p_last_end = p_last ? p_last->p_end : NULL;
+    decoder->ubuf_base = (char*) ubuf;
+    decoder_decode_buffer( decoder, buf, count, ubuf, i_size,
+                           DECODER_ENCODING_UTF32 );
+    i_size = ( i_size - decoder->ucount ) / sizeof(*ubuf);
+    ubuf[ i_size ] = 0;
+    decoder_type_regions( decoder, p_last, p_last_end, DECODER_ENCODING_UTF32 );
     return i_size;
 }
 
 arib_decoder_t * arib_decoder_new( arib_instance_t *p_instance )
 {
-    arib_decoder_t *p_decoder = calloc( 1, sizeof( *p_decoder ) );
+    arib_decoder_t *p_decoder = arib_calloc( p_instance, 1, sizeof( *p_decoder ) );
     if ( !p_decoder )
         return NULL;
     p_decoder->p_instance = p_instance;
-    arib_log( p_decoder->p_instance, "arib decoder was created" );
+    p_decoder->p_drcs = &p_instance->p->drcs;
+    decoder_bind_tables( p_decoder );
+    p_decoder->p_macros = arib_calloc( p_instance, DECODER_MACRO_COUNT,
+                                       sizeof(decoder_macro_t) );
+    if( !p_decoder->p_macros )
+    {
+        arib_free( p_instance, p_decoder );
+        return NULL;
+    }
+    for( int i = 0; i < 16; i++ )
+    {
+        decoder_define_macro( p_decoder, 0x60 - 0x21 + i,
+                              decoder_default_macros[i].buf,
+                              decoder_default_macros[i].count, false );
+    }
+    arib_log( p_decoder->p_instance, ARIB_LOG_DEBUG, "arib decoder was created" );
     return p_decoder;
 }
 
 void arib_decoder_free( arib_decoder_t *p_decoder )
 {
     arib_finalize_decoder( p_decoder );
-    arib_log( p_decoder->p_instance, "arib decoder destroyed" );
-    free( p_decoder );
+    arib_log( p_decoder->p_instance, ARIB_LOG_DEBUG, "arib decoder destroyed" );
+    arib_instance_t *p_instance = p_decoder->p_instance;
+    arib_free( p_instance, p_decoder->p_runs );
+    for( int i = 0; i < DECODER_MACRO_COUNT; i++ )
+    {
+        if( p_decoder->p_macros[i].b_owned )
+        {
+            arib_free( p_instance, (void*) p_decoder->p_macros[i].p_body );
+        }
+    }
+    arib_free( p_instance, p_decoder->p_macros );
+    arib_free( p_instance, p_decoder->p_macro_undo );
+    arib_free( p_instance, p_decoder );
 }
 
 time_t arib_decoder_get_time( arib_decoder_t *p_decoder )
 {
-    return (time_t) p_decoder->i_control_time * 1000000 / 10;
+    return (time_t) ( (int64_t) p_decoder->i_control_time * 100000 );
+}
+
+int64_t arib_decoder_get_control_time( arib_decoder_t *p_decoder )
+{
+    return (int64_t) p_decoder->i_control_time * 9000;
+}
+
+void arib_decoder_set_packet( arib_decoder_t *p_decoder,
+                              const arib_caption_packet_t *p_packet )
+{
+    p_decoder->p_drcs = p_packet ? packet_get_drcs( p_packet ) :
+                                   &p_decoder->p_instance->p->drcs;
+}
+
+const drcs_set_t * decoder_get_drcs( arib_decoder_t *p_decoder )
+{
+    return p_decoder->p_drcs;
 }
 
 const arib_buf_region_t * arib_decoder_get_regions( arib_decoder_t *p_decoder )
 {
     return p_decoder->p_region;
 }
+
+bool arib_decoder_get_clear_screen( arib_decoder_t *p_decoder, size_t *pi_offset )
+{
+    *pi_offset = p_decoder->i_clear_offset;
+    return p_decoder->b_clear_screen;
+}
+
+const arib_styled_run_t * arib_decoder_get_runs( arib_decoder_t *p_decoder,
+                                                 size_t *pi_count )
+{
+    *pi_count = p_decoder->i_runs;
+    return p_decoder->p_runs;
+}
+
+/*****************************************************************************
+ * Decoder state snapshot
+ *****************************************************************************/
+#define DECODER_STATE_VERSION 2
+
+#define DECODER_STATE_FIELD( field ) offsetof( arib_decoder_t, field )
+static const size_t decoder_state_fields[] = {
+    DECODER_STATE_FIELD( i_gl ),
+    DECODER_STATE_FIELD( i_gl_single ),
+    DECODER_STATE_FIELD( i_gr ),
+    DECODER_STATE_FIELD( i_gset[0] ),
+    DECODER_STATE_FIELD( i_gset[1] ),
+    DECODER_STATE_FIELD( i_gset[2] ),
+    DECODER_STATE_FIELD( i_gset[3] ),
+    DECODER_STATE_FIELD( kanji_ku ),
+    DECODER_STATE_FIELD( i_control_time ),
+    DECODER_STATE_FIELD( i_color_map ),
+    DECODER_STATE_FIELD( i_foreground_color ),
+    DECODER_STATE_FIELD( i_foreground_color_prev ),
+    DECODER_STATE_FIELD( i_background_color ),
+    DECODER_STATE_FIELD( i_foreground_alpha ),
+    DECODER_STATE_FIELD( i_background_alpha ),
+    DECODER_STATE_FIELD( i_planewidth ),
+    DECODER_STATE_FIELD( i_planeheight ),
+    DECODER_STATE_FIELD( i_width ),
+    DECODER_STATE_FIELD( i_height ),
+    DECODER_STATE_FIELD( i_left ),
+    DECODER_STATE_FIELD( i_top ),
+    DECODER_STATE_FIELD( i_fontwidth ),
+    DECODER_STATE_FIELD( i_fontwidth_cur ),
+    DECODER_STATE_FIELD( i_fontheight ),
+    DECODER_STATE_FIELD( i_fontheight_cur ),
+    DECODER_STATE_FIELD( i_horint ),
+    DECODER_STATE_FIELD( i_horint_cur ),
+    DECODER_STATE_FIELD( i_verint ),
+    DECODER_STATE_FIELD( i_verint_cur ),
+    DECODER_STATE_FIELD( i_charwidth ),
+    DECODER_STATE_FIELD( i_charheight ),
+    DECODER_STATE_FIELD( i_right ),
+    DECODER_STATE_FIELD( i_bottom ),
+    DECODER_STATE_FIELD( i_charleft ),
+    DECODER_STATE_FIELD( i_charbottom ),
+    DECODER_STATE_FIELD( i_palette ),
+    DECODER_STATE_FIELD( i_style ),
+};
+#undef DECODER_STATE_FIELD
+
+#define DECODER_STATE_COUNT \
+    ( sizeof(decoder_state_fields) / sizeof(decoder_state_fields[0]) )
+
+/* the last word holds b_need_next_region */
+typedef char decoder_state_size_check
+    [ DECODER_STATE_COUNT + 1 <= ARIB_DECODER_STATE_SIZE ? 1 : -1 ];
+
+void arib_decoder_snapshot( arib_decoder_t *p_decoder,
+                            arib_decoder_state_t *p_state )
+{
+    memset( p_state, 0, sizeof(*p_state) );
+    p_state->i_version = DECODER_STATE_VERSION;
+    for( size_t i = 0; i < DECODER_STATE_COUNT; i++ )
+    {
+        p_state->i_data[i] =
+            *(const int*)( (const char*)p_decoder + decoder_state_fields[i] );
+    }
+    p_state->i_data[DECODER_STATE_COUNT] = p_decoder->b_need_next_region;
+}
+
+bool arib_decoder_restore( arib_decoder_t *p_decoder,
+                           const arib_decoder_state_t *p_state )
+{
+    const int32_t *p_data = p_state->i_data;
+    if( p_state->i_version != DECODER_STATE_VERSION )
+    {
+        return false;
+    }
+    /* i_gl, i_gl_single, i_gr, i_gset[4], kanji_ku */
+    if( p_data[0] < 0 || p_data[0] > 3 ||
+        p_data[1] < -1 || p_data[1] > 3 ||
+        p_data[2] < 0 || p_data[2] > 3 ||
+        p_data[7] < -1 || p_data[7] >= 94 )
+    {
+        return false;
+    }
+    for( int i = 3; i < 7; i++ )
+    {
+        if( p_data[i] < 0 || p_data[i] >= DECODER_SET_COUNT )
+        {
+            return false;
+        }
+    }
+
+    for( size_t i = 0; i < DECODER_STATE_COUNT; i++ )
+    {
+        *(int*)( (char*)p_decoder + decoder_state_fields[i] ) = p_data[i];
+    }
+    p_decoder->b_need_next_region = p_data[DECODER_STATE_COUNT] != 0;
+    p_decoder->i_carry = 0;
+    decoder_update_layout_adjust( p_decoder );
+    /* MACRO definitions are left alone: the cache restores the end state of
+     * bodies on a decoder holding the same definitions */
+    return true;
+}
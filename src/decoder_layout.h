@@ -0,0 +1,118 @@
+/*****************************************************************************
+ * decoder_layout.h : ARIB STD-B24 decoder per-character layout attributes
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_DECODER_LAYOUT_H
+#define ARIBB24_DECODER_LAYOUT_H 1
+
+#include <stdint.h>
+
+/* Layout attribute of a code point: the low nibble is the adjust class
+ * (index into the per font size i_veradj/i_horadj table), the high bit
+ * tells that the character never starts a new region on its own. */
+#define LAYOUT_ADJ_MASK         0x0f
+#define LAYOUT_NO_REGION_BREAK  0x80
+
+enum
+{
+    LAYOUT_ADJ_NONE = 0,
+    LAYOUT_ADJ_V_1_3,           /* veradj = fontheight * 1 / 3 */
+    LAYOUT_ADJ_V_2_3,           /* veradj = fontheight * 2 / 3 */
+    LAYOUT_ADJ_V_1_2,           /* veradj = fontheight * 1 / 2 */
+    LAYOUT_ADJ_V_1_4,           /* veradj = fontheight * 1 / 4 */
+    LAYOUT_ADJ_V_1_6,           /* veradj = fontheight * 1 / 6 */
+    LAYOUT_ADJ_H_1_6,           /* horadj = fontwidth * 1 / 6 */
+    LAYOUT_ADJ_V_1_3_H_1_6,     /* both of the above */
+    LAYOUT_ADJ_COUNT
+};
+
+/* Second level: one 256 entries block per used BMP row */
+static const uint8_t decoder_layout_blocks[][256] = {
+    { 0 },
+    { /* U+20xx */
+        [0x26] = LAYOUT_ADJ_V_1_3, /* HORIZONTAL ELLIPSIS */
+    },
+    { /* U+21xx */
+        [0x92] = LAYOUT_ADJ_V_1_3 | LAYOUT_NO_REGION_BREAK, /* RIGHTWARDS ARROW */
+    },
+    { /* U+22xx */
+        [0x12] = LAYOUT_ADJ_V_1_3, /* MINUS SIGN */
+        [0x6a] = LAYOUT_ADJ_V_1_4, /* MUCH LESS-THAN */
+        [0x6b] = LAYOUT_ADJ_V_1_4, /* MUCH GREATER-THAN */
+        [0xef] = LAYOUT_ADJ_V_1_3, /* MIDLINE HORIZONTAL ELLIPSIS */
+    },
+    { /* U+30xx */
+        [0x00] = LAYOUT_ADJ_V_2_3, /* IDEOGRAPHIC SPACE */
+        [0x01] = LAYOUT_ADJ_V_1_2 | LAYOUT_NO_REGION_BREAK, /* IDEOGRAPHIC COMMA */
+        [0x02] = LAYOUT_ADJ_V_1_2 | LAYOUT_NO_REGION_BREAK, /* IDEOGRAPHIC FULL STOP */
+        [0x0c] = LAYOUT_ADJ_H_1_6, /* LEFT CORNER BRACKET */
+        [0x0d] = LAYOUT_ADJ_V_1_6, /* RIGHT CORNER BRACKET */
+        [0x0e] = LAYOUT_ADJ_H_1_6, /* LEFT WHITE CORNER BRACKET */
+        [0x0f] = LAYOUT_ADJ_V_1_6, /* RIGHT WHITE CORNER BRACKET */
+        [0x1c] = LAYOUT_ADJ_V_1_3, /* WAVE DASH */
+        [0x41] = LAYOUT_ADJ_V_1_6, /* HIRAGANA LETTER SMALL A */
+        [0x43] = LAYOUT_ADJ_V_1_6, /* HIRAGANA LETTER SMALL I */
+        [0x45] = LAYOUT_ADJ_V_1_6, /* HIRAGANA LETTER SMALL U */
+        [0x47] = LAYOUT_ADJ_V_1_6, /* HIRAGANA LETTER SMALL E */
+        [0x49] = LAYOUT_ADJ_V_1_6, /* HIRAGANA LETTER SMALL O */
+        [0x63] = LAYOUT_ADJ_V_1_3, /* HIRAGANA LETTER SMALL TU */
+        [0x83] = LAYOUT_ADJ_V_1_6, /* HIRAGANA LETTER SMALL YA */
+        [0x85] = LAYOUT_ADJ_V_1_6, /* HIRAGANA LETTER SMALL YU */
+        [0x87] = LAYOUT_ADJ_V_1_6, /* HIRAGANA LETTER SMALL YO */
+        [0xa1] = LAYOUT_ADJ_V_1_6, /* KATAKANA LETTER SMALL A */
+        [0xa3] = LAYOUT_ADJ_V_1_6, /* KATAKANA LETTER SMALL I */
+        [0xa5] = LAYOUT_ADJ_V_1_6, /* KATAKANA LETTER SMALL U */
+        [0xa7] = LAYOUT_ADJ_V_1_6, /* KATAKANA LETTER SMALL E */
+        [0xa9] = LAYOUT_ADJ_V_1_6, /* KATAKANA LETTER SMALL O */
+        [0xc3] = LAYOUT_ADJ_V_1_3, /* KATAKANA LETTER SMALL TU */
+        [0xe3] = LAYOUT_ADJ_V_1_6, /* KATAKANA LETTER SMALL YA */
+        [0xe5] = LAYOUT_ADJ_V_1_6, /* KATAKANA LETTER SMALL YU */
+        [0xe7] = LAYOUT_ADJ_V_1_6, /* KATAKANA LETTER SMALL YO */
+        [0xfb] = LAYOUT_ADJ_V_1_3_H_1_6, /* KATAKANA MIDDLE DOT */
+        [0xfc] = LAYOUT_ADJ_V_1_3, /* KATAKANA-HIRAGANA PROLONGED SOUND MARK */
+    },
+    { /* U+FFxx */
+        [0x08] = LAYOUT_ADJ_H_1_6, /* FULLWIDTH LEFT PARENTHESIS */
+        [0x09] = LAYOUT_ADJ_H_1_6, /* FULLWIDTH RIGHT PARENTHESIS */
+        [0x0c] = LAYOUT_ADJ_V_1_2 | LAYOUT_NO_REGION_BREAK, /* FULLWIDTH COMMA */
+        [0x0d] = LAYOUT_ADJ_V_1_3, /* FULLWIDTH MINUS SIGN */
+        [0x0e] = LAYOUT_ADJ_V_1_2 | LAYOUT_NO_REGION_BREAK, /* FULLWIDTH FULL STOP */
+        [0x1c] = LAYOUT_ADJ_V_1_4, /* FULLWIDTH LESS-THAN SIGN */
+        [0x1e] = LAYOUT_ADJ_V_1_4, /* FULLWIDTH GREATER-THAN SIGN */
+    },
+};
+
+/* First level: BMP row (uc >> 8) to block of decoder_layout_blocks */
+static const uint8_t decoder_layout_index[256] = {
+    [0x20] = 1,
+    [0x21] = 2,
+    [0x22] = 3,
+    [0x30] = 4,
+    [0xff] = 5,
+};
+
+static inline uint8_t decoder_layout_attr( unsigned int uc )
+{
+    if( uc > 0xffff )
+    {
+        return 0;
+    }
+    return decoder_layout_blocks[decoder_layout_index[uc >> 8]][uc & 0xff];
+}
+
+#endif
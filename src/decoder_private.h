@@ -26,4 +26,7 @@
 arib_decoder_t * arib_decoder_new( arib_instance_t *p_instance );
 void arib_decoder_free( arib_decoder_t * );
 
+/* DRCS set the last decoded characters refer to */
+const drcs_set_t * decoder_get_drcs( arib_decoder_t * );
+
 #endif
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -38,6 +39,7 @@
 #include "aribb24_private.h"
 #include "drcs.h"
 #include "md5.h"
+#include "probes.h"
 
 #if defined( _WIN32 ) || defined( __SYMBIAN32__ ) || defined( __OS2__ )
 #   define mkdir(a,b) mkdir(a)
@@ -75,7 +77,8 @@ static char* get_arib_data_dir( arib_instance_t *p_instance )
     }
 
     char *psz_arib_data_dir;
-    if( asprintf( &psz_arib_data_dir, "%s"DIR_SEP"data", psz_arib_base_path ) < 0 )
+    if( arib_asprintf( p_instance, &psz_arib_data_dir,
+                       "%s"DIR_SEP"data", psz_arib_base_path ) < 0 )
     {
         psz_arib_data_dir = NULL;
     }
@@ -116,43 +119,46 @@ static bool create_arib_datadir( arib_instance_t *p_instance )
     {
         if( mkdir( psz_arib_data_dir, 0700) == 0 )
         {
-            free( psz_arib_data_dir );
+            arib_free( p_instance, psz_arib_data_dir );
             return false;
         }
     }
 
-    free( psz_arib_data_dir );
+    arib_free( p_instance, psz_arib_data_dir );
     return true;
 }
 
 bool apply_drcs_conversion_table( arib_instance_t *p_instance )
 {
-    for( int i = 0; i < p_instance->p->i_drcs_num; i++ )
+    drcs_set_t *p_drcs = &p_instance->p->drcs;
+    int i_mapped = 0;
+    for( int i = 0; i < p_drcs->i_num; i++ )
     {
         unsigned int uc = 0;
         drcs_conversion_t *p_drcs_conv = p_instance->p->p_drcs_conv;
         while( p_drcs_conv != NULL )
         {
-            if( strcmp( p_drcs_conv->hash, p_instance->p->drcs_hash_table[i] ) == 0 )
+            if( strcmp( p_drcs_conv->hash, p_drcs->hash_table[i] ) == 0 )
             {
                 uc = p_drcs_conv->code;
+                i_mapped++;
                 break;
             }
             p_drcs_conv = p_drcs_conv->p_next;
         }
-#ifdef DEBUG_ARIBSUB
-        if( uc )
+        if( p_instance->b_replace_ellipsis && uc == 0x2026 )
         {
-            arib_log( p_instance, "Mapping [%s=U+%04x] will be used.",
-                      p_instance->p->drcs_hash_table[i], uc );
+            uc = 0x22ef;
         }
-        else
-        {
-            arib_log( p_instance, "Mapping for hash[%s] is not found.",
-                      p_instance->p->drcs_hash_table[i] );
-        }
-#endif
-        p_instance->p->drcs_conv_table[i] = uc;
+        p_drcs->conv_table[i] = uc;
+    }
+    if( p_drcs->i_num > 0 )
+    {
+        arib_stats_add( p_instance, ARIB_STAT_DRCS_CONV_HITS, i_mapped );
+        arib_stats_add( p_instance, ARIB_STAT_DRCS_CONV_MISSES,
+                        p_drcs->i_num - i_mapped );
+        arib_log( p_instance, ARIB_LOG_DEBUG, "%d of %d DRCS patterns mapped",
+                  i_mapped, p_drcs->i_num );
     }
     return true;
 }
@@ -168,7 +174,8 @@ bool load_drcs_conversion_table( arib_instance_t *p_instance )
     }
 
     char* psz_conv_file;
-    if( asprintf( &psz_conv_file, "%s"DIR_SEP"drcs_conv.ini", psz_arib_base_path ) < 0 )
+    if( arib_asprintf( p_instance, &psz_conv_file,
+                       "%s"DIR_SEP"drcs_conv.ini", psz_arib_base_path ) < 0 )
     {
         psz_conv_file = NULL;
     }
@@ -178,7 +185,7 @@ bool load_drcs_conversion_table( arib_instance_t *p_instance )
     }
 
     FILE *fp = fopen( psz_conv_file, "r" );
-    free( psz_conv_file );
+    arib_free( p_instance, psz_conv_file );
     if( fp == NULL )
     {
         return false;
@@ -219,8 +226,8 @@ bool load_drcs_conversion_table( arib_instance_t *p_instance )
             continue;
         }
 
-        drcs_conversion_t *p_next = (drcs_conversion_t*) calloc(
-                1, sizeof(drcs_conversion_t) );
+        drcs_conversion_t *p_next = (drcs_conversion_t*) arib_calloc(
+                p_instance, 1, sizeof(drcs_conversion_t) );
         if( p_next == NULL )
         {
             continue;
@@ -257,11 +264,12 @@ static FILE* open_image_file( arib_instance_t* p_instance, const char *psz_hash
     }
 
     char* psz_image_file;
-    if( asprintf( &psz_image_file, "%s"DIR_SEP"%s.png", psz_arib_data_dir, psz_hash ) < 0 )
+    if( arib_asprintf( p_instance, &psz_image_file,
+                       "%s"DIR_SEP"%s.png", psz_arib_data_dir, psz_hash ) < 0 )
     {
         psz_image_file = NULL;
     }
-    free( psz_arib_data_dir );
+    arib_free( p_instance, psz_arib_data_dir );
     if( psz_image_file == NULL )
     {
         return NULL;
@@ -278,17 +286,19 @@ static FILE* open_image_file( arib_instance_t* p_instance, const char *psz_hash
         fp = fdopen( fd, "wb" );
         if( fp == NULL )
         {
-            arib_log( p_instance, "Failed creating image file %s", psz_image_file );
+            arib_log( p_instance, ARIB_LOG_ERROR,
+                      "Failed creating image file %s", psz_image_file );
             close( fd );
         }
     }
 
-    free( psz_image_file );
+    arib_free( p_instance, psz_image_file );
     return fp;
 }
 
-static char* get_drcs_pattern_data_hash(
-        arib_instance_t *p_instance,
+/* written as md5sum shows it, without allocating */
+static void get_drcs_pattern_data_hash(
+        char psz_hash[32 + 1],
         int i_width, int i_height,
         int i_depth, const int8_t* p_patternData )
 {
@@ -297,24 +307,40 @@ static char* get_drcs_pattern_data_hash(
     InitMD5( &md5 );
     AddMD5( &md5, p_patternData, i_width * i_height * i_bits_per_pixel / 8 );
     EndMD5( &md5 );
-    return psz_md5_hash( &md5 );
+    for( int i = 0; i < 16; i++ )
+    {
+        sprintf( &psz_hash[2*i], "%02"PRIx8, md5.buf[i] );
+    }
 }
 
-static void save_drcs_pattern_data_image(
-        arib_instance_t *p_instance,
-        const char* psz_hash,
+#if defined( HAVE_PNG ) && defined( PNG_USER_MEM_SUPPORTED )
+static png_voidp drcs_png_malloc( png_structp png_ptr, png_alloc_size_t i_size )
+{
+    return arib_malloc( (arib_instance_t*) png_get_mem_ptr( png_ptr ), i_size );
+}
+
+static void drcs_png_free( png_structp png_ptr, png_voidp p )
+{
+    arib_free( (arib_instance_t*) png_get_mem_ptr( png_ptr ), p );
+}
+#endif
+
+#ifdef HAVE_PNG
+/* Kept apart from the file opening: no local of the caller lives across
+ * the setjmp() below */
+static void write_drcs_pattern_data_png(
+        arib_instance_t *p_instance, FILE *fp,
         int i_width, int i_height,
         int i_depth, const int8_t* p_patternData )
 {
-#ifdef HAVE_PNG
-    FILE *fp = open_image_file( p_instance, psz_hash );
-    if( fp == NULL )
-    {
-        return;
-    }
-
+#ifdef PNG_USER_MEM_SUPPORTED
+    png_structp png_ptr = png_create_write_struct_2(
+            PNG_LIBPNG_VER_STRING, NULL, NULL, NULL,
+            p_instance, drcs_png_malloc, drcs_png_free );
+#else
     png_structp png_ptr = png_create_write_struct(
             PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+#endif
     if( png_ptr == NULL )
     {
         goto png_create_write_struct_failed;
@@ -388,6 +414,7 @@ static void save_drcs_pattern_data_image(
     png_set_packing( png_ptr );
     png_write_image( png_ptr, pp_image );
     png_write_end( png_ptr, info_ptr );
+    arib_stats_add( p_instance, ARIB_STAT_PNG_WRITES, 1 );
 
     for( int j = 0; j < i_height; j++ )
     {
@@ -399,26 +426,111 @@ png_failure:
 png_create_info_struct_failed:
     png_destroy_write_struct( &png_ptr, &info_ptr );
 png_create_write_struct_failed:
+    return;
+}
+#endif
+
+static void save_drcs_pattern_data_image(
+        arib_instance_t *p_instance,
+        const char* psz_hash,
+        int i_width, int i_height,
+        int i_depth, const int8_t* p_patternData )
+{
+#ifdef HAVE_PNG
+    FILE *fp = open_image_file( p_instance, psz_hash );
+    if( fp == NULL )
+    {
+        return;
+    }
+    write_drcs_pattern_data_png( p_instance, fp, i_width, i_height,
+                                 i_depth, p_patternData );
     fclose( fp );
 #endif
 }
 
+static void save_drcs_pattern_data_glyph(
+        arib_instance_t *p_instance,
+        drcs_glyph_t *p_glyph,
+        int i_width, int i_height,
+        int i_depth, const int8_t* p_patternData )
+{
+    arib_free( p_instance, p_glyph->p_alpha );
+    p_glyph->p_alpha = NULL;
+    p_glyph->i_width = 0;
+    p_glyph->i_height = 0;
+
+    if( i_width <= 0 || i_height <= 0 || i_depth < 2 )
+    {
+        return;
+    }
+    uint8_t *p_alpha = (uint8_t*) arib_malloc( p_instance, i_width * i_height );
+    if( p_alpha == NULL )
+    {
+        return;
+    }
+
+#if defined( __ANDROID__ )
+    int i_bits_per_pixel = ceil( log( i_depth ) / log( 2 ) );
+#else
+    int i_bits_per_pixel = ceil( log2( i_depth ) );
+#endif
+
+    bs_t bs;
+    bs_init( &bs, p_patternData, i_width * i_height * i_bits_per_pixel / 8 );
+
+    /* gradations are spread evenly from transparent to opaque */
+    for( int i = 0; i < i_width * i_height; i++ )
+    {
+        unsigned int i_pxl = bs_read( &bs, i_bits_per_pixel );
+        if( i_pxl >= (unsigned int) i_depth )
+        {
+            i_pxl = i_depth - 1;
+        }
+        p_alpha[i] = i_pxl * 255 / ( i_depth - 1 );
+    }
+
+    p_glyph->i_width = i_width;
+    p_glyph->i_height = i_height;
+    p_glyph->p_alpha = p_alpha;
+}
+
+void free_drcs_glyphs( const arib_allocator_t *p_alloc, drcs_set_t *p_drcs )
+{
+    for( int i = 0; i < DRCS_MAX; i++ )
+    {
+        arib_allocator_free( p_alloc, p_drcs->glyph_table[i].p_alpha );
+        p_drcs->glyph_table[i].p_alpha = NULL;
+    }
+}
+
 void save_drcs_pattern(
         arib_instance_t *p_instance,
         int i_width, int i_height,
         int i_depth, const int8_t* p_patternData )
 {
-    char* psz_hash = get_drcs_pattern_data_hash( p_instance,
+    drcs_set_t *p_drcs = &p_instance->p->drcs;
+    if( p_drcs->i_num >= DRCS_MAX )
+    {
+        return;
+    }
+
+    char *psz_hash = p_drcs->hash_table[p_drcs->i_num];
+    get_drcs_pattern_data_hash( psz_hash,
+            i_width, i_height, i_depth, p_patternData );
+
+    save_drcs_pattern_data_glyph( p_instance, &p_drcs->glyph_table[p_drcs->i_num],
             i_width, i_height, i_depth, p_patternData );
 
-    strncpy( p_instance->p->drcs_hash_table[p_instance->p->i_drcs_num], psz_hash, 32 );
-    p_instance->p->drcs_hash_table[p_instance->p->i_drcs_num][32] = '\0';
+    ARIB_PROBE4( drcs_save, p_instance, i_width, i_height, psz_hash );
+    arib_stats_add( p_instance, ARIB_STAT_DRCS_PATTERNS, 1 );
+    arib_stats_add( p_instance, ARIB_STAT_ALLOCATIONS,
+                    p_drcs->glyph_table[p_drcs->i_num].p_alpha != NULL );
 
-    p_instance->p->i_drcs_num++;
+    p_drcs->conv_table[p_drcs->i_num] = 0;
+
+    p_drcs->i_num++;
 
     save_drcs_pattern_data_image( p_instance, psz_hash,
             i_width, i_height, i_depth, p_patternData );
-
-    free( psz_hash );
 }
 
@@ -31,6 +31,25 @@ typedef struct drcs_conversion_s
 } drcs_conversion_t ;
 
 
+/* Pattern of a received DRCS character, one coverage byte per pixel */
+typedef struct drcs_glyph_s
+{
+    int     i_width;
+    int     i_height;
+    uint8_t *p_alpha;
+} drcs_glyph_t;
+
+#define DRCS_MAX 188
+
+/* DRCS patterns of the last DRCS data unit, as received by the parser */
+typedef struct drcs_set_s
+{
+    int          i_num;
+    unsigned int conv_table[DRCS_MAX]; /* replacement characters, 0 if none */
+    char         hash_table[DRCS_MAX][32 + 1];
+    drcs_glyph_t glyph_table[DRCS_MAX];
+} drcs_set_t;
+
 //#define ARIBSUB_GEN_DRCS_DATA
 #ifdef ARIBSUB_GEN_DRCS_DATA
 typedef struct drcs_geometric_data_s
@@ -78,5 +97,6 @@ typedef struct drcs_data_s
 bool apply_drcs_conversion_table( arib_instance_t * );
 bool load_drcs_conversion_table( arib_instance_t * );
 void save_drcs_pattern( arib_instance_t *, int, int, int, const int8_t* );
+void free_drcs_glyphs( const arib_allocator_t *, drcs_set_t * );
 
 #endif
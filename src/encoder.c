@@ -0,0 +1,514 @@
+/*****************************************************************************
+ * encoder.c : ARIB STD-B24 JIS 8bit character code encoder
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "aribb24/aribb24.h"
+#include "aribb24/encoder.h"
+#include "aribb24_private.h"
+#include "encoder_hash.h"
+#include "encoder_table.h"
+
+/* Characters looked at to choose the G set of the current one */
+#define ENCODER_LOOKAHEAD 4
+
+/* Graphic sets the encoder designates, -1 for anything else */
+enum
+{
+    ENCODER_SET_KANJI = 0,
+    ENCODER_SET_ALNUM,
+    ENCODER_SET_HIRAGANA,
+    ENCODER_SET_KATAKANA,
+    ENCODER_SET_COUNT
+};
+
+/* final bytes of the designations */
+static const unsigned char encoder_set_final[ENCODER_SET_COUNT] =
+{
+    [ENCODER_SET_KANJI]    = 0x42,
+    [ENCODER_SET_ALNUM]    = 0x4a,
+    [ENCODER_SET_HIRAGANA] = 0x30,
+    [ENCODER_SET_KATAKANA] = 0x31,
+};
+
+#define ENCODER_ANY_SET 0xff /* SP and APR, shown whatever the G sets */
+
+typedef struct
+{
+    uint32_t uc;
+    uint8_t i_len; /* UTF-8 bytes, 0 if invalid */
+    uint8_t i_sets; /* 1 << ENCODER_SET_* able to encode uc */
+    uint8_t i_byte; /* code in the one byte sets, or the control code */
+    uint16_t i_cell; /* ku * 94 + ten in the kanji set */
+} encoder_char_t;
+
+/* How the G sets change before a character */
+typedef struct
+{
+    int i_set;
+    int i_g; /* G set receiving the designation, -1 if none */
+    int i_invoke; /* ENCODER_INVOKE_* */
+    int i_cost; /* bytes added for the whole run */
+} encoder_plan_t;
+
+enum
+{
+    ENCODER_INVOKE_NONE = 0, /* already in GL or GR */
+    ENCODER_INVOKE_GL,
+    ENCODER_INVOKE_GR,
+    ENCODER_INVOKE_SINGLE,
+};
+
+struct arib_encoder_t
+{
+    arib_instance_t *p_instance;
+    int i_gset[4]; /* ENCODER_SET_* designated to G0-G3, -1 if other */
+    int i_gl;
+    int i_gr;
+
+    /* last character count at which each G set was used */
+    size_t i_used[4];
+    size_t i_chars;
+
+    encoder_char_t ahead[ENCODER_LOOKAHEAD];
+    int i_ahead;
+};
+
+static uint32_t encoder_lookup( uint32_t uc )
+{
+    uint32_t i_slot = encoder_hash_slot( uc, encoder_hash_seed[encoder_hash_bucket( uc )] );
+    return encoder_hash_key[i_slot] == uc ? encoder_hash_value[i_slot] : 0;
+}
+
+static size_t encoder_utf8_next( const unsigned char *p, size_t i_size, uint32_t *puc )
+{
+    static const uint32_t min[4] = { 0, 0x80, 0x800, 0x10000 };
+    size_t i_len;
+    uint32_t uc = p[0];
+
+    if( uc < 0x80 )
+    {
+        *puc = uc;
+        return 1;
+    }
+    else if( uc >= 0xc2 && uc < 0xe0 )
+    {
+        i_len = 2;
+        uc &= 0x1f;
+    }
+    else if( uc >= 0xe0 && uc < 0xf0 )
+    {
+        i_len = 3;
+        uc &= 0x0f;
+    }
+    else if( uc >= 0xf0 && uc < 0xf5 )
+    {
+        i_len = 4;
+        uc &= 0x07;
+    }
+    else
+    {
+        return 0;
+    }
+    if( i_len > i_size )
+    {
+        return 0;
+    }
+    for( size_t i = 1; i < i_len; i++ )
+    {
+        if( ( p[i] & 0xc0 ) != 0x80 )
+        {
+            return 0;
+        }
+        uc = ( uc << 6 ) | ( p[i] & 0x3f );
+    }
+    if( uc < min[i_len - 1] || uc > 0x10ffff || ( uc >= 0xd800 && uc < 0xe000 ) )
+    {
+        return 0;
+    }
+    *puc = uc;
+    return i_len;
+}
+
+static void encoder_classify( arib_encoder_t *p_encoder,
+                              const unsigned char *p, size_t i_size,
+                              encoder_char_t *p_char )
+{
+    memset( p_char, 0, sizeof(*p_char) );
+    p_char->i_len = encoder_utf8_next( p, i_size, &p_char->uc );
+    if( p_char->i_len == 0 )
+    {
+        return;
+    }
+
+    uint32_t uc = p_char->uc;
+    if( uc == 0x20 || uc == 0x3000 )
+    {
+        p_char->i_sets = ENCODER_ANY_SET;
+        p_char->i_byte = 0x20; /* SP */
+        return;
+    }
+    if( uc == '\n' )
+    {
+        p_char->i_sets = ENCODER_ANY_SET;
+        p_char->i_byte = 0x0d; /* APR */
+        return;
+    }
+    if( uc == 0x22ef && p_encoder->p_instance->b_replace_ellipsis )
+    {
+        uc = 0x2026;
+    }
+
+    uint32_t i_value = encoder_lookup( uc );
+    uint32_t i_cell = i_value & ENCODER_CELL_MASK;
+    bool b_private = p_encoder->p_instance->b_use_private_conv;
+    if( i_cell != 0 &&
+        !( ( i_value & ENCODER_CELL_PRIVATE ) && !b_private ) &&
+        !( ( i_value & ENCODER_CELL_NO_PRIVATE ) && b_private ) )
+    {
+        p_char->i_sets |= 1 << ENCODER_SET_KANJI;
+        p_char->i_cell = i_cell - 1;
+    }
+    uint32_t i_in = i_value >> ENCODER_SETS_SHIFT;
+    if( i_in & ENCODER_IN_ALNUM )
+    {
+        p_char->i_sets |= 1 << ENCODER_SET_ALNUM;
+    }
+    if( i_in & ENCODER_IN_HIRAGANA )
+    {
+        p_char->i_sets |= 1 << ENCODER_SET_HIRAGANA;
+    }
+    if( i_in & ENCODER_IN_KATAKANA )
+    {
+        p_char->i_sets |= 1 << ENCODER_SET_KATAKANA;
+    }
+    p_char->i_byte = ( i_value >> ENCODER_BYTE_SHIFT ) & 0x7f;
+}
+
+static int encoder_invoke_cost( const arib_encoder_t *p_encoder, int i_set,
+                                int i_g, int i_run, int *pi_invoke )
+{
+    if( i_g == p_encoder->i_gl || i_g == p_encoder->i_gr )
+    {
+        *pi_invoke = ENCODER_INVOKE_NONE;
+        return 0;
+    }
+
+    /* LS0, LS1 are one byte; LS2, LS3 and the GR shifts are ESC sequences */
+    int i_gl_cost = i_g < 2 ? 1 : 2;
+    int i_gr_cost = i_g > 0 ? 2 : INT32_MAX / 2;
+    /* replace the shift in use least recently */
+    if( p_encoder->i_used[p_encoder->i_gl] > p_encoder->i_used[p_encoder->i_gr] )
+    {
+        i_gl_cost++;
+    }
+    else
+    {
+        i_gr_cost++;
+    }
+
+    int i_cost = i_gl_cost;
+    *pi_invoke = ENCODER_INVOKE_GL;
+    if( i_gr_cost < i_cost )
+    {
+        i_cost = i_gr_cost;
+        *pi_invoke = ENCODER_INVOKE_GR;
+    }
+    /* SS2 and SS3 cost a byte per character, and only shift one byte */
+    if( i_g >= 2 && i_set != ENCODER_SET_KANJI && i_run < i_cost )
+    {
+        i_cost = i_run;
+        *pi_invoke = ENCODER_INVOKE_SINGLE;
+    }
+    return i_cost;
+}
+
+static void encoder_plan( const arib_encoder_t *p_encoder, int i_set, int i_run,
+                          uint8_t i_needed, encoder_plan_t *p_plan )
+{
+    p_plan->i_set = i_set;
+    for( int i_g = 0; i_g < 4; i_g++ )
+    {
+        if( p_encoder->i_gset[i_g] == i_set )
+        {
+            p_plan->i_g = -1;
+            p_plan->i_cost = encoder_invoke_cost( p_encoder, i_set, i_g, i_run,
+                                                  &p_plan->i_invoke );
+            return;
+        }
+    }
+
+    p_plan->i_cost = INT32_MAX;
+    for( int i_g = 0; i_g < 4; i_g++ )
+    {
+        int i_invoke;
+        int i_cost = ( i_set == ENCODER_SET_KANJI && i_g > 0 ) ? 4 : 3;
+        i_cost += encoder_invoke_cost( p_encoder, i_set, i_g, i_run, &i_invoke );
+        /* the replaced set is needed soon */
+        int i_old = p_encoder->i_gset[i_g];
+        if( i_old >= 0 && ( i_needed & ( 1 << i_old ) ) )
+        {
+            i_cost += 3;
+        }
+        if( i_cost < p_plan->i_cost ||
+            ( i_cost == p_plan->i_cost &&
+              p_encoder->i_used[i_g] < p_encoder->i_used[p_plan->i_g] ) )
+        {
+            p_plan->i_g = i_g;
+            p_plan->i_invoke = i_invoke;
+            p_plan->i_cost = i_cost;
+        }
+    }
+}
+
+/* Writes the designation, invocation and character codes into p,
+ * returns their size */
+static size_t encoder_apply( arib_encoder_t *p_encoder, const encoder_plan_t *p_plan,
+                             const encoder_char_t *p_char, unsigned char *p )
+{
+    unsigned char *p_start = p;
+    int i_g = p_plan->i_g;
+
+    if( i_g >= 0 )
+    {
+        *p++ = 0x1b;
+        if( p_plan->i_set == ENCODER_SET_KANJI )
+        {
+            *p++ = 0x24;
+            if( i_g > 0 )
+            {
+                *p++ = 0x28 + i_g;
+            }
+        }
+        else
+        {
+            *p++ = 0x28 + i_g;
+        }
+        *p++ = encoder_set_final[p_plan->i_set];
+        p_encoder->i_gset[i_g] = p_plan->i_set;
+    }
+    else
+    {
+        for( i_g = 0; p_encoder->i_gset[i_g] != p_plan->i_set; i_g++ )
+            ;
+    }
+
+    static const unsigned char ls_gl[4] = { 0x0f, 0x0e, 0x6e, 0x6f };
+    static const unsigned char ls_gr[4] = { 0, 0x7e, 0x7d, 0x7c };
+    unsigned char i_high = 0;
+    switch( p_plan->i_invoke )
+    {
+        case ENCODER_INVOKE_NONE:
+            i_high = i_g == p_encoder->i_gl ? 0 : 0x80;
+            break;
+        case ENCODER_INVOKE_GL:
+            if( i_g >= 2 )
+            {
+                *p++ = 0x1b;
+            }
+            *p++ = ls_gl[i_g];
+            p_encoder->i_gl = i_g;
+            break;
+        case ENCODER_INVOKE_GR:
+            *p++ = 0x1b;
+            *p++ = ls_gr[i_g];
+            p_encoder->i_gr = i_g;
+            i_high = 0x80;
+            break;
+        case ENCODER_INVOKE_SINGLE:
+            *p++ = i_g == 2 ? 0x19 : 0x1d;
+            break;
+    }
+    if( p_plan->i_invoke != ENCODER_INVOKE_SINGLE )
+    {
+        p_encoder->i_used[i_g] = p_encoder->i_chars;
+    }
+
+    if( p_plan->i_set == ENCODER_SET_KANJI )
+    {
+        *p++ = ( 0x21 + p_char->i_cell / 94 ) | i_high;
+        *p++ = ( 0x21 + p_char->i_cell % 94 ) | i_high;
+    }
+    else
+    {
+        *p++ = p_char->i_byte | i_high;
+    }
+    return p - p_start;
+}
+
+static void encoder_fill( arib_encoder_t *p_encoder, const unsigned char *p,
+                          const unsigned char *p_end )
+{
+    /* skip what the window already holds */
+    for( int i = 0; i < p_encoder->i_ahead; i++ )
+    {
+        p += p_encoder->ahead[i].i_len;
+    }
+    while( p_encoder->i_ahead < ENCODER_LOOKAHEAD && p < p_end )
+    {
+        encoder_char_t *p_char = &p_encoder->ahead[p_encoder->i_ahead];
+        encoder_classify( p_encoder, p, p_end - p, p_char );
+        if( p_char->i_len == 0 )
+        {
+            break;
+        }
+        p_encoder->i_ahead++;
+        p += p_char->i_len;
+    }
+}
+
+arib_encode_status_t arib_encode_buffer( arib_encoder_t *p_encoder,
+                                         const char *psz_text, size_t i_text,
+                                         unsigned char *buf, size_t i_size,
+                                         size_t *pi_consumed, size_t *pi_written )
+{
+    const unsigned char *p = (const unsigned char *) psz_text;
+    const unsigned char *p_end = p + i_text;
+    size_t i_written = 0;
+    arib_encode_status_t i_status = ARIB_ENCODE_OK;
+
+    p_encoder->i_ahead = 0;
+    while( p < p_end )
+    {
+        encoder_fill( p_encoder, p, p_end );
+        if( p_encoder->i_ahead == 0 || p_encoder->ahead[0].i_sets == 0 )
+        {
+            i_status = ARIB_ENCODE_ERROR;
+            break;
+        }
+
+        const encoder_char_t *p_char = &p_encoder->ahead[0];
+        unsigned char code[16];
+        size_t i_code;
+        if( p_char->i_sets == ENCODER_ANY_SET )
+        {
+            code[0] = p_char->i_byte;
+            i_code = 1;
+        }
+        else
+        {
+            /* cost of each possible set over the run of characters it
+             * can encode, compared per character */
+            encoder_plan_t best = { 0 }, plan;
+            int i_best_run = 0;
+            uint8_t i_needed = 0;
+            for( int i = 1; i < p_encoder->i_ahead; i++ )
+            {
+                uint8_t i_sets = p_encoder->ahead[i].i_sets;
+                if( i_sets != ENCODER_ANY_SET && ( i_sets & ( i_sets - 1 ) ) == 0 )
+                {
+                    i_needed |= i_sets;
+                }
+            }
+            for( int i_set = 0; i_set < ENCODER_SET_COUNT; i_set++ )
+            {
+                if( !( p_char->i_sets & ( 1 << i_set ) ) )
+                {
+                    continue;
+                }
+                int i_run = 1;
+                while( i_run < p_encoder->i_ahead &&
+                       ( p_encoder->ahead[i_run].i_sets & ( 1 << i_set ) ) )
+                {
+                    i_run++;
+                }
+                encoder_plan( p_encoder, i_set, i_run, i_needed & ~( 1 << i_set ), &plan );
+                plan.i_cost += i_run * ( i_set == ENCODER_SET_KANJI ? 2 : 1 );
+                if( i_best_run == 0 ||
+                    (int64_t) plan.i_cost * i_best_run < (int64_t) best.i_cost * i_run )
+                {
+                    best = plan;
+                    i_best_run = i_run;
+                }
+            }
+
+            arib_encoder_t saved = *p_encoder;
+            i_code = encoder_apply( p_encoder, &best, p_char, code );
+            if( i_written + i_code > i_size )
+            {
+                *p_encoder = saved;
+            }
+        }
+
+        if( i_written + i_code > i_size )
+        {
+            i_status = ARIB_ENCODE_OUTPUT_FULL;
+            break;
+        }
+        memcpy( buf + i_written, code, i_code );
+        i_written += i_code;
+        p += p_char->i_len;
+        p_encoder->i_chars++;
+        p_encoder->i_ahead--;
+        memmove( p_encoder->ahead, p_encoder->ahead + 1,
+                 p_encoder->i_ahead * sizeof(encoder_char_t) );
+    }
+
+    *pi_consumed = p - (const unsigned char *) psz_text;
+    *pi_written = i_written;
+    return i_status;
+}
+
+void arib_initialize_encoder_a_profile( arib_encoder_t *p_encoder )
+{
+    p_encoder->i_gset[0] = ENCODER_SET_KANJI;
+    p_encoder->i_gset[1] = ENCODER_SET_ALNUM;
+    p_encoder->i_gset[2] = ENCODER_SET_HIRAGANA;
+    p_encoder->i_gset[3] = -1; /* macros */
+    p_encoder->i_gl = 0;
+    p_encoder->i_gr = 2;
+    memset( p_encoder->i_used, 0, sizeof(p_encoder->i_used) );
+    p_encoder->i_chars = 1;
+}
+
+void arib_initialize_encoder_c_profile( arib_encoder_t *p_encoder )
+{
+    p_encoder->i_gset[0] = -1; /* DRCS */
+    p_encoder->i_gset[1] = ENCODER_SET_ALNUM;
+    p_encoder->i_gset[2] = ENCODER_SET_KANJI;
+    p_encoder->i_gset[3] = ENCODER_SET_KATAKANA;
+    p_encoder->i_gl = 0;
+    p_encoder->i_gr = 2;
+    memset( p_encoder->i_used, 0, sizeof(p_encoder->i_used) );
+    p_encoder->i_chars = 1;
+}
+
+arib_encoder_t * arib_encoder_new( arib_instance_t *p_instance )
+{
+    arib_encoder_t *p_encoder = arib_calloc( p_instance, 1, sizeof(*p_encoder) );
+    if( p_encoder == NULL )
+    {
+        return NULL;
+    }
+    p_encoder->p_instance = p_instance;
+    arib_initialize_encoder_a_profile( p_encoder );
+    return p_encoder;
+}
+
+void arib_encoder_free( arib_encoder_t *p_encoder )
+{
+    if( p_encoder == NULL )
+    {
+        return;
+    }
+    arib_free( p_encoder->p_instance, p_encoder );
+}
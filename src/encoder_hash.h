@@ -0,0 +1,59 @@
+/*****************************************************************************
+ * encoder_hash.h : perfect hash of the ARIB STD-B24 reverse conversion table
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_ENCODER_HASH_H
+#define ARIBB24_ENCODER_HASH_H 1
+
+/* Shared by gen_convtable, which picks a seed per bucket so that no two
+ * code points land in the same slot, and the encoder looking them up */
+#define ENCODER_HASH_SLOT_BITS   13
+#define ENCODER_HASH_BUCKET_BITS 11
+
+/* encoder_hash_value[] fields */
+#define ENCODER_CELL_MASK       0x3fff /* 1 + ku * 94 + ten, 0 if none */
+#define ENCODER_CELL_PRIVATE    0x4000 /* only with b_use_private_conv */
+#define ENCODER_CELL_NO_PRIVATE 0x8000 /* only without b_use_private_conv */
+#define ENCODER_BYTE_SHIFT      16     /* 0x21-0x7e in the sets below */
+#define ENCODER_SETS_SHIFT      24
+#define ENCODER_IN_ALNUM        0x1
+#define ENCODER_IN_HIRAGANA     0x2
+#define ENCODER_IN_KATAKANA     0x4
+
+static inline uint32_t encoder_hash_mix( uint32_t x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline uint32_t encoder_hash_bucket( uint32_t uc )
+{
+    return encoder_hash_mix( uc ) >> ( 32 - ENCODER_HASH_BUCKET_BITS );
+}
+
+static inline uint32_t encoder_hash_slot( uint32_t uc, uint32_t i_seed )
+{
+    return encoder_hash_mix( uc ^ ( i_seed * 0x9e3779b9 ) ) &
+           ( ( 1 << ENCODER_HASH_SLOT_BITS ) - 1 );
+}
+
+#endif
@@ -0,0 +1,598 @@
+/*****************************************************************************
+ * engine.c : ARIB STD-B24 multi-channel caption engine
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "aribb24/engine.h"
+#include "aribb24_private.h"
+
+/* PES handled before a busy channel goes back to the end of a queue */
+#define ENGINE_BATCH 8
+/* a worker takes from the shared queue first every so many channels, so
+ * that channels pushed from outside are not starved by busy ones */
+#define ENGINE_SHARED_INTERVAL 31
+#define ENGINE_TEXT_SIZE 4096
+
+typedef struct engine_pes_t
+{
+    struct engine_pes_t *p_next;
+    int64_t i_pts;
+    size_t i_data;
+    unsigned char p_data[];
+} engine_pes_t;
+
+typedef struct engine_channel_t
+{
+    int i_index;
+    arib_instance_t *p_instance;
+    arib_parser_t *p_parser;
+    arib_decoder_t *p_decoder;
+    arib_engine_profile_t i_profile;
+
+    /* PES waiting for a worker, and whether the channel is in a queue or
+     * being handled: it is never in two places at once */
+    pthread_mutex_t lock;
+    engine_pes_t *p_first;
+    engine_pes_t **pp_last;
+    bool b_scheduled;
+
+    /* only touched by the worker handling the channel */
+    char *p_text;
+    size_t i_text_size;
+} engine_channel_t;
+
+/* Channels ready to run, oldest first. Thieves take the newest. */
+typedef struct
+{
+    pthread_mutex_t lock;
+    engine_channel_t **pp_channels;
+    size_t i_mask;
+    size_t i_head;
+    size_t i_tail;
+} engine_queue_t;
+
+typedef struct
+{
+    arib_engine_t *p_engine;
+    int i_index;
+    pthread_t thread;
+    engine_queue_t queue;
+    unsigned int i_ticks;
+} engine_worker_t;
+
+struct arib_engine_t
+{
+    engine_channel_t *p_channels;
+    int i_channels;
+    engine_worker_t *p_workers;
+    int i_workers;
+    int i_started;
+
+    arib_engine_callback_t pf_callback;
+    void *p_opaque;
+
+    /* channels pushed from outside the workers */
+    engine_queue_t shared;
+
+    /* idle workers wait for i_queued, the channels in all the queues */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_int i_queued;
+    atomic_int i_sleepers;
+    bool b_quit;
+
+    /* PES pushed and not handled yet, for arib_engine_flush() */
+    atomic_size_t i_pending;
+    pthread_cond_t idle;
+};
+
+/*****************************************************************************
+ * Run queues
+ *****************************************************************************/
+static bool engine_queue_init( engine_queue_t *p_queue, int i_channels )
+{
+    size_t i_size = 1;
+    while( i_size < (size_t) i_channels )
+    {
+        i_size <<= 1;
+    }
+    p_queue->pp_channels = (engine_channel_t**) calloc(
+            i_size, sizeof(*p_queue->pp_channels) );
+    if( p_queue->pp_channels == NULL )
+    {
+        return false;
+    }
+    p_queue->i_mask = i_size - 1;
+    p_queue->i_head = p_queue->i_tail = 0;
+    pthread_mutex_init( &p_queue->lock, NULL );
+    return true;
+}
+
+static void engine_queue_clean( engine_queue_t *p_queue )
+{
+    if( p_queue->pp_channels != NULL )
+    {
+        pthread_mutex_destroy( &p_queue->lock );
+        free( p_queue->pp_channels );
+    }
+}
+
+/* Never full: a queue has room for every channel */
+static void engine_queue_push( engine_queue_t *p_queue,
+                               engine_channel_t *p_channel )
+{
+    pthread_mutex_lock( &p_queue->lock );
+    p_queue->pp_channels[p_queue->i_tail++ & p_queue->i_mask] = p_channel;
+    pthread_mutex_unlock( &p_queue->lock );
+}
+
+static engine_channel_t * engine_queue_pop( engine_queue_t *p_queue,
+                                            bool b_steal )
+{
+    engine_channel_t *p_channel = NULL;
+    pthread_mutex_lock( &p_queue->lock );
+    if( p_queue->i_head != p_queue->i_tail )
+    {
+        if( b_steal )
+        {
+            p_channel = p_queue->pp_channels[--p_queue->i_tail & p_queue->i_mask];
+        }
+        else
+        {
+            p_channel = p_queue->pp_channels[p_queue->i_head++ & p_queue->i_mask];
+        }
+    }
+    pthread_mutex_unlock( &p_queue->lock );
+    return p_channel;
+}
+
+/*****************************************************************************
+ * Scheduling
+ *****************************************************************************/
+static void engine_schedule( arib_engine_t *p_engine, engine_queue_t *p_queue,
+                             engine_channel_t *p_channel )
+{
+    /* counted first: a worker seeing no queued channel may sleep */
+    atomic_fetch_add( &p_engine->i_queued, 1 );
+    engine_queue_push( p_queue, p_channel );
+    if( atomic_load( &p_engine->i_sleepers ) > 0 )
+    {
+        pthread_mutex_lock( &p_engine->lock );
+        pthread_cond_signal( &p_engine->wake );
+        pthread_mutex_unlock( &p_engine->lock );
+    }
+}
+
+static engine_channel_t * engine_take( arib_engine_t *p_engine,
+                                       engine_worker_t *p_worker )
+{
+    engine_channel_t *p_channel = NULL;
+    if( ++p_worker->i_ticks % ENGINE_SHARED_INTERVAL == 0 )
+    {
+        p_channel = engine_queue_pop( &p_engine->shared, false );
+    }
+    if( p_channel == NULL )
+    {
+        p_channel = engine_queue_pop( &p_worker->queue, false );
+    }
+    if( p_channel == NULL )
+    {
+        p_channel = engine_queue_pop( &p_engine->shared, false );
+    }
+    for( int i = 1; p_channel == NULL && i < p_engine->i_workers; i++ )
+    {
+        engine_worker_t *p_victim =
+            &p_engine->p_workers[( p_worker->i_index + i ) % p_engine->i_workers];
+        p_channel = engine_queue_pop( &p_victim->queue, true );
+    }
+    if( p_channel != NULL )
+    {
+        atomic_fetch_sub( &p_engine->i_queued, 1 );
+    }
+    return p_channel;
+}
+
+/* Next channel to run, NULL when the engine stops */
+static engine_channel_t * engine_wait( arib_engine_t *p_engine,
+                                       engine_worker_t *p_worker )
+{
+    for( ;; )
+    {
+        engine_channel_t *p_channel = engine_take( p_engine, p_worker );
+        if( p_channel != NULL )
+        {
+            return p_channel;
+        }
+
+        bool b_quit;
+        pthread_mutex_lock( &p_engine->lock );
+        atomic_fetch_add( &p_engine->i_sleepers, 1 );
+        while( atomic_load( &p_engine->i_queued ) == 0 && !p_engine->b_quit )
+        {
+            pthread_cond_wait( &p_engine->wake, &p_engine->lock );
+        }
+        atomic_fetch_sub( &p_engine->i_sleepers, 1 );
+        b_quit = p_engine->b_quit && atomic_load( &p_engine->i_queued ) == 0;
+        pthread_mutex_unlock( &p_engine->lock );
+        if( b_quit )
+        {
+            return NULL;
+        }
+    }
+}
+
+/*****************************************************************************
+ * Channels
+ *****************************************************************************/
+/* ARIB STD-B24 VOLUME3 Chapter 5, data_group_id of the caption statements */
+static bool engine_is_statement( const engine_pes_t *p_pes )
+{
+    if( p_pes->i_data < 4 )
+    {
+        return false;
+    }
+    size_t i_group = 3 + ( p_pes->p_data[2] & 0x0f );
+    if( i_group >= p_pes->i_data )
+    {
+        return false;
+    }
+    uint8_t i_group_id = p_pes->p_data[i_group] >> 2;
+    return i_group_id != 0x00 && i_group_id != 0x20;
+}
+
+static void engine_decode( arib_engine_t *p_engine, engine_channel_t *p_channel,
+                           const engine_pes_t *p_pes )
+{
+    arib_parse_pes_pts( p_channel->p_parser, p_pes->p_data, p_pes->i_data,
+                        p_pes->i_pts );
+    if( !engine_is_statement( p_pes ) )
+    {
+        return;
+    }
+
+    size_t i_data;
+    const unsigned char *p_data = arib_parser_get_data( p_channel->p_parser, &i_data );
+    if( p_data == NULL || i_data == 0 )
+    {
+        return;
+    }
+
+    arib_decoder_t *p_decoder = p_channel->p_decoder;
+    if( p_channel->i_profile == ARIB_ENGINE_PROFILE_C )
+    {
+        arib_initialize_decoder_c_profile( p_decoder );
+    }
+    else
+    {
+        arib_initialize_decoder_a_profile( p_decoder );
+    }
+
+    size_t i_text = 0;
+    for( ;; )
+    {
+        size_t i_consumed;
+        arib_decode_status_t i_status = arib_decode_buffer_ex( p_decoder,
+                p_data, i_data, p_channel->p_text, p_channel->i_text_size,
+                &i_consumed, &i_text );
+        if( i_status != ARIB_DECODE_OUTPUT_FULL )
+        {
+            break;
+        }
+        char *p_text = (char*) realloc( p_channel->p_text,
+                                        p_channel->i_text_size * 2 );
+        if( p_text == NULL )
+        {
+            arib_log( p_channel->p_instance, ARIB_LOG_ERROR,
+                      "Failed growing the caption text" );
+            return;
+        }
+        p_channel->p_text = p_text;
+        p_channel->i_text_size *= 2;
+        p_data += i_consumed;
+        i_data -= i_consumed;
+    }
+
+    arib_engine_caption_t caption;
+    caption.i_channel = p_channel->i_index;
+    arib_parser_get_timing( p_channel->p_parser, &caption.timing );
+    caption.psz_text = p_channel->p_text;
+    caption.i_text = i_text;
+    caption.p_regions = arib_decoder_get_regions( p_decoder );
+    caption.p_runs = arib_decoder_get_runs( p_decoder, &caption.i_runs );
+    caption.b_clear_screen = arib_decoder_get_clear_screen( p_decoder,
+                                                            &caption.i_clear_offset );
+    p_engine->pf_callback( p_engine->p_opaque, &caption );
+}
+
+static void engine_done( arib_engine_t *p_engine )
+{
+    if( atomic_fetch_sub( &p_engine->i_pending, 1 ) == 1 )
+    {
+        pthread_mutex_lock( &p_engine->lock );
+        pthread_cond_broadcast( &p_engine->idle );
+        pthread_mutex_unlock( &p_engine->lock );
+    }
+}
+
+static void engine_run( arib_engine_t *p_engine, engine_worker_t *p_worker,
+                        engine_channel_t *p_channel )
+{
+    for( int i = 0; i < ENGINE_BATCH; i++ )
+    {
+        pthread_mutex_lock( &p_channel->lock );
+        engine_pes_t *p_pes = p_channel->p_first;
+        if( p_pes == NULL )
+        {
+            p_channel->b_scheduled = false;
+            pthread_mutex_unlock( &p_channel->lock );
+            return;
+        }
+        p_channel->p_first = p_pes->p_next;
+        if( p_channel->p_first == NULL )
+        {
+            p_channel->pp_last = &p_channel->p_first;
+        }
+        pthread_mutex_unlock( &p_channel->lock );
+
+        engine_decode( p_engine, p_channel, p_pes );
+        free( p_pes );
+        engine_done( p_engine );
+    }
+
+    pthread_mutex_lock( &p_channel->lock );
+    bool b_more = p_channel->p_first != NULL;
+    p_channel->b_scheduled = b_more;
+    pthread_mutex_unlock( &p_channel->lock );
+    if( b_more )
+    {
+        /* still busy: behind the channels already waiting here, and up for
+         * stealing by idle workers */
+        engine_schedule( p_engine, &p_worker->queue, p_channel );
+    }
+}
+
+static void * engine_worker( void *p_data )
+{
+    engine_worker_t *p_worker = (engine_worker_t*) p_data;
+    arib_engine_t *p_engine = p_worker->p_engine;
+    engine_channel_t *p_channel;
+    while( (p_channel = engine_wait( p_engine, p_worker )) != NULL )
+    {
+        engine_run( p_engine, p_worker, p_channel );
+    }
+    return NULL;
+}
+
+/*****************************************************************************
+ * Engine
+ *****************************************************************************/
+static bool engine_channel_init( engine_channel_t *p_channel, int i_index )
+{
+    p_channel->i_index = i_index;
+    p_channel->p_instance = arib_instance_new( NULL );
+    if( p_channel->p_instance == NULL )
+    {
+        return false;
+    }
+    p_channel->p_parser = arib_get_parser( p_channel->p_instance );
+    p_channel->p_decoder = arib_get_decoder( p_channel->p_instance );
+    p_channel->p_text = (char*) malloc( ENGINE_TEXT_SIZE );
+    if( p_channel->p_parser == NULL || p_channel->p_decoder == NULL ||
+        p_channel->p_text == NULL )
+    {
+        return false;
+    }
+    p_channel->i_text_size = ENGINE_TEXT_SIZE;
+    p_channel->i_profile = ARIB_ENGINE_PROFILE_A;
+    p_channel->p_first = NULL;
+    p_channel->pp_last = &p_channel->p_first;
+    p_channel->b_scheduled = false;
+    pthread_mutex_init( &p_channel->lock, NULL );
+    return true;
+}
+
+static void engine_channel_clean( engine_channel_t *p_channel )
+{
+    if( p_channel->p_instance == NULL )
+    {
+        return;
+    }
+    if( p_channel->i_text_size > 0 )
+    {
+        pthread_mutex_destroy( &p_channel->lock );
+    }
+    engine_pes_t *p_pes, *p_next;
+    for( p_pes = p_channel->p_first; p_pes; p_pes = p_next )
+    {
+        p_next = p_pes->p_next;
+        free( p_pes );
+    }
+    free( p_channel->p_text );
+    arib_instance_destroy( p_channel->p_instance );
+}
+
+arib_engine_t * arib_engine_new( int i_channels, int i_workers,
+                                 arib_engine_callback_t pf_callback,
+                                 void *p_opaque )
+{
+    if( i_channels <= 0 || pf_callback == NULL )
+    {
+        return NULL;
+    }
+    if( i_workers <= 0 )
+    {
+        long i_cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        i_workers = i_cpus > 0 ? (int) i_cpus : 1;
+    }
+
+    arib_engine_t *p_engine = (arib_engine_t*) calloc( 1, sizeof(*p_engine) );
+    if( p_engine == NULL )
+    {
+        return NULL;
+    }
+    p_engine->pf_callback = pf_callback;
+    p_engine->p_opaque = p_opaque;
+    pthread_mutex_init( &p_engine->lock, NULL );
+    pthread_cond_init( &p_engine->wake, NULL );
+    pthread_cond_init( &p_engine->idle, NULL );
+    atomic_init( &p_engine->i_queued, 0 );
+    atomic_init( &p_engine->i_sleepers, 0 );
+    atomic_init( &p_engine->i_pending, 0 );
+
+    p_engine->p_channels = (engine_channel_t*) calloc( i_channels,
+                                                       sizeof(engine_channel_t) );
+    p_engine->p_workers = (engine_worker_t*) calloc( i_workers,
+                                                     sizeof(engine_worker_t) );
+    if( p_engine->p_channels == NULL || p_engine->p_workers == NULL ||
+        !engine_queue_init( &p_engine->shared, i_channels ) )
+    {
+        arib_engine_free( p_engine );
+        return NULL;
+    }
+    for( ; p_engine->i_channels < i_channels; p_engine->i_channels++ )
+    {
+        engine_channel_t *p_channel = &p_engine->p_channels[p_engine->i_channels];
+        if( !engine_channel_init( p_channel, p_engine->i_channels ) )
+        {
+            p_engine->i_channels++;
+            arib_engine_free( p_engine );
+            return NULL;
+        }
+    }
+    for( ; p_engine->i_workers < i_workers; p_engine->i_workers++ )
+    {
+        engine_worker_t *p_worker = &p_engine->p_workers[p_engine->i_workers];
+        p_worker->p_engine = p_engine;
+        p_worker->i_index = p_engine->i_workers;
+        if( !engine_queue_init( &p_worker->queue, i_channels ) )
+        {
+            arib_engine_free( p_engine );
+            return NULL;
+        }
+    }
+    /* workers steal from every queue, all of them exist before any starts */
+    for( ; p_engine->i_started < i_workers; p_engine->i_started++ )
+    {
+        engine_worker_t *p_worker = &p_engine->p_workers[p_engine->i_started];
+        if( pthread_create( &p_worker->thread, NULL, engine_worker, p_worker ) )
+        {
+            arib_engine_free( p_engine );
+            return NULL;
+        }
+    }
+    return p_engine;
+}
+
+void arib_engine_free( arib_engine_t *p_engine )
+{
+    arib_engine_flush( p_engine );
+
+    pthread_mutex_lock( &p_engine->lock );
+    p_engine->b_quit = true;
+    pthread_cond_broadcast( &p_engine->wake );
+    pthread_mutex_unlock( &p_engine->lock );
+    for( int i = 0; i < p_engine->i_started; i++ )
+    {
+        pthread_join( p_engine->p_workers[i].thread, NULL );
+    }
+
+    for( int i = 0; i < p_engine->i_workers; i++ )
+    {
+        engine_queue_clean( &p_engine->p_workers[i].queue );
+    }
+    for( int i = 0; i < p_engine->i_channels; i++ )
+    {
+        engine_channel_clean( &p_engine->p_channels[i] );
+    }
+    engine_queue_clean( &p_engine->shared );
+    free( p_engine->p_workers );
+    free( p_engine->p_channels );
+    pthread_cond_destroy( &p_engine->idle );
+    pthread_cond_destroy( &p_engine->wake );
+    pthread_mutex_destroy( &p_engine->lock );
+    free( p_engine );
+}
+
+arib_instance_t * arib_engine_get_instance( arib_engine_t *p_engine, int i_channel )
+{
+    if( i_channel < 0 || i_channel >= p_engine->i_channels )
+    {
+        return NULL;
+    }
+    return p_engine->p_channels[i_channel].p_instance;
+}
+
+void arib_engine_set_profile( arib_engine_t *p_engine, int i_channel,
+                              arib_engine_profile_t i_profile )
+{
+    if( i_channel >= 0 && i_channel < p_engine->i_channels )
+    {
+        p_engine->p_channels[i_channel].i_profile = i_profile;
+    }
+}
+
+bool arib_engine_push_pes( arib_engine_t *p_engine, int i_channel,
+                           const void *p_data, size_t i_data, int64_t i_pts )
+{
+    if( i_channel < 0 || i_channel >= p_engine->i_channels )
+    {
+        return false;
+    }
+    engine_channel_t *p_channel = &p_engine->p_channels[i_channel];
+
+    engine_pes_t *p_pes = (engine_pes_t*) malloc( sizeof(*p_pes) + i_data );
+    if( p_pes == NULL )
+    {
+        return false;
+    }
+    p_pes->p_next = NULL;
+    p_pes->i_pts = i_pts;
+    p_pes->i_data = i_data;
+    memcpy( p_pes->p_data, p_data, i_data );
+    atomic_fetch_add( &p_engine->i_pending, 1 );
+
+    pthread_mutex_lock( &p_channel->lock );
+    *p_channel->pp_last = p_pes;
+    p_channel->pp_last = &p_pes->p_next;
+    bool b_schedule = !p_channel->b_scheduled;
+    p_channel->b_scheduled = true;
+    pthread_mutex_unlock( &p_channel->lock );
+
+    if( b_schedule )
+    {
+        engine_schedule( p_engine, &p_engine->shared, p_channel );
+    }
+    return true;
+}
+
+void arib_engine_flush( arib_engine_t *p_engine )
+{
+    pthread_mutex_lock( &p_engine->lock );
+    while( atomic_load( &p_engine->i_pending ) > 0 )
+    {
+        pthread_cond_wait( &p_engine->idle, &p_engine->lock );
+    }
+    pthread_mutex_unlock( &p_engine->lock );
+}
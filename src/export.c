@@ -0,0 +1,810 @@
+/*****************************************************************************
+ * export.c : ARIB STD-B24 caption to subtitle file exporter
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "aribb24/export.h"
+#include "aribb24_private.h"
+
+#define PTS_MASK ( ( INT64_C(1) << 33 ) - 1 )
+
+typedef struct export_buffer_s
+{
+    arib_instance_t *p_instance; /* allocating the data */
+    char *p_data;
+    size_t i_data;
+    size_t i_alloc;
+} export_buffer_t;
+
+/* Displayed region */
+typedef struct export_item_s
+{
+    size_t i_text; /* in the cue buffer */
+    size_t i_len;
+    int i_left;
+    int i_top;
+    int i_width;
+    int i_height;
+    int i_style;
+    int i_area;
+} export_item_t;
+
+/* Positioned formats style, compared with memcmp */
+typedef struct export_style_s
+{
+    int i_color;
+    int i_alpha;
+    int i_fontwidth;
+    int i_fontheight;
+    int i_horint;
+} export_style_t;
+
+typedef struct export_area_s
+{
+    int i_left;
+    int i_top;
+    int i_width;
+    int i_height;
+} export_area_t;
+
+struct arib_exporter_t
+{
+    arib_instance_t *p_instance;
+    arib_export_format_t i_format;
+    arib_export_write_callback_t pf_write;
+    void *p_opaque;
+    int fd;
+
+    /* kept across cues, only grown */
+    export_buffer_t out;
+    export_buffer_t cue;
+    export_item_t *p_items;
+    size_t i_items;
+    size_t i_items_alloc;
+
+    /* ASS and TTML: distinct styles and areas. The header, written with
+     * the first cue, declares those seen so far; the later ones are
+     * written inline in each event using them. */
+    bool b_positioned;
+    export_style_t *p_styles;
+    int i_styles;
+    int i_styles_declared;
+    export_area_t *p_areas;
+    int i_areas;
+    int i_areas_declared;
+    int i_planewidth;
+    int i_planeheight;
+
+    bool b_header_done;
+    bool b_finished;
+    bool b_cue_open;
+    int i_cue_index;
+    int64_t i_cue_start;
+
+    /* 90 kHz clock, unwrapped */
+    bool b_have_pts;
+    int64_t i_last_pts;
+    int64_t i_time;
+};
+
+static bool export_reserve( export_buffer_t *p_buf, size_t i_size )
+{
+    if( p_buf->i_data + i_size <= p_buf->i_alloc )
+    {
+        return true;
+    }
+    size_t i_alloc = p_buf->i_alloc ? p_buf->i_alloc : 1024;
+    while( i_alloc < p_buf->i_data + i_size )
+    {
+        i_alloc *= 2;
+    }
+    char *p_data = (char*) arib_realloc( p_buf->p_instance, p_buf->p_data, i_alloc );
+    if( p_data == NULL )
+    {
+        return false;
+    }
+    p_buf->p_data = p_data;
+    p_buf->i_alloc = i_alloc;
+    return true;
+}
+
+static bool export_append( export_buffer_t *p_buf, const char *p_data, size_t i_data )
+{
+    if( !export_reserve( p_buf, i_data ) )
+    {
+        return false;
+    }
+    memcpy( p_buf->p_data + p_buf->i_data, p_data, i_data );
+    p_buf->i_data += i_data;
+    return true;
+}
+
+static bool export_appendf( export_buffer_t *p_buf, const char *psz_format, ... )
+{
+    va_list args;
+    size_t i_size = 128;
+    for( ;; )
+    {
+        if( !export_reserve( p_buf, i_size ) )
+        {
+            return false;
+        }
+        va_start( args, psz_format );
+        int i_len = vsnprintf( p_buf->p_data + p_buf->i_data, i_size, psz_format, args );
+        va_end( args );
+        if( i_len < 0 )
+        {
+            return false;
+        }
+        if( (size_t) i_len < i_size )
+        {
+            p_buf->i_data += i_len;
+            return true;
+        }
+        i_size = i_len + 1;
+    }
+}
+
+static bool export_write_fd( void *p_opaque, const char *p_data, size_t i_data )
+{
+    arib_exporter_t *p_exporter = (arib_exporter_t*) p_opaque;
+    while( i_data > 0 )
+    {
+        ssize_t i_ret = write( p_exporter->fd, p_data, i_data );
+        if( i_ret < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            return false;
+        }
+        p_data += i_ret;
+        i_data -= i_ret;
+    }
+    return true;
+}
+
+static bool export_write( arib_exporter_t *p_exporter, export_buffer_t *p_buf )
+{
+    if( p_buf->i_data == 0 )
+    {
+        return true;
+    }
+    bool b_ret = p_exporter->pf_write( p_exporter->p_opaque,
+                                       p_buf->p_data, p_buf->i_data );
+    p_buf->i_data = 0;
+    if( !b_ret )
+    {
+        arib_log( p_exporter->p_instance, ARIB_LOG_ERROR,
+                  "Failed writing exported captions" );
+    }
+    return b_ret;
+}
+
+static bool export_append_time( arib_exporter_t *p_exporter, int64_t i_time )
+{
+    int64_t i_ms = i_time > 0 ? i_time / 90 : 0;
+    int i_hour = i_ms / 3600000;
+    int i_min = i_ms / 60000 % 60;
+    int i_sec = i_ms / 1000 % 60;
+    switch( p_exporter->i_format )
+    {
+        case ARIB_EXPORT_SRT:
+            return export_appendf( &p_exporter->out, "%02d:%02d:%02d,%03d",
+                                   i_hour, i_min, i_sec, (int) ( i_ms % 1000 ) );
+        case ARIB_EXPORT_ASS:
+            return export_appendf( &p_exporter->out, "%d:%02d:%02d.%02d",
+                                   i_hour, i_min, i_sec, (int) ( i_ms % 1000 / 10 ) );
+        default:
+            return export_appendf( &p_exporter->out, "%02d:%02d:%02d.%03d",
+                                   i_hour, i_min, i_sec, (int) ( i_ms % 1000 ) );
+    }
+}
+
+/* Cue text, escaped as the format requires */
+static bool export_append_text( arib_exporter_t *p_exporter,
+                                const char *p_data, size_t i_data )
+{
+    export_buffer_t *p_buf = &p_exporter->out;
+    if( p_exporter->i_format == ARIB_EXPORT_SRT )
+    {
+        return export_append( p_buf, p_data, i_data );
+    }
+
+    size_t i_span = 0;
+    for( size_t i = 0; i < i_data; i++ )
+    {
+        const char *psz_escape = NULL;
+        if( p_exporter->i_format == ARIB_EXPORT_ASS )
+        {
+            switch( p_data[i] )
+            {
+                case '{': psz_escape = "\\{"; break;
+                case '}': psz_escape = "\\}"; break;
+            }
+        }
+        else
+        {
+            switch( p_data[i] )
+            {
+                case '&': psz_escape = "&amp;"; break;
+                case '<': psz_escape = "&lt;"; break;
+                case '>': psz_escape = "&gt;"; break;
+            }
+        }
+        if( psz_escape == NULL )
+        {
+            continue;
+        }
+        if( !export_append( p_buf, p_data + i_span, i - i_span ) ||
+            !export_append( p_buf, psz_escape, strlen( psz_escape ) ) )
+        {
+            return false;
+        }
+        i_span = i + 1;
+    }
+    return export_append( p_buf, p_data + i_span, i_data - i_span );
+}
+
+/* Index of the style or area, added on first use */
+static int export_find( arib_instance_t *p_instance, void **pp_table, int *pi_count,
+                        const void *p_entry, size_t i_size )
+{
+    char *p_table = (char*) *pp_table;
+    for( int i = 0; i < *pi_count; i++ )
+    {
+        if( memcmp( p_table + i * i_size, p_entry, i_size ) == 0 )
+        {
+            return i;
+        }
+    }
+    p_table = (char*) arib_realloc( p_instance, p_table, ( *pi_count + 1 ) * i_size );
+    if( p_table == NULL )
+    {
+        return -1;
+    }
+    memcpy( p_table + *pi_count * i_size, p_entry, i_size );
+    *pp_table = p_table;
+    return (*pi_count)++;
+}
+
+static int export_utf8_length( const char *p_data, size_t i_data )
+{
+    int i_chars = 0;
+    for( size_t i = 0; i < i_data; i++ )
+    {
+        if( ( p_data[i] & 0xc0 ) != 0x80 )
+        {
+            i_chars++;
+        }
+    }
+    return i_chars;
+}
+
+static bool export_add_item( arib_exporter_t *p_exporter,
+                             const arib_buf_region_t *p_region )
+{
+    size_t i_len = p_region->p_end - p_region->p_start;
+
+    if( p_exporter->i_items == p_exporter->i_items_alloc )
+    {
+        size_t i_alloc = p_exporter->i_items_alloc ? p_exporter->i_items_alloc * 2 : 16;
+        export_item_t *p_items = (export_item_t*) arib_realloc(
+                p_exporter->p_instance, p_exporter->p_items,
+                i_alloc * sizeof(export_item_t) );
+        if( p_items == NULL )
+        {
+            return false;
+        }
+        p_exporter->p_items = p_items;
+        p_exporter->i_items_alloc = i_alloc;
+    }
+
+    export_item_t *p_item = &p_exporter->p_items[p_exporter->i_items];
+    p_item->i_text = p_exporter->cue.i_data;
+    p_item->i_len = i_len;
+
+    /* i_charleft is past the first character */
+    int i_charwidth = p_region->i_fontwidth + p_region->i_horint;
+    int i_charheight = p_region->i_fontheight + p_region->i_verint;
+    p_item->i_left = p_region->i_charleft - i_charwidth;
+    p_item->i_top = p_region->i_charbottom - i_charheight;
+    p_item->i_width = export_utf8_length( p_region->p_start, i_len ) * i_charwidth;
+    p_item->i_height = i_charheight;
+    p_item->i_style = 0;
+    p_item->i_area = 0;
+
+    if( p_exporter->b_positioned )
+    {
+        export_style_t style;
+        memset( &style, 0, sizeof(style) );
+        style.i_color = p_region->i_foreground_color;
+        style.i_alpha = p_region->i_foreground_alpha;
+        style.i_fontwidth = p_region->i_fontwidth;
+        style.i_fontheight = p_region->i_fontheight;
+        style.i_horint = p_region->i_horint;
+        p_item->i_style = export_find( p_exporter->p_instance,
+                                       (void**) &p_exporter->p_styles,
+                                       &p_exporter->i_styles, &style, sizeof(style) );
+
+        export_area_t area;
+        memset( &area, 0, sizeof(area) );
+        area.i_left = p_item->i_left;
+        area.i_top = p_item->i_top;
+        area.i_width = p_item->i_width;
+        area.i_height = p_item->i_height;
+        p_item->i_area = export_find( p_exporter->p_instance,
+                                      (void**) &p_exporter->p_areas,
+                                      &p_exporter->i_areas, &area, sizeof(area) );
+        if( p_item->i_style < 0 || p_item->i_area < 0 )
+        {
+            return false;
+        }
+
+        if( p_exporter->i_planewidth == 0 )
+        {
+            p_exporter->i_planewidth = p_region->i_planewidth;
+            p_exporter->i_planeheight = p_region->i_planeheight;
+        }
+    }
+
+    if( !export_append( &p_exporter->cue, p_region->p_start, i_len ) )
+    {
+        return false;
+    }
+    p_exporter->i_items++;
+    return true;
+}
+
+/* &HAABBGGRR, AA is the transparency */
+static unsigned int export_ass_color( const export_style_t *p_style )
+{
+    return ( p_style->i_alpha & 0xff ) << 24 |
+           ( p_style->i_color & 0xff ) << 16 |
+           ( p_style->i_color & 0xff00 ) |
+           ( p_style->i_color >> 16 & 0xff );
+}
+
+static int export_ass_scale( const export_style_t *p_style )
+{
+    return p_style->i_fontheight ?
+           p_style->i_fontwidth * 100 / p_style->i_fontheight : 100;
+}
+
+static bool export_append_ttml_style( export_buffer_t *p_out,
+                                      const export_style_t *p_style )
+{
+    return export_appendf( p_out,
+        " tts:color=\"#%06X%02X\" tts:fontSize=\"%dpx %dpx\" "
+        "tts:letterSpacing=\"%dpx\"",
+        p_style->i_color & 0xffffff, 0xff - ( p_style->i_alpha & 0xff ),
+        p_style->i_fontwidth, p_style->i_fontheight, p_style->i_horint );
+}
+
+static bool export_append_ttml_area( export_buffer_t *p_out,
+                                     const export_area_t *p_area )
+{
+    return export_appendf( p_out, " tts:origin=\"%dpx %dpx\" tts:extent=\"%dpx %dpx\"",
+                           p_area->i_left, p_area->i_top,
+                           p_area->i_width, p_area->i_height );
+}
+
+/* The eight colors of palette 0 in the character sizes of the profile,
+ * so that most later events still use a declared style */
+static bool export_add_standard_styles( arib_exporter_t *p_exporter,
+                                        int i_planewidth )
+{
+    static const int colors[] =
+    {
+        0x000000, 0xFF0000, 0x00FF00, 0xFFFF00,
+        0x0000FF, 0xFF00FF, 0x00FFFF, 0xFFFFFF,
+    };
+    /* width and height, in half characters: normal, middle, small,
+     * double height, double width, double size */
+    static const int sizes[][2] =
+    {
+        { 2, 2 }, { 1, 2 }, { 1, 1 }, { 2, 4 }, { 4, 2 }, { 4, 4 },
+    };
+    /* profile A plane is 960 wide, profile C 320 */
+    int i_font = i_planewidth < 960 ? 18 : 36;
+    int i_horint = i_font / 9;
+
+    for( size_t i_size = 0; i_size < sizeof(sizes) / sizeof(sizes[0]); i_size++ )
+    {
+        for( size_t i = 0; i < sizeof(colors) / sizeof(colors[0]); i++ )
+        {
+            export_style_t style;
+            memset( &style, 0, sizeof(style) );
+            style.i_color = colors[i];
+            style.i_fontwidth = i_font * sizes[i_size][0] / 2;
+            style.i_fontheight = i_font * sizes[i_size][1] / 2;
+            style.i_horint = i_horint * sizes[i_size][0] / 2;
+            if( export_find( p_exporter->p_instance, (void**) &p_exporter->p_styles,
+                             &p_exporter->i_styles, &style, sizeof(style) ) < 0 )
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Declares the styles and areas seen so far, the later ones are inline */
+static bool export_write_header( arib_exporter_t *p_exporter )
+{
+    export_buffer_t *p_out = &p_exporter->out;
+    int i_planewidth = p_exporter->i_planewidth ? p_exporter->i_planewidth : 960;
+    int i_planeheight = p_exporter->i_planeheight ? p_exporter->i_planeheight : 540;
+    bool b_ok = true;
+
+    p_exporter->b_header_done = true;
+    b_ok &= export_add_standard_styles( p_exporter, i_planewidth );
+    p_exporter->i_styles_declared = p_exporter->i_styles;
+    p_exporter->i_areas_declared = p_exporter->i_areas;
+    if( p_exporter->i_format == ARIB_EXPORT_ASS )
+    {
+        b_ok &= export_appendf( p_out,
+            "[Script Info]\n"
+            "ScriptType: v4.00+\n"
+            "PlayResX: %d\n"
+            "PlayResY: %d\n"
+            "WrapStyle: 2\n"
+            "\n"
+            "[V4+ Styles]\n"
+            "Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, "
+            "OutlineColour, BackColour, Bold, Italic, Underline, StrikeOut, "
+            "ScaleX, ScaleY, Spacing, Angle, BorderStyle, Outline, Shadow, "
+            "Alignment, MarginL, MarginR, MarginV, Encoding\n",
+            i_planewidth, i_planeheight );
+        for( int i = 0; i < p_exporter->i_styles; i++ )
+        {
+            const export_style_t *p_style = &p_exporter->p_styles[i];
+            unsigned int i_color = export_ass_color( p_style );
+            b_ok &= export_appendf( p_out,
+                "Style: s%d,sans-serif,%d,&H%08X,&H%08X,&H00000000,&H00000000,"
+                "0,0,0,0,%d,100,%d,0,1,1,0,1,0,0,0,1\n",
+                i, p_style->i_fontheight, i_color, i_color,
+                export_ass_scale( p_style ), p_style->i_horint );
+        }
+        b_ok &= export_appendf( p_out,
+            "\n"
+            "[Events]\n"
+            "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, "
+            "Effect, Text\n" );
+    }
+    else
+    {
+        b_ok &= export_appendf( p_out,
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<tt xmlns=\"http://www.w3.org/ns/ttml\" "
+            "xmlns:tts=\"http://www.w3.org/ns/ttml#styling\" "
+            "xmlns:ttp=\"http://www.w3.org/ns/ttml#parameter\" "
+            "ttp:timeBase=\"media\" xml:lang=\"ja\" tts:extent=\"%dpx %dpx\">\n"
+            "<head>\n<styling>\n",
+            i_planewidth, i_planeheight );
+        for( int i = 0; i < p_exporter->i_styles; i++ )
+        {
+            b_ok &= export_appendf( p_out, "<style xml:id=\"s%d\"", i );
+            b_ok &= export_append_ttml_style( p_out, &p_exporter->p_styles[i] );
+            b_ok &= export_append( p_out, "/>\n", 3 );
+        }
+        b_ok &= export_appendf( p_out, "</styling>\n<layout>\n" );
+        for( int i = 0; i < p_exporter->i_areas; i++ )
+        {
+            b_ok &= export_appendf( p_out, "<region xml:id=\"r%d\"", i );
+            b_ok &= export_append_ttml_area( p_out, &p_exporter->p_areas[i] );
+            b_ok &= export_append( p_out, "/>\n", 3 );
+        }
+        b_ok &= export_appendf( p_out, "</layout>\n</head>\n<body>\n<div>\n" );
+    }
+    return b_ok;
+}
+
+static bool export_write_cue( arib_exporter_t *p_exporter, int64_t i_end )
+{
+    export_buffer_t *p_out = &p_exporter->out;
+    const char *p_text = p_exporter->cue.p_data;
+    bool b_ok = true;
+
+    if( p_exporter->b_positioned && !p_exporter->b_header_done )
+    {
+        b_ok &= export_write_header( p_exporter );
+    }
+
+    switch( p_exporter->i_format )
+    {
+        case ARIB_EXPORT_SRT:
+        case ARIB_EXPORT_WEBVTT:
+            /* one line per region row */
+            if( p_exporter->i_format == ARIB_EXPORT_SRT )
+            {
+                b_ok &= export_appendf( p_out, "%d\n", ++p_exporter->i_cue_index );
+            }
+            b_ok &= export_append_time( p_exporter, p_exporter->i_cue_start );
+            b_ok &= export_append( p_out, " --> ", 5 );
+            b_ok &= export_append_time( p_exporter, i_end );
+            for( size_t i = 0; i < p_exporter->i_items; i++ )
+            {
+                const export_item_t *p_item = &p_exporter->p_items[i];
+                if( i == 0 || p_item->i_top != p_item[-1].i_top )
+                {
+                    b_ok &= export_append( p_out, "\n", 1 );
+                }
+                b_ok &= export_append_text( p_exporter, p_text + p_item->i_text,
+                                            p_item->i_len );
+            }
+            b_ok &= export_append( p_out, "\n\n", 2 );
+            break;
+
+        case ARIB_EXPORT_ASS:
+            /* one event per region, bottom left aligned at its position,
+             * a style missing from the header overrides s0 */
+            for( size_t i = 0; i < p_exporter->i_items; i++ )
+            {
+                const export_item_t *p_item = &p_exporter->p_items[i];
+                bool b_declared = p_item->i_style < p_exporter->i_styles_declared;
+                b_ok &= export_append( p_out, "Dialogue: 0,", 12 );
+                b_ok &= export_append_time( p_exporter, p_exporter->i_cue_start );
+                b_ok &= export_append( p_out, ",", 1 );
+                b_ok &= export_append_time( p_exporter, i_end );
+                b_ok &= export_appendf( p_out, ",s%d,,0,0,0,,{\\pos(%d,%d)",
+                                        b_declared ? p_item->i_style : 0,
+                                        p_item->i_left,
+                                        p_item->i_top + p_item->i_height );
+                if( !b_declared )
+                {
+                    const export_style_t *p_style = &p_exporter->p_styles[p_item->i_style];
+                    unsigned int i_color = export_ass_color( p_style );
+                    b_ok &= export_appendf( p_out,
+                        "\\fs%d\\fscx%d\\fsp%d\\1c&H%06X&\\1a&H%02X&",
+                        p_style->i_fontheight, export_ass_scale( p_style ),
+                        p_style->i_horint, i_color & 0xffffff, i_color >> 24 );
+                }
+                b_ok &= export_append( p_out, "}", 1 );
+                b_ok &= export_append_text( p_exporter, p_text + p_item->i_text,
+                                            p_item->i_len );
+                b_ok &= export_append( p_out, "\n", 1 );
+            }
+            break;
+
+        case ARIB_EXPORT_TTML:
+            /* an area or a style missing from the header is an inline
+             * region or inline styling */
+            for( size_t i = 0; i < p_exporter->i_items; i++ )
+            {
+                const export_item_t *p_item = &p_exporter->p_items[i];
+                b_ok &= export_append( p_out, "<p begin=\"", 10 );
+                b_ok &= export_append_time( p_exporter, p_exporter->i_cue_start );
+                b_ok &= export_append( p_out, "\" end=\"", 7 );
+                b_ok &= export_append_time( p_exporter, i_end );
+                if( p_item->i_area < p_exporter->i_areas_declared )
+                {
+                    b_ok &= export_appendf( p_out, "\" region=\"r%d\">", p_item->i_area );
+                }
+                else
+                {
+                    b_ok &= export_append( p_out, "\"><region", 9 );
+                    b_ok &= export_append_ttml_area( p_out,
+                                                     &p_exporter->p_areas[p_item->i_area] );
+                    b_ok &= export_append( p_out, "/>", 2 );
+                }
+                if( p_item->i_style < p_exporter->i_styles_declared )
+                {
+                    b_ok &= export_appendf( p_out, "<span style=\"s%d\">", p_item->i_style );
+                }
+                else
+                {
+                    b_ok &= export_append( p_out, "<span", 5 );
+                    b_ok &= export_append_ttml_style( p_out,
+                                                      &p_exporter->p_styles[p_item->i_style] );
+                    b_ok &= export_append( p_out, ">", 1 );
+                }
+                b_ok &= export_append_text( p_exporter, p_text + p_item->i_text,
+                                            p_item->i_len );
+                b_ok &= export_append( p_out, "</span></p>\n", 12 );
+            }
+            break;
+    }
+    return b_ok;
+}
+
+static bool export_close_cue( arib_exporter_t *p_exporter, int64_t i_end )
+{
+    if( !p_exporter->b_cue_open )
+    {
+        return true;
+    }
+    p_exporter->b_cue_open = false;
+    if( i_end <= p_exporter->i_cue_start || p_exporter->i_items == 0 )
+    {
+        return true;
+    }
+
+    if( !export_write_cue( p_exporter, i_end ) )
+    {
+        arib_log( p_exporter->p_instance, ARIB_LOG_ERROR,
+                  "Failed exporting cue at %"PRId64, p_exporter->i_cue_start );
+        return false;
+    }
+    return export_write( p_exporter, &p_exporter->out );
+}
+
+static int64_t export_time( arib_exporter_t *p_exporter, int64_t i_pts )
+{
+    i_pts &= PTS_MASK;
+    if( p_exporter->b_have_pts )
+    {
+        /* 33 bits wrap around, small backward steps are kept */
+        int64_t i_delta = ( i_pts - p_exporter->i_last_pts ) & PTS_MASK;
+        if( i_delta > PTS_MASK / 2 )
+        {
+            i_delta -= PTS_MASK + 1;
+        }
+        p_exporter->i_time += i_delta;
+    }
+    p_exporter->b_have_pts = true;
+    p_exporter->i_last_pts = i_pts;
+    return p_exporter->i_time;
+}
+
+arib_exporter_t * arib_exporter_new( arib_instance_t *p_instance,
+                                     arib_export_format_t i_format,
+                                     arib_export_write_callback_t pf_write,
+                                     void *p_opaque )
+{
+    arib_exporter_t *p_exporter = arib_calloc( p_instance, 1, sizeof(*p_exporter) );
+    if( p_exporter == NULL )
+    {
+        return NULL;
+    }
+    p_exporter->p_instance = p_instance;
+    p_exporter->out.p_instance = p_instance;
+    p_exporter->cue.p_instance = p_instance;
+    p_exporter->i_format = i_format;
+    p_exporter->pf_write = pf_write;
+    p_exporter->p_opaque = p_opaque;
+    p_exporter->fd = -1;
+    p_exporter->b_positioned = i_format == ARIB_EXPORT_ASS ||
+                               i_format == ARIB_EXPORT_TTML;
+    return p_exporter;
+}
+
+arib_exporter_t * arib_exporter_new_fd( arib_instance_t *p_instance,
+                                        arib_export_format_t i_format, int fd )
+{
+    arib_exporter_t *p_exporter = arib_exporter_new( p_instance, i_format,
+                                                     export_write_fd, NULL );
+    if( p_exporter != NULL )
+    {
+        p_exporter->p_opaque = p_exporter;
+        p_exporter->fd = fd;
+    }
+    return p_exporter;
+}
+
+void arib_exporter_free( arib_exporter_t *p_exporter )
+{
+    if( p_exporter == NULL )
+    {
+        return;
+    }
+    arib_instance_t *p_instance = p_exporter->p_instance;
+    arib_free( p_instance, p_exporter->out.p_data );
+    arib_free( p_instance, p_exporter->cue.p_data );
+    arib_free( p_instance, p_exporter->p_items );
+    arib_free( p_instance, p_exporter->p_styles );
+    arib_free( p_instance, p_exporter->p_areas );
+    arib_free( p_instance, p_exporter );
+}
+
+bool arib_exporter_push( arib_exporter_t *p_exporter, arib_decoder_t *p_decoder,
+                         const char *psz_text, int64_t i_pts )
+{
+    int64_t i_time = export_time( p_exporter, i_pts );
+
+    if( !p_exporter->b_header_done && p_exporter->i_format == ARIB_EXPORT_WEBVTT )
+    {
+        if( !export_append( &p_exporter->out, "WEBVTT\n\n", 8 ) )
+        {
+            return false;
+        }
+        p_exporter->b_header_done = true;
+    }
+
+    size_t i_clear;
+    bool b_clear = arib_decoder_get_clear_screen( p_decoder, &i_clear );
+    const arib_buf_region_t *p_region = arib_decoder_get_regions( p_decoder );
+
+    /* skip what the last CS erased */
+    if( b_clear )
+    {
+        while( p_region != NULL && (size_t) ( p_region->p_start - psz_text ) < i_clear )
+        {
+            p_region = p_region->p_next;
+        }
+    }
+    bool b_text = false;
+    for( const arib_buf_region_t *p = p_region; p != NULL; p = p->p_next )
+    {
+        if( p->p_end > p->p_start )
+        {
+            b_text = true;
+            break;
+        }
+    }
+
+    if( !b_clear && !b_text )
+    {
+        return export_write( p_exporter, &p_exporter->out );
+    }
+    if( !export_close_cue( p_exporter, i_time ) )
+    {
+        return false;
+    }
+    if( b_clear )
+    {
+        p_exporter->cue.i_data = 0;
+        p_exporter->i_items = 0;
+    }
+
+    for( ; p_region != NULL; p_region = p_region->p_next )
+    {
+        if( p_region->p_end > p_region->p_start &&
+            !export_add_item( p_exporter, p_region ) )
+        {
+            return false;
+        }
+    }
+
+    if( p_exporter->i_items > 0 )
+    {
+        p_exporter->b_cue_open = true;
+        p_exporter->i_cue_start = i_time;
+    }
+    return export_write( p_exporter, &p_exporter->out );
+}
+
+bool arib_exporter_finish( arib_exporter_t *p_exporter, int64_t i_pts )
+{
+    bool b_ret = export_close_cue( p_exporter, export_time( p_exporter, i_pts ) );
+    p_exporter->cue.i_data = 0;
+    p_exporter->i_items = 0;
+
+    if( p_exporter->b_positioned && !p_exporter->b_finished )
+    {
+        p_exporter->b_finished = true;
+        if( !p_exporter->b_header_done )
+        {
+            b_ret &= export_write_header( p_exporter );
+        }
+        if( p_exporter->i_format == ARIB_EXPORT_TTML )
+        {
+            b_ret &= export_appendf( &p_exporter->out, "</div>\n</body>\n</tt>\n" );
+        }
+    }
+    return export_write( p_exporter, &p_exporter->out ) && b_ret;
+}
@@ -0,0 +1,358 @@
+/*****************************************************************************
+ * gen_convtable.c : generate the compact kanji tables from convtable.h
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Built and run on the build machine, writes convtable16.h to stdout, or
+ * encoder_table.h when run as "gen_convtable encoder".
+ *
+ * Cells are stored as uint16_t in [ku * 94 + ten] order. The few cells
+ * outside the BMP hold 0xd800 + their index in a side table: surrogates
+ * are never valid characters, so no BMP value can be mistaken for one. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CONVTABLE_KANJI 1
+#include "convtable.h"
+#include "encoder_hash.h"
+
+#define GEN_SUPPLEMENTARY_BASE 0xd800
+#define GEN_SUPPLEMENTARY_MAX  0x800
+
+static unsigned int supplementary[GEN_SUPPLEMENTARY_MAX];
+static int i_supplementary = 0;
+
+/* Marker for the cells that the 16-bit tables cannot hold: code points
+ * above the BMP, and U+2026 which b_replace_ellipsis maps to another one */
+static int gen_supplementary( const char *psz_name, unsigned int uc )
+{
+    for( int i = 0; i < i_supplementary; i++ )
+    {
+        if( supplementary[i] == uc )
+        {
+            return GEN_SUPPLEMENTARY_BASE + i;
+        }
+    }
+    if( i_supplementary == GEN_SUPPLEMENTARY_MAX )
+    {
+        fprintf( stderr, "%s: too many supplementary cells\n", psz_name );
+        return -1;
+    }
+    supplementary[i_supplementary] = uc;
+    return GEN_SUPPLEMENTARY_BASE + i_supplementary++;
+}
+
+/* The rows from i_private_ku come from the private table when it is given */
+static int gen_table( const char *psz_name, const unsigned int (*table)[94],
+                      int i_rows, const unsigned int (*private)[94],
+                      int i_private_ku )
+{
+    printf( "static const uint16_t %s[%d * 94] = {", psz_name, i_rows );
+    for( int i = 0; i < i_rows * 94; i++ )
+    {
+        unsigned int uc = table[i / 94][i % 94];
+        if( private != NULL && i / 94 >= i_private_ku )
+        {
+            uc = private[i / 94 - i_private_ku][i % 94];
+        }
+        if( uc >= GEN_SUPPLEMENTARY_BASE &&
+            uc < GEN_SUPPLEMENTARY_BASE + GEN_SUPPLEMENTARY_MAX )
+        {
+            fprintf( stderr, "%s: surrogate 0x%x at %d\n", psz_name, uc, i );
+            return -1;
+        }
+        if( uc > 0xffff || uc == 0x2026 )
+        {
+            int i_marker = gen_supplementary( psz_name, uc );
+            if( i_marker < 0 )
+            {
+                return -1;
+            }
+            uc = i_marker;
+        }
+        printf( "%s0x%04x,", i % 8 ? " " : "\n    ", uc );
+    }
+    printf( "\n};\n\n" );
+    return 0;
+}
+
+static void gen_supplementary_table( bool b_replace_ellipsis )
+{
+    printf( "    {" );
+    for( int i = 0; i < i_supplementary; i++ )
+    {
+        unsigned int uc = supplementary[i];
+        if( b_replace_ellipsis && uc == 0x2026 )
+        {
+            // U+2026: HORIZONTAL ELLIPSIS
+            // U+22EF: MIDLINE HORIZONTAL ELLIPSIS
+            uc = 0x22ef;
+        }
+        printf( "%s0x%05x,", i % 8 ? " " : "\n        ", uc );
+    }
+    printf( "\n    },\n" );
+}
+
+static int gen_decoder( void )
+{
+    printf( "/* Generated by gen_convtable from convtable.h, do not edit */\n\n"
+            "#ifndef ARIBB24_CONVTABLE16_H\n"
+            "#define ARIBB24_CONVTABLE16_H 1\n\n"
+            "#define DECODER_KANJI_SUPPLEMENTARY 0x%x\n\n",
+            GEN_SUPPLEMENTARY_BASE );
+
+    const int i_rows = sizeof(decoder_kanji_table) / sizeof(decoder_kanji_table[0]);
+    const int i_private_ku = i_rows - sizeof(decoder_private_conv_table) /
+                                      sizeof(decoder_private_conv_table[0]);
+
+    /* one table per b_use_private_conv value, bound when the decoder is
+     * initialized */
+    printf( "#define DECODER_PRIVATE_KU %d\n\n", i_private_ku );
+    if( gen_table( "decoder_kanji_table16", decoder_kanji_table,
+                   i_rows, NULL, 0 ) ||
+        gen_table( "decoder_kanji_private_table16", decoder_kanji_table,
+                   i_rows, decoder_private_conv_table, i_private_ku ) )
+    {
+        return -1;
+    }
+
+    /* and one side table per b_replace_ellipsis value */
+    printf( "static const uint32_t decoder_kanji_supplementary[2][%d] = {\n",
+            i_supplementary );
+    gen_supplementary_table( false );
+    gen_supplementary_table( true );
+    printf( "};\n\n#endif\n" );
+    return 0;
+}
+
+#define GEN_SLOTS   ( 1 << ENCODER_HASH_SLOT_BITS )
+#define GEN_BUCKETS ( 1 << ENCODER_HASH_BUCKET_BITS )
+
+static uint32_t keys[GEN_SLOTS];
+static uint32_t values[GEN_SLOTS];
+static int i_keys = 0;
+
+static uint32_t *gen_find( uint32_t uc )
+{
+    for( int i = 0; i < i_keys; i++ )
+    {
+        if( keys[i] == uc )
+        {
+            return &values[i];
+        }
+    }
+    if( i_keys == GEN_SLOTS )
+    {
+        return NULL;
+    }
+    keys[i_keys] = uc;
+    values[i_keys] = 0;
+    return &values[i_keys++];
+}
+
+static int gen_add_cell( uint32_t uc, int i_cell, uint32_t i_flags )
+{
+    uint32_t *p_value = gen_find( uc );
+    if( p_value == NULL )
+    {
+        return -1;
+    }
+    /* the first cell of a character shown by both modes wins */
+    if( ( *p_value & ENCODER_CELL_MASK ) == 0 ||
+        ( ( *p_value & ( ENCODER_CELL_PRIVATE | ENCODER_CELL_NO_PRIVATE ) ) &&
+          i_flags == 0 ) )
+    {
+        *p_value = ( *p_value & ~0xffff ) | ( i_cell + 1 ) | i_flags;
+    }
+    return 0;
+}
+
+static int gen_add_byte( uint32_t uc, int i_byte, uint32_t i_set )
+{
+    uint32_t *p_value = gen_find( uc );
+    if( p_value == NULL )
+    {
+        return -1;
+    }
+    uint32_t i_old = ( *p_value >> ENCODER_BYTE_SHIFT ) & 0xff;
+    if( i_old != 0 && i_old != (uint32_t) i_byte )
+    {
+        /* keep the first set, the encoder needs a single byte value */
+        return 0;
+    }
+    *p_value |= ( (uint32_t) i_byte << ENCODER_BYTE_SHIFT ) |
+                ( i_set << ENCODER_SETS_SHIFT );
+    return 0;
+}
+
+static int gen_encoder( void )
+{
+    /* reverse of each decoder table */
+    for( int i = 0; i < 94; i++ )
+    {
+        if( gen_add_byte( decoder_alnum_table[i] + 0xfee0, 0x21 + i, ENCODER_IN_ALNUM ) ||
+            gen_add_byte( decoder_alnum_table[i], 0x21 + i, ENCODER_IN_ALNUM ) )
+        {
+            return -1;
+        }
+        /* U+3000 is encoded as SP */
+        if( decoder_hiragana_table[i] != 0x3000 &&
+            gen_add_byte( decoder_hiragana_table[i], 0x21 + i, ENCODER_IN_HIRAGANA ) )
+        {
+            return -1;
+        }
+        if( decoder_katakana_table[i] != 0x3000 &&
+            gen_add_byte( decoder_katakana_table[i], 0x21 + i, ENCODER_IN_KATAKANA ) )
+        {
+            return -1;
+        }
+    }
+
+    const int i_rows = sizeof(decoder_kanji_table) / sizeof(decoder_kanji_table[0]);
+    const int i_private_rows = sizeof(decoder_private_conv_table) /
+                               sizeof(decoder_private_conv_table[0]);
+    const int i_private_ku = i_rows - i_private_rows;
+    for( int i = 0; i < i_rows * 94; i++ )
+    {
+        uint32_t uc = decoder_kanji_table[i / 94][i % 94];
+        uint32_t i_flags = 0;
+        if( i / 94 >= i_private_ku &&
+            decoder_private_conv_table[i / 94 - i_private_ku][i % 94] != uc )
+        {
+            i_flags = ENCODER_CELL_NO_PRIVATE;
+        }
+        if( uc != 0 && uc != 0x3000 && gen_add_cell( uc, i, i_flags ) )
+        {
+            return -1;
+        }
+    }
+    for( int i = 0; i < i_private_rows * 94; i++ )
+    {
+        uint32_t uc = decoder_private_conv_table[i / 94][i % 94];
+        int i_cell = i_private_ku * 94 + i;
+        if( uc != 0 && uc != decoder_kanji_table[i_cell / 94][i_cell % 94] &&
+            gen_add_cell( uc, i_cell, ENCODER_CELL_PRIVATE ) )
+        {
+            return -1;
+        }
+    }
+
+    /* hash and displace: place the largest buckets first, each with the
+     * first seed sending all its keys to free slots */
+    static int bucket_keys[GEN_BUCKETS][16];
+    static int bucket_size[GEN_BUCKETS];
+    static uint16_t seeds[GEN_BUCKETS];
+    static uint32_t slot_key[GEN_SLOTS];
+    static uint32_t slot_value[GEN_SLOTS];
+    static char slot_used[GEN_SLOTS];
+
+    for( int i = 0; i < i_keys; i++ )
+    {
+        uint32_t b = encoder_hash_bucket( keys[i] );
+        if( bucket_size[b] == 16 )
+        {
+            fprintf( stderr, "encoder: bucket %u overflows\n", b );
+            return -1;
+        }
+        bucket_keys[b][bucket_size[b]++] = i;
+    }
+
+    for( int i_size = 16; i_size > 0; i_size-- )
+    {
+        for( int b = 0; b < GEN_BUCKETS; b++ )
+        {
+            if( bucket_size[b] != i_size )
+            {
+                continue;
+            }
+            uint32_t i_seed;
+            for( i_seed = 0; i_seed <= 0xffff; i_seed++ )
+            {
+                uint32_t slots[16];
+                int k;
+                for( k = 0; k < i_size; k++ )
+                {
+                    slots[k] = encoder_hash_slot( keys[bucket_keys[b][k]], i_seed );
+                    if( slot_used[slots[k]] )
+                    {
+                        break;
+                    }
+                    int j;
+                    for( j = 0; j < k && slots[j] != slots[k]; j++ )
+                        ;
+                    if( j < k )
+                    {
+                        break;
+                    }
+                }
+                if( k == i_size )
+                {
+                    for( k = 0; k < i_size; k++ )
+                    {
+                        slot_used[slots[k]] = 1;
+                        slot_key[slots[k]] = keys[bucket_keys[b][k]];
+                        slot_value[slots[k]] = values[bucket_keys[b][k]];
+                    }
+                    break;
+                }
+            }
+            if( i_seed > 0xffff )
+            {
+                fprintf( stderr, "encoder: no seed for bucket %d\n", b );
+                return -1;
+            }
+            seeds[b] = i_seed;
+        }
+    }
+
+    printf( "/* Generated by gen_convtable from convtable.h, do not edit */\n\n"
+            "#ifndef ARIBB24_ENCODER_TABLE_H\n"
+            "#define ARIBB24_ENCODER_TABLE_H 1\n\n"
+            "/* %d code points */\n", i_keys );
+    printf( "static const uint16_t encoder_hash_seed[%d] = {", GEN_BUCKETS );
+    for( int i = 0; i < GEN_BUCKETS; i++ )
+    {
+        printf( "%s%u,", i % 12 ? " " : "\n    ", seeds[i] );
+    }
+    printf( "\n};\n\nstatic const uint32_t encoder_hash_key[%d] = {", GEN_SLOTS );
+    for( int i = 0; i < GEN_SLOTS; i++ )
+    {
+        printf( "%s0x%05x,", i % 8 ? " " : "\n    ", slot_key[i] );
+    }
+    printf( "\n};\n\nstatic const uint32_t encoder_hash_value[%d] = {", GEN_SLOTS );
+    for( int i = 0; i < GEN_SLOTS; i++ )
+    {
+        printf( "%s0x%08x,", i % 6 ? " " : "\n    ", slot_value[i] );
+    }
+    printf( "\n};\n\n#endif\n" );
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    int i_ret = argc > 1 && !strcmp( argv[1], "encoder" ) ? gen_encoder()
+                                                           : gen_decoder();
+    if( i_ret || ferror( stdout ) )
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,246 @@
+/*****************************************************************************
+ * packet.c : ARIB STD-B24 caption packets handed from parser to decoder
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "aribb24/packet.h"
+#include "aribb24_private.h"
+#include "packet_private.h"
+
+struct arib_caption_packet_t
+{
+    /* of the instance, which the packet may outlive */
+    arib_allocator_t allocator;
+    arib_caption_timing_t timing;
+    size_t i_data;
+    unsigned char *p_data;
+    drcs_set_t *p_drcs; /* NULL without DRCS patterns */
+};
+
+static const drcs_set_t packet_no_drcs;
+
+static drcs_set_t * packet_copy_drcs( const arib_allocator_t *p_alloc,
+                                      const drcs_set_t *p_src )
+{
+    drcs_set_t *p_drcs = (drcs_set_t*) arib_allocator_malloc( p_alloc,
+                                                              sizeof(*p_drcs) );
+    if( p_drcs == NULL )
+    {
+        return NULL;
+    }
+    p_drcs->i_num = p_src->i_num;
+    memcpy( p_drcs->conv_table, p_src->conv_table,
+            p_src->i_num * sizeof(p_src->conv_table[0]) );
+    memcpy( p_drcs->hash_table, p_src->hash_table,
+            p_src->i_num * sizeof(p_src->hash_table[0]) );
+    memset( p_drcs->glyph_table, 0, sizeof(p_drcs->glyph_table) );
+    for( int i = 0; i < p_src->i_num; i++ )
+    {
+        const drcs_glyph_t *p_glyph = &p_src->glyph_table[i];
+        if( p_glyph->p_alpha == NULL )
+        {
+            continue;
+        }
+        size_t i_size = (size_t) p_glyph->i_width * p_glyph->i_height;
+        uint8_t *p_alpha = (uint8_t*) arib_allocator_malloc( p_alloc, i_size );
+        if( p_alpha == NULL )
+        {
+            free_drcs_glyphs( p_alloc, p_drcs );
+            arib_allocator_free( p_alloc, p_drcs );
+            return NULL;
+        }
+        memcpy( p_alpha, p_glyph->p_alpha, i_size );
+        p_drcs->glyph_table[i] = *p_glyph;
+        p_drcs->glyph_table[i].p_alpha = p_alpha;
+    }
+    return p_drcs;
+}
+
+arib_caption_packet_t * arib_caption_packet_new( arib_instance_t *p_instance,
+                                                 const unsigned char *p_data,
+                                                 size_t i_data,
+                                                 const arib_caption_timing_t *p_timing )
+{
+    const arib_allocator_t *p_alloc = &p_instance->p->allocator;
+    arib_caption_packet_t *p_packet =
+        (arib_caption_packet_t*) arib_allocator_calloc( p_alloc, 1,
+                                                        sizeof(*p_packet) );
+    if( p_packet == NULL )
+    {
+        return NULL;
+    }
+    p_packet->allocator = *p_alloc;
+    p_packet->timing = *p_timing;
+    p_packet->i_data = i_data;
+    p_packet->p_data = (unsigned char*) arib_allocator_malloc( p_alloc, i_data + 1 );
+    if( p_packet->p_data == NULL )
+    {
+        arib_allocator_free( p_alloc, p_packet );
+        return NULL;
+    }
+    memcpy( p_packet->p_data, p_data, i_data );
+    p_packet->p_data[i_data] = '\0';
+
+    if( p_instance->p->drcs.i_num > 0 )
+    {
+        p_packet->p_drcs = packet_copy_drcs( p_alloc, &p_instance->p->drcs );
+        if( p_packet->p_drcs == NULL )
+        {
+            arib_allocator_free( p_alloc, p_packet->p_data );
+            arib_allocator_free( p_alloc, p_packet );
+            return NULL;
+        }
+    }
+    return p_packet;
+}
+
+void arib_caption_packet_free( arib_caption_packet_t *p_packet )
+{
+    if( p_packet == NULL )
+    {
+        return;
+    }
+    const arib_allocator_t allocator = p_packet->allocator;
+    if( p_packet->p_drcs != NULL )
+    {
+        free_drcs_glyphs( &allocator, p_packet->p_drcs );
+        arib_allocator_free( &allocator, p_packet->p_drcs );
+    }
+    arib_allocator_free( &allocator, p_packet->p_data );
+    arib_allocator_free( &allocator, p_packet );
+}
+
+const unsigned char * arib_caption_packet_get_data( const arib_caption_packet_t *p_packet,
+                                                    size_t *pi_size )
+{
+    *pi_size = p_packet->i_data;
+    return p_packet->p_data;
+}
+
+void arib_caption_packet_get_timing( const arib_caption_packet_t *p_packet,
+                                     arib_caption_timing_t *p_timing )
+{
+    *p_timing = p_packet->timing;
+}
+
+const drcs_set_t * packet_get_drcs( const arib_caption_packet_t *p_packet )
+{
+    return p_packet->p_drcs ? p_packet->p_drcs : &packet_no_drcs;
+}
+
+/*****************************************************************************
+ * Single producer, single consumer queue
+ *****************************************************************************/
+#define PACKET_QUEUE_LINE 64
+
+struct arib_packet_queue_t
+{
+    arib_caption_packet_t **pp_slots;
+    size_t i_mask;
+
+    /* consumer side: next slot to pop, and the tail it last saw */
+    char pad0[PACKET_QUEUE_LINE];
+    atomic_size_t i_head;
+    size_t i_tail_seen;
+
+    /* producer side: next slot to push, and the head it last saw */
+    char pad1[PACKET_QUEUE_LINE];
+    atomic_size_t i_tail;
+    size_t i_head_seen;
+    char pad2[PACKET_QUEUE_LINE];
+};
+
+arib_packet_queue_t * arib_packet_queue_new( size_t i_size )
+{
+    size_t i_slots = 1;
+    while( i_slots < i_size )
+    {
+        i_slots <<= 1;
+    }
+
+    arib_packet_queue_t *p_queue =
+        (arib_packet_queue_t*) calloc( 1, sizeof(*p_queue) );
+    if( p_queue == NULL )
+    {
+        return NULL;
+    }
+    p_queue->pp_slots = (arib_caption_packet_t**) calloc(
+            i_slots, sizeof(*p_queue->pp_slots) );
+    if( p_queue->pp_slots == NULL )
+    {
+        free( p_queue );
+        return NULL;
+    }
+    p_queue->i_mask = i_slots - 1;
+    atomic_init( &p_queue->i_head, 0 );
+    atomic_init( &p_queue->i_tail, 0 );
+    return p_queue;
+}
+
+void arib_packet_queue_free( arib_packet_queue_t *p_queue )
+{
+    arib_caption_packet_t *p_packet;
+    while( (p_packet = arib_packet_queue_pop( p_queue )) != NULL )
+    {
+        arib_caption_packet_free( p_packet );
+    }
+    free( p_queue->pp_slots );
+    free( p_queue );
+}
+
+bool arib_packet_queue_push( arib_packet_queue_t *p_queue,
+                             arib_caption_packet_t *p_packet )
+{
+    size_t i_tail = atomic_load_explicit( &p_queue->i_tail, memory_order_relaxed );
+    if( i_tail - p_queue->i_head_seen > p_queue->i_mask )
+    {
+        p_queue->i_head_seen = atomic_load_explicit( &p_queue->i_head,
+                                                     memory_order_acquire );
+        if( i_tail - p_queue->i_head_seen > p_queue->i_mask )
+        {
+            return false;
+        }
+    }
+    p_queue->pp_slots[i_tail & p_queue->i_mask] = p_packet;
+    /* publishes the slot and the packet content */
+    atomic_store_explicit( &p_queue->i_tail, i_tail + 1, memory_order_release );
+    return true;
+}
+
+arib_caption_packet_t * arib_packet_queue_pop( arib_packet_queue_t *p_queue )
+{
+    size_t i_head = atomic_load_explicit( &p_queue->i_head, memory_order_relaxed );
+    if( i_head == p_queue->i_tail_seen )
+    {
+        p_queue->i_tail_seen = atomic_load_explicit( &p_queue->i_tail,
+                                                     memory_order_acquire );
+        if( i_head == p_queue->i_tail_seen )
+        {
+            return NULL;
+        }
+    }
+    arib_caption_packet_t *p_packet = p_queue->pp_slots[i_head & p_queue->i_mask];
+    /* hands the slot back to the producer */
+    atomic_store_explicit( &p_queue->i_head, i_head + 1, memory_order_release );
+    return p_packet;
+}
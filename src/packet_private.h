@@ -0,0 +1,29 @@
+/*****************************************************************************
+ * packet_private.h : ARIB STD-B24 caption packet internals
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef PACKET_PRIVATE_H
+#define PACKET_PRIVATE_H 1
+
+arib_caption_packet_t * arib_caption_packet_new( arib_instance_t *,
+                                                 const unsigned char *p_data,
+                                                 size_t i_data,
+                                                 const arib_caption_timing_t * );
+const drcs_set_t * packet_get_drcs( const arib_caption_packet_t * );
+
+#endif
@@ -31,8 +31,11 @@
 #include "aribb24/aribb24.h"
 #include "aribb24/parser.h"
 #include "aribb24/bits.h"
+#include "aribb24/packet.h"
 #include "aribb24_private.h"
 #include "parser_private.h"
+#include "packet_private.h"
+#include "probes.h"
 
 struct arib_parser_t
 {
@@ -46,6 +49,13 @@ struct arib_parser_t
     size_t            i_subtitle_data_size;
     unsigned char     *psz_subtitle_data;
 
+    /* timing of the last statement, 90 kHz */
+    int64_t           i_pts;
+    arib_caption_timing_t timing;
+    int64_t           i_otm_pts; /* PTS of the management data carrying OTM */
+
+    unsigned int      i_stat_calls; /* to sample the parse time */
+
 #ifdef ARIBSUB_GEN_DRCS_DATA
     drcs_data_t       *p_drcs_data;
 #endif //ARIBSUB_GEN_DRCS_DATA
@@ -55,12 +65,13 @@ static void parse_data_unit_statement_body( arib_parser_t *p_parser, bs_t *p_bs,
                                             uint8_t i_data_unit_parameter,
                                             uint32_t i_data_unit_size )
 {
-    char* p_data_unit_data_byte = (char*) calloc(
-            i_data_unit_size + 1, sizeof(char) );
+    char* p_data_unit_data_byte = (char*) arib_calloc(
+            p_parser->p_instance, i_data_unit_size + 1, sizeof(char) );
     if( p_data_unit_data_byte == NULL )
     {
         return;
     }
+    arib_stats_add( p_parser->p_instance, ARIB_STAT_ALLOCATIONS, 1 );
     for( uint32_t i = 0; i < i_data_unit_size; i++ )
     {
         p_data_unit_data_byte[i] = bs_read( p_bs, 8 );
@@ -72,15 +83,16 @@ static void parse_data_unit_statement_body( arib_parser_t *p_parser, bs_t *p_bs,
             p_data_unit_data_byte, i_data_unit_size );
     p_parser->i_subtitle_data_size += i_data_unit_size;
 
-    free( p_data_unit_data_byte );
+    arib_free( p_parser->p_instance, p_data_unit_data_byte );
 }
 
 static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
                                   uint8_t i_data_unit_parameter,
                                   uint32_t i_data_unit_size )
 {
-    p_parser->p_instance->p->i_drcs_num = 0;
+    p_parser->p_instance->p->drcs.i_num = 0;
 #ifdef ARIBSUB_GEN_DRCS_DATA
+    arib_instance_t *p_instance = p_parser->p_instance;
     if( p_parser->p_drcs_data != NULL )
     {
         for( int i = 0; i < p_parser->p_drcs_data->i_NumberOfCode; i++ )
@@ -89,15 +101,16 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
             for( int j = 0; j < p_drcs_code->i_NumberOfFont ; j++ )
             {
                 drcs_font_data_t *p_drcs_font_data =  &p_drcs_code->p_drcs_font_data[j];
-                free( p_drcs_font_data->p_drcs_pattern_data );
-                free( p_drcs_font_data->p_drcs_geometric_data );
+                arib_free( p_instance, p_drcs_font_data->p_drcs_pattern_data );
+                arib_free( p_instance, p_drcs_font_data->p_drcs_geometric_data );
             }
-            free( p_drcs_code->p_drcs_font_data );
+            arib_free( p_instance, p_drcs_code->p_drcs_font_data );
         }
-        free( p_parser->p_drcs_data->p_drcs_code );
-        free( p_parser->p_drcs_data );
+        arib_free( p_instance, p_parser->p_drcs_data->p_drcs_code );
+        arib_free( p_instance, p_parser->p_drcs_data );
     }
-    p_parser->p_drcs_data = (drcs_data_t*) calloc( 1, sizeof(drcs_data_t) );
+    p_parser->p_drcs_data = (drcs_data_t*) arib_calloc(
+            p_parser->p_instance, 1, sizeof(drcs_data_t) );
     if( p_parser->p_drcs_data == NULL )
     {
         return;
@@ -109,8 +122,8 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
 
 #ifdef ARIBSUB_GEN_DRCS_DATA
     p_parser->p_drcs_data->i_NumberOfCode = i_NumberOfCode;
-    p_parser->p_drcs_data->p_drcs_code = (drcs_code_t*) calloc(
-            i_NumberOfCode, sizeof(drcs_code_t) );
+    p_parser->p_drcs_data->p_drcs_code = (drcs_code_t*) arib_calloc(
+            p_parser->p_instance, i_NumberOfCode, sizeof(drcs_code_t) );
     if( p_parser->p_drcs_data->p_drcs_code == NULL )
     {
         return;
@@ -128,8 +141,8 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
         drcs_code_t *p_drcs_code = &p_parser->p_drcs_data->p_drcs_code[i];
         p_drcs_code->i_CharacterCode = i_CharacterCode;
         p_drcs_code->i_NumberOfFont = i_NumberOfFont;
-        p_drcs_code->p_drcs_font_data = (drcs_font_data_t*) calloc(
-                i_NumberOfFont, sizeof(drcs_font_data_t) );
+        p_drcs_code->p_drcs_font_data = (drcs_font_data_t*) arib_calloc(
+                p_parser->p_instance, i_NumberOfFont, sizeof(drcs_font_data_t) );
         if( p_drcs_code->p_drcs_font_data == NULL )
         {
             return;
@@ -167,8 +180,8 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
 #ifdef ARIBSUB_GEN_DRCS_DATA
                 drcs_pattern_data_t* p_drcs_pattern_data =
                     p_drcs_font_data->p_drcs_pattern_data =
-                    (drcs_pattern_data_t*) calloc(
-                            1, sizeof(drcs_pattern_data_t) );
+                    (drcs_pattern_data_t*) arib_calloc(
+                            p_parser->p_instance, 1, sizeof(drcs_pattern_data_t) );
                 if( p_drcs_pattern_data == NULL )
                 {
                     return;
@@ -176,7 +189,8 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
                 p_drcs_pattern_data->i_depth = i_depth;
                 p_drcs_pattern_data->i_width = i_width;
                 p_drcs_pattern_data->i_height = i_height;
-                p_drcs_pattern_data->p_patternData = (int8_t*) calloc(
+                p_drcs_pattern_data->p_patternData = (int8_t*) arib_calloc(
+                            p_parser->p_instance,
                             i_width * i_height * i_bits_per_pixel / 8,
                             sizeof(int8_t) );
                 if( p_drcs_pattern_data->p_patternData == NULL )
@@ -184,13 +198,15 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
                     return;
                 }
 #else
-                int8_t *p_patternData = (int8_t*) calloc(
+                int8_t *p_patternData = (int8_t*) arib_calloc(
+                            p_parser->p_instance,
                             i_width * i_height * i_bits_per_pixel / 8,
                             sizeof(int8_t) );
                 if( p_patternData == NULL )
                 {
                     return;
                 }
+                arib_stats_add( p_parser->p_instance, ARIB_STAT_ALLOCATIONS, 1 );
 #endif //ARIBSUB_GEN_DRCS_DATA
 
                 for( int k = 0; k < i_width * i_height * i_bits_per_pixel / 8; k++ )
@@ -210,7 +226,7 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
 #else
                 save_drcs_pattern( p_parser->p_instance, i_width, i_height, i_depth + 2,
                                    p_patternData );
-                free( p_patternData );
+                arib_free( p_parser->p_instance, p_patternData );
 #endif //ARIBSUB_GEN_DRCS_DATA
             }
             else
@@ -225,8 +241,8 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
 #ifdef ARIBSUB_GEN_DRCS_DATA
                 drcs_geometric_data_t* p_drcs_geometric_data =
                     p_drcs_font_data->p_drcs_geometric_data =
-                    (drcs_geometric_data_t*) calloc(
-                            1, sizeof(drcs_geometric_data_t) );
+                    (drcs_geometric_data_t*) arib_calloc(
+                            p_parser->p_instance, 1, sizeof(drcs_geometric_data_t) );
                 if( p_drcs_geometric_data == NULL )
                 {
                     return;
@@ -235,7 +251,7 @@ static void parse_data_unit_DRCS( arib_parser_t *p_parser, bs_t *p_bs,
                 p_drcs_geometric_data->i_regionY = i_regionY;
                 p_drcs_geometric_data->i_geometricData_length = i_geometricData_length;
                 p_drcs_geometric_data->p_geometricData = (int8_t*)
-                    calloc( i_geometricData_length, sizeof(int8_t) );
+                    arib_calloc( p_parser->p_instance, i_geometricData_length, sizeof(int8_t) );
                 if( p_drcs_geometric_data->p_geometricData == NULL )
                 {
                     return;
@@ -286,8 +302,12 @@ static void parse_data_unit( arib_parser_t *p_parser, bs_t *p_bs )
     p_parser->i_data_unit_size += 1;
     uint32_t i_data_unit_size = bs_read( p_bs, 24 );
     p_parser->i_data_unit_size += 3;
+    ARIB_PROBE3( data_unit, p_parser, i_data_unit_parameter, i_data_unit_size );
+    arib_instance_t *p_instance = p_parser->p_instance;
     if( i_data_unit_parameter == 0x20 )
     {
+        arib_stats_add( p_instance, ARIB_STAT_STATEMENT_UNITS, 1 );
+        arib_stats_add( p_instance, ARIB_STAT_STATEMENT_BYTES, i_data_unit_size );
         parse_data_unit_statement_body( p_parser, p_bs,
                                        i_data_unit_parameter,
                                        i_data_unit_size );
@@ -295,18 +315,41 @@ static void parse_data_unit( arib_parser_t *p_parser, bs_t *p_bs )
     else if( i_data_unit_parameter == 0x30 ||
              i_data_unit_parameter == 0x31 )
     {
+        arib_stats_add( p_instance, i_data_unit_parameter == 0x30 ?
+                                    ARIB_STAT_DRCS_1BYTE_UNITS :
+                                    ARIB_STAT_DRCS_2BYTE_UNITS, 1 );
         parse_data_unit_DRCS( p_parser, p_bs,
                               i_data_unit_parameter,
                               i_data_unit_size );
+        /* mapped here so that decoding never writes the parser's DRCS */
+        apply_drcs_conversion_table( p_instance );
     }
     else
     {
+        arib_stats_add( p_instance, ARIB_STAT_OTHER_UNITS, 1 );
         parse_data_unit_others( p_parser, p_bs,
                                 i_data_unit_parameter,
                                 i_data_unit_size );
     }
 }
 
+/* 36 bits BCD hours, minutes, seconds and milliseconds, to 90 kHz */
+static int64_t parse_time( bs_t *p_bs )
+{
+    static const int digits[4] = { 2, 2, 2, 3 };
+    int64_t i_value[4];
+    for( int i = 0; i < 4; i++ )
+    {
+        i_value[i] = 0;
+        for( int j = 0; j < digits[i]; j++ )
+        {
+            i_value[i] = i_value[i] * 10 + bs_read( p_bs, 4 );
+        }
+    }
+    int64_t i_ms = ( ( i_value[0] * 60 + i_value[1] ) * 60 + i_value[2] ) * 1000 + i_value[3];
+    return i_ms * 90;
+}
+
 /*****************************************************************************
  * parse_caption_management_data
  *****************************************************************************
@@ -316,10 +359,11 @@ static void parse_caption_management_data( arib_parser_t *p_parser, bs_t *p_bs )
 {
     uint8_t i_TMD = bs_read( p_bs, 2 );
     bs_skip( p_bs, 6 ); /* Reserved */
+    p_parser->timing.i_otm = -1;
     if( i_TMD == 0x02 /* 10 */ )
     {
-        bs_skip( p_bs, 32 ); /* OTM << 4 */
-        bs_skip( p_bs, 4 ); /* OTM & 15 */
+        p_parser->timing.i_otm = parse_time( p_bs ); /* OTM */
+        p_parser->i_otm_pts = p_parser->i_pts;
         bs_skip( p_bs, 4 ); /* Reserved */
     }
     uint8_t i_num_languages = bs_read( p_bs, 8 );
@@ -340,14 +384,19 @@ static void parse_caption_management_data( arib_parser_t *p_parser, bs_t *p_bs )
         bs_skip( p_bs, 2 ); /* i_rollup_mode */
     }
     uint32_t i_data_unit_loop_length = bs_read( p_bs, 24 );
-    free( p_parser->psz_subtitle_data );
+    arib_free( p_parser->p_instance, p_parser->psz_subtitle_data );
     p_parser->i_data_unit_size = 0;
     p_parser->i_subtitle_data_size = 0;
     p_parser->psz_subtitle_data = NULL;
     if( i_data_unit_loop_length > 0 )
     {
-        p_parser->psz_subtitle_data = (unsigned char*) calloc(
-                i_data_unit_loop_length + 1, sizeof(unsigned char) );
+        p_parser->psz_subtitle_data = (unsigned char*) arib_calloc(
+                p_parser->p_instance, i_data_unit_loop_length + 1,
+                sizeof(unsigned char) );
+        if( p_parser->psz_subtitle_data != NULL )
+        {
+            arib_stats_add( p_parser->p_instance, ARIB_STAT_ALLOCATIONS, 1 );
+        }
     }
     while( p_parser->i_data_unit_size < i_data_unit_loop_length )
     {
@@ -364,20 +413,39 @@ static void parse_caption_statement_data( arib_parser_t *p_parser, bs_t *p_bs )
 {
     uint8_t i_TMD = bs_read( p_bs, 2 );
     bs_skip( p_bs, 6 ); /* Reserved */
+    arib_caption_timing_t *p_timing = &p_parser->timing;
+    p_timing->i_tmd = i_TMD;
+    p_timing->i_pts = p_parser->i_pts;
+    p_timing->i_stm = -1;
     if( i_TMD == 0x01 /* 01 */ || i_TMD == 0x02 /* 10 */ )
     {
-        bs_skip( p_bs, 32 ); /* STM << 4 */
-        bs_skip( p_bs, 4 ); /* STM & 15 */
+        p_timing->i_stm = parse_time( p_bs ); /* STM */
         bs_skip( p_bs, 4 ); /* Reserved */
     }
+
+    /* In offset time mode, the STM and OTM clock is anchored at the PTS
+     * of the management data that carried the OTM */
+    p_timing->i_start = p_parser->i_pts;
+    if( i_TMD == ARIB_TMD_OFFSET && p_timing->i_stm >= 0 &&
+        p_timing->i_otm >= 0 && p_parser->i_otm_pts >= 0 )
+    {
+        p_timing->i_start = ( p_parser->i_otm_pts + p_timing->i_stm -
+                              p_timing->i_otm ) & ARIB_PTS_MASK;
+    }
     uint32_t i_data_unit_loop_length = bs_read( p_bs, 24 );
-    free( p_parser->psz_subtitle_data );
+    arib_free( p_parser->p_instance, p_parser->psz_subtitle_data );
+    p_parser->i_data_unit_size = 0;
     p_parser->i_subtitle_data_size = 0;
     p_parser->psz_subtitle_data = NULL;
     if( i_data_unit_loop_length > 0 )
     {
-        p_parser->psz_subtitle_data = (unsigned char*) calloc(
-                i_data_unit_loop_length + 1, sizeof(unsigned char) );
+        p_parser->psz_subtitle_data = (unsigned char*) arib_calloc(
+                p_parser->p_instance, i_data_unit_loop_length + 1,
+                sizeof(unsigned char) );
+        if( p_parser->psz_subtitle_data != NULL )
+        {
+            arib_stats_add( p_parser->p_instance, ARIB_STAT_ALLOCATIONS, 1 );
+        }
     }
     while( p_parser->i_data_unit_size < i_data_unit_loop_length )
     {
@@ -414,6 +482,11 @@ static void parse_data_group( arib_parser_t *p_parser, bs_t *p_bs )
  * ARIB STD-B24 VOLUME3 Chapter 5 Independent PES transmission protocol
  *****************************************************************************/
 void arib_parse_pes( arib_parser_t *p_parser, const void *p_data, size_t i_data )
+{
+    arib_parse_pes_pts( p_parser, p_data, i_data, -1 );
+}
+
+static void parse_pes( arib_parser_t *p_parser, const void *p_data, size_t i_data )
 {
     bs_t bs;
     bs_init( &bs, p_data, i_data );
@@ -436,26 +509,47 @@ void arib_parse_pes( arib_parser_t *p_parser, const void *p_data, size_t i_data
     parse_data_group( p_parser, &bs );
 }
 
+void arib_parse_pes_pts( arib_parser_t *p_parser, const void *p_data, size_t i_data,
+                         int64_t i_pts )
+{
+    arib_instance_t *p_instance = p_parser->p_instance;
+    uint64_t i_start = arib_stats_time_begin( &p_parser->i_stat_calls );
+    ARIB_PROBE2( parse_entry, p_parser, i_data );
+    p_parser->i_pts = i_pts;
+    parse_pes( p_parser, p_data, i_data );
+    ARIB_PROBE3( parse_exit, p_parser, i_data, p_parser->i_subtitle_data_size );
+    arib_stats_add( p_instance, ARIB_STAT_PARSED_BYTES, i_data );
+    arib_stats_time_end( p_instance, ARIB_STAT_PARSE_NS, i_start );
+}
+
 arib_parser_t * arib_parser_new( arib_instance_t *p_instance )
 {
-    arib_parser_t *p_parser = calloc( 1, sizeof(*p_parser) );
+    arib_parser_t *p_parser = arib_calloc( p_instance, 1, sizeof(*p_parser) );
     if ( !p_parser )
        return NULL;
     p_parser->p_instance = p_instance;
-    arib_log( p_parser->p_instance, "arib parser was created" );
-    if ( p_instance->p->psz_base_path )
+    p_parser->i_pts = -1;
+    p_parser->timing.i_pts = -1;
+    p_parser->timing.i_stm = -1;
+    p_parser->timing.i_otm = -1;
+    p_parser->timing.i_start = -1;
+    p_parser->i_otm_pts = -1;
+    arib_log( p_parser->p_instance, ARIB_LOG_DEBUG, "arib parser was created" );
+    if ( p_instance->p->psz_base_path &&
+         !load_drcs_conversion_table( p_parser->p_instance ) )
     {
-        load_drcs_conversion_table( p_parser->p_instance );
-        arib_log( p_parser->p_instance, "could not load drcs conversion table" );
+        arib_log( p_parser->p_instance, ARIB_LOG_WARNING,
+                  "could not load drcs conversion table" );
     }
     return p_parser;
 }
 
 void arib_parser_free( arib_parser_t *p_parser )
 {
-    arib_log( p_parser->p_instance, "arib parser was destroyed" );
-    free( p_parser->psz_subtitle_data );
-    free( p_parser );
+    arib_log( p_parser->p_instance, ARIB_LOG_DEBUG, "arib parser was destroyed" );
+    arib_instance_t *p_instance = p_parser->p_instance;
+    arib_free( p_instance, p_parser->psz_subtitle_data );
+    arib_free( p_instance, p_parser );
 }
 
 const unsigned char * arib_parser_get_data( arib_parser_t *p_parser, size_t *pi_size )
@@ -463,3 +557,20 @@ const unsigned char * arib_parser_get_data( arib_parser_t *p_parser, size_t *pi_
     *pi_size = p_parser->i_subtitle_data_size;
     return p_parser->psz_subtitle_data;
 }
+
+void arib_parser_get_timing( arib_parser_t *p_parser, arib_caption_timing_t *p_timing )
+{
+    *p_timing = p_parser->timing;
+}
+
+arib_caption_packet_t * arib_parser_get_packet( arib_parser_t *p_parser )
+{
+    if( p_parser->psz_subtitle_data == NULL )
+    {
+        return NULL;
+    }
+    return arib_caption_packet_new( p_parser->p_instance,
+                                    p_parser->psz_subtitle_data,
+                                    p_parser->i_subtitle_data_size,
+                                    &p_parser->timing );
+}
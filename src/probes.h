@@ -0,0 +1,50 @@
+/*****************************************************************************
+ * probes.h : ARIB STD-B24 USDT static probes
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef ARIBB24_PROBES_H
+#define ARIBB24_PROBES_H 1
+
+/* Probes of the "aribb24" provider, built in when configure finds
+ * <sys/sdt.h> unless --disable-sdt. Each is a single nop until perf,
+ * bpftrace or SystemTap attaches to it, e.g.
+ *   bpftrace -e 'usdt:libaribb24.so:aribb24:decode_exit { ... }'
+ *
+ *   parse_entry     (parser, PES bytes)
+ *   parse_exit      (parser, PES bytes, statement bytes)
+ *   data_unit       (parser, data unit parameter, data unit bytes)
+ *   decode_entry    (decoder, input bytes)
+ *   decode_exit     (decoder, input bytes consumed, output bytes)
+ *   decode_failure  (decoder, offset of the undecodable input byte)
+ *   region_new      (decoder, left, bottom)
+ *   drcs_save       (instance, width, height, MD5 hash string)
+ */
+#ifdef HAVE_SYS_SDT_H
+# include <sys/sdt.h>
+# define ARIB_PROBE1( name, a )          DTRACE_PROBE1( aribb24, name, a )
+# define ARIB_PROBE2( name, a, b )       DTRACE_PROBE2( aribb24, name, a, b )
+# define ARIB_PROBE3( name, a, b, c )    DTRACE_PROBE3( aribb24, name, a, b, c )
+# define ARIB_PROBE4( name, a, b, c, d ) DTRACE_PROBE4( aribb24, name, a, b, c, d )
+#else
+# define ARIB_PROBE1( name, a )          do { } while( 0 )
+# define ARIB_PROBE2( name, a, b )       do { } while( 0 )
+# define ARIB_PROBE3( name, a, b, c )    do { } while( 0 )
+# define ARIB_PROBE4( name, a, b, c, d ) do { } while( 0 )
+#endif
+
+#endif
@@ -0,0 +1,681 @@
+/*****************************************************************************
+ * render.c : ARIB STD-B24 caption rasterizer
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef HAVE_FREETYPE
+  #include <ft2build.h>
+  #include FT_FREETYPE_H
+  #include FT_MODULE_H
+#endif
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+#include "aribb24/render.h"
+#include "aribb24_private.h"
+#include "decoder_private.h"
+
+/* Glyph cache: open addressing on (code point, size), a slot is evicted
+ * when no free one is found within RENDER_CACHE_PROBE slots */
+#define RENDER_CACHE_SIZE  1024
+#define RENDER_CACHE_PROBE 8
+
+typedef struct render_glyph_s
+{
+    uint32_t uc;
+    uint32_t i_size; /* width << 16 | height, 0 for a free slot */
+
+    /* bitmap position in the glyph box */
+    int i_left;
+    int i_top;
+    int i_width;
+    int i_height;
+    uint8_t *p_alpha;
+} render_glyph_t;
+
+struct arib_renderer_t
+{
+    arib_instance_t *p_instance;
+
+#ifdef HAVE_FREETYPE
+    /* FreeType allocates through the instance allocator too */
+    struct FT_MemoryRec_ ft_memory;
+    FT_Library p_library;
+    FT_Face p_face;
+    uint32_t i_face_size;
+#endif
+
+    uint32_t cmla_table[128];
+    render_glyph_t glyph_cache[RENDER_CACHE_SIZE];
+
+    /* DRCS pattern scaled to the glyph box */
+    uint8_t *p_scratch;
+    size_t i_scratch;
+};
+
+#define DIV255( x ) ( ( (x) + 128 + ( ( (x) + 128 ) >> 8 ) ) >> 8 )
+
+/*****************************************************************************
+ * ARIB STD-B24 VOLUME 1 Part 2 Table 7-9 CMLA
+ *****************************************************************************/
+static void render_init_cmla_table( uint32_t *p_table )
+{
+    static const uint8_t levels[4] = { 0, 85, 170, 255 };
+    int i = 0;
+
+    /* palette 0: full and half intensity primaries, 8 is transparent */
+    for( int j = 0; j < 16; j++ )
+    {
+        int i_level = j < 8 ? 255 : 170;
+        uint32_t i_rgb = ( j & 1 ? i_level << 16 : 0 ) |
+                         ( j & 2 ? i_level << 8 : 0 ) |
+                         ( j & 4 ? i_level : 0 );
+        p_table[i++] = j == 8 ? 0 : 0xff000000 | i_rgb;
+    }
+
+    /* then the remaining combinations of the four levels */
+    for( int r = 0; r < 4; r++ )
+    {
+        for( int g = 0; g < 4; g++ )
+        {
+            for( int b = 0; b < 4; b++ )
+            {
+                bool b_full = ( r == 0 || r == 3 ) && ( g == 0 || g == 3 ) &&
+                              ( b == 0 || b == 3 );
+                bool b_half = ( r == 0 || r == 2 ) && ( g == 0 || g == 2 ) &&
+                              ( b == 0 || b == 2 );
+                if( b_full || b_half )
+                {
+                    continue;
+                }
+                p_table[i++] = 0xff000000 | levels[r] << 16 |
+                               levels[g] << 8 | levels[b];
+            }
+        }
+    }
+
+    /* and the same colors at half transparency */
+    for( int j = 0; i < 128; j++ )
+    {
+        if( j == 8 )
+        {
+            continue;
+        }
+        p_table[i++] = 0x80000000 | ( p_table[j] & 0xffffff );
+    }
+}
+
+/*****************************************************************************
+ * Blending, premultiplied alpha "over"
+ *****************************************************************************/
+static inline uint32_t render_blend1( uint32_t i_dst, uint32_t i_color, unsigned int a )
+{
+    /* a is the coverage of the color, its own alpha included */
+    uint32_t i_out = 0;
+    for( int i_shift = 0; i_shift < 32; i_shift += 8 )
+    {
+        unsigned int s = ( i_shift == 24 ? 255 : i_color >> i_shift ) & 0xff;
+        unsigned int d = ( i_dst >> i_shift ) & 0xff;
+        i_out |= (uint32_t) DIV255( s * a + d * ( 255 - a ) ) << i_shift;
+    }
+    return i_out;
+}
+
+#ifdef __SSE2__
+static inline __m128i render_div255_sse2( __m128i x )
+{
+    x = _mm_add_epi16( x, _mm_set1_epi16( 128 ) );
+    return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+}
+
+/* Blends 4 ARGB pixels, a holds their alphas in its 4 low 16 bits lanes
+ * and src the 16 bits channels of the opaque color, twice */
+static inline __m128i render_blend4_sse2( __m128i d, __m128i a, __m128i src )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ff = _mm_set1_epi16( 255 );
+
+    a = _mm_unpacklo_epi16( a, a );
+    __m128i a01 = _mm_unpacklo_epi32( a, a );
+    __m128i a23 = _mm_unpackhi_epi32( a, a );
+
+    __m128i dlo = _mm_unpacklo_epi8( d, zero );
+    __m128i dhi = _mm_unpackhi_epi8( d, zero );
+    dlo = _mm_add_epi16( _mm_mullo_epi16( src, a01 ),
+                         _mm_mullo_epi16( dlo, _mm_sub_epi16( ff, a01 ) ) );
+    dhi = _mm_add_epi16( _mm_mullo_epi16( src, a23 ),
+                         _mm_mullo_epi16( dhi, _mm_sub_epi16( ff, a23 ) ) );
+    return _mm_packus_epi16( render_div255_sse2( dlo ), render_div255_sse2( dhi ) );
+}
+#endif
+
+/* p_cov == NULL blends a constant coverage of 255 */
+static void render_blend_argb( uint32_t *p_dst, const uint8_t *p_cov, int i_count,
+                               uint32_t i_color )
+{
+    unsigned int i_alpha = i_color >> 24;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i src = _mm_unpacklo_epi8(
+            _mm_set1_epi32( (int) ( i_color | 0xff000000 ) ), zero );
+    const __m128i alpha = _mm_set1_epi16( i_alpha );
+    for( ; i + 4 <= i_count; i += 4 )
+    {
+        __m128i a = alpha;
+        if( p_cov != NULL )
+        {
+            uint32_t i_cov4;
+            memcpy( &i_cov4, &p_cov[i], 4 );
+            if( i_cov4 == 0 )
+            {
+                continue;
+            }
+            a = _mm_unpacklo_epi8( _mm_cvtsi32_si128( i_cov4 ), zero );
+            a = render_div255_sse2( _mm_mullo_epi16( a, alpha ) );
+        }
+        __m128i d = _mm_loadu_si128( (const __m128i*) &p_dst[i] );
+        _mm_storeu_si128( (__m128i*) &p_dst[i], render_blend4_sse2( d, a, src ) );
+    }
+#endif
+
+    for( ; i < i_count; i++ )
+    {
+        unsigned int a = p_cov ? DIV255( p_cov[i] * i_alpha ) : i_alpha;
+        if( a == 255 )
+        {
+            p_dst[i] = i_color | 0xff000000;
+        }
+        else if( a != 0 )
+        {
+            p_dst[i] = render_blend1( p_dst[i], i_color, a );
+        }
+    }
+}
+
+static void render_blend_a8( uint8_t *p_dst, const uint8_t *p_cov, int i_count,
+                             unsigned int i_alpha )
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ff = _mm_set1_epi16( 255 );
+    const __m128i alpha = _mm_set1_epi16( i_alpha );
+    for( ; i + 8 <= i_count; i += 8 )
+    {
+        __m128i a = alpha;
+        if( p_cov != NULL )
+        {
+            a = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) &p_cov[i] ), zero );
+            a = render_div255_sse2( _mm_mullo_epi16( a, alpha ) );
+        }
+        __m128i d = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) &p_dst[i] ), zero );
+        d = _mm_add_epi16( _mm_mullo_epi16( a, ff ),
+                           _mm_mullo_epi16( d, _mm_sub_epi16( ff, a ) ) );
+        d = _mm_packus_epi16( render_div255_sse2( d ), zero );
+        _mm_storel_epi64( (__m128i*) &p_dst[i], d );
+    }
+#endif
+
+    for( ; i < i_count; i++ )
+    {
+        unsigned int a = p_cov ? DIV255( p_cov[i] * i_alpha ) : i_alpha;
+        p_dst[i] = DIV255( a * 255 + p_dst[i] * ( 255 - a ) );
+    }
+}
+
+/* Blends a coverage bitmap (or a plain rectangle when p_alpha is NULL)
+ * at x, y with clipping */
+static void render_blit( arib_surface_t *p_surface,
+                         int x, int y, int i_width, int i_height,
+                         const uint8_t *p_alpha, int i_pitch, uint32_t i_color )
+{
+    if( ( i_color >> 24 ) == 0 )
+    {
+        return;
+    }
+
+    int i_skip_x = x < 0 ? -x : 0;
+    int i_skip_y = y < 0 ? -y : 0;
+    if( x + i_width > p_surface->i_width )
+    {
+        i_width = p_surface->i_width - x;
+    }
+    if( y + i_height > p_surface->i_height )
+    {
+        i_height = p_surface->i_height - y;
+    }
+    int i_count = i_width - i_skip_x;
+    if( i_count <= 0 )
+    {
+        return;
+    }
+
+    for( int j = i_skip_y; j < i_height; j++ )
+    {
+        uint8_t *p_line = p_surface->p_pixels + (size_t) ( y + j ) * p_surface->i_pitch;
+        const uint8_t *p_cov = p_alpha ? p_alpha + j * i_pitch + i_skip_x : NULL;
+        if( p_surface->i_format == ARIB_SURFACE_A8 )
+        {
+            render_blend_a8( p_line + x + i_skip_x, p_cov, i_count, i_color >> 24 );
+        }
+        else
+        {
+            render_blend_argb( (uint32_t*) p_line + x + i_skip_x, p_cov, i_count,
+                               i_color );
+        }
+    }
+}
+
+/*****************************************************************************
+ * Glyphs
+ *****************************************************************************/
+#ifdef HAVE_FREETYPE
+static void render_rasterize( arib_renderer_t *p_renderer, render_glyph_t *p_glyph,
+                              int i_width, int i_height )
+{
+    FT_Face p_face = p_renderer->p_face;
+
+    if( p_renderer->i_face_size != p_glyph->i_size )
+    {
+        if( FT_Set_Pixel_Sizes( p_face, i_width, i_height ) )
+        {
+            return;
+        }
+        p_renderer->i_face_size = p_glyph->i_size;
+    }
+    if( FT_Load_Char( p_face, p_glyph->uc, FT_LOAD_RENDER ) )
+    {
+        return;
+    }
+
+    FT_GlyphSlot p_slot = p_face->glyph;
+    FT_Bitmap *p_bitmap = &p_slot->bitmap;
+    if( p_bitmap->pixel_mode != FT_PIXEL_MODE_GRAY ||
+        p_bitmap->width == 0 || p_bitmap->rows == 0 )
+    {
+        return;
+    }
+
+    uint8_t *p_alpha = (uint8_t*) arib_malloc( p_renderer->p_instance,
+                                               p_bitmap->width * p_bitmap->rows );
+    if( p_alpha == NULL )
+    {
+        return;
+    }
+    for( unsigned int j = 0; j < p_bitmap->rows; j++ )
+    {
+        memcpy( p_alpha + j * p_bitmap->width,
+                p_bitmap->buffer + (int) j * p_bitmap->pitch, p_bitmap->width );
+    }
+
+    /* centered in the box, baseline at the ascender share of its height */
+    int i_ascender = p_face->size->metrics.ascender >> 6;
+    int i_descender = -( p_face->size->metrics.descender >> 6 );
+    int i_baseline = i_ascender + i_descender > 0 ?
+        i_height * i_ascender / ( i_ascender + i_descender ) : i_height;
+    int i_advance = p_slot->advance.x >> 6;
+
+    p_glyph->i_left = p_slot->bitmap_left + ( i_width - i_advance ) / 2;
+    p_glyph->i_top = i_baseline - p_slot->bitmap_top;
+    p_glyph->i_width = p_bitmap->width;
+    p_glyph->i_height = p_bitmap->rows;
+    p_glyph->p_alpha = p_alpha;
+}
+#endif
+
+static const render_glyph_t * render_get_glyph( arib_renderer_t *p_renderer,
+                                                uint32_t uc,
+                                                int i_width, int i_height )
+{
+    uint32_t i_size = (uint32_t) i_width << 16 | (uint32_t) i_height;
+    uint32_t i_hash = ( uc * 2654435761u ) ^ ( i_size * 40503u );
+    render_glyph_t *p_glyph = NULL;
+
+    for( int i = 0; i < RENDER_CACHE_PROBE; i++ )
+    {
+        render_glyph_t *p_slot =
+            &p_renderer->glyph_cache[( i_hash + i ) & ( RENDER_CACHE_SIZE - 1 )];
+        if( p_slot->i_size == i_size && p_slot->uc == uc )
+        {
+            return p_slot;
+        }
+        if( p_slot->i_size == 0 )
+        {
+            p_glyph = p_slot;
+            break;
+        }
+    }
+    if( p_glyph == NULL )
+    {
+        p_glyph = &p_renderer->glyph_cache[i_hash & ( RENDER_CACHE_SIZE - 1 )];
+        arib_free( p_renderer->p_instance, p_glyph->p_alpha );
+    }
+
+    /* a glyph missing from the font is cached empty */
+    memset( p_glyph, 0, sizeof(*p_glyph) );
+    p_glyph->uc = uc;
+    p_glyph->i_size = i_size;
+#ifdef HAVE_FREETYPE
+    if( p_renderer->p_face != NULL )
+    {
+        render_rasterize( p_renderer, p_glyph, i_width, i_height );
+    }
+#endif
+    return p_glyph;
+}
+
+/* Nearest neighbour scaling of a DRCS pattern to the glyph box */
+static const uint8_t * render_scale_drcs( arib_renderer_t *p_renderer,
+                                          const drcs_glyph_t *p_drcs,
+                                          int i_width, int i_height )
+{
+    size_t i_size = (size_t) i_width * i_height;
+    if( p_renderer->i_scratch < i_size )
+    {
+        uint8_t *p_scratch = (uint8_t*) arib_realloc( p_renderer->p_instance,
+                                                      p_renderer->p_scratch, i_size );
+        if( p_scratch == NULL )
+        {
+            return NULL;
+        }
+        p_renderer->p_scratch = p_scratch;
+        p_renderer->i_scratch = i_size;
+    }
+
+    uint8_t *p_dst = p_renderer->p_scratch;
+    for( int j = 0; j < i_height; j++ )
+    {
+        const uint8_t *p_src = p_drcs->p_alpha +
+            ( j * p_drcs->i_height / i_height ) * p_drcs->i_width;
+        for( int i = 0; i < i_width; i++ )
+        {
+            *p_dst++ = p_src[i * p_drcs->i_width / i_width];
+        }
+    }
+    return p_renderer->p_scratch;
+}
+
+static void render_glyph( arib_surface_t *p_surface, int x, int y,
+                          const uint8_t *p_alpha, int i_width, int i_height,
+                          int i_ornament, int i_offset,
+                          uint32_t i_color, uint32_t i_ornament_color )
+{
+    switch( i_ornament )
+    {
+        case 1: /* hemming */
+        case 3: /* hollow */
+            for( int dy = -i_offset; dy <= i_offset; dy += i_offset )
+            {
+                for( int dx = -i_offset; dx <= i_offset; dx += i_offset )
+                {
+                    if( dx || dy )
+                    {
+                        render_blit( p_surface, x + dx, y + dy, i_width, i_height,
+                                     p_alpha, i_width, i_ornament_color );
+                    }
+                }
+            }
+            if( i_ornament == 3 )
+            {
+                return;
+            }
+            break;
+        case 2: /* shade */
+            render_blit( p_surface, x + i_offset, y + i_offset, i_width, i_height,
+                         p_alpha, i_width, i_ornament_color );
+            break;
+        default:
+            break;
+    }
+    render_blit( p_surface, x, y, i_width, i_height, p_alpha, i_width, i_color );
+}
+
+static uint32_t render_utf8_next( const unsigned char **pp, const unsigned char *p_end )
+{
+    const unsigned char *p = *pp;
+    uint32_t uc = *p++;
+    int i_extra = uc >= 0xf0 ? 3 : uc >= 0xe0 ? 2 : uc >= 0xc0 ? 1 : 0;
+    if( i_extra )
+    {
+        uc &= 0x3f >> i_extra;
+    }
+    while( i_extra-- > 0 && p < p_end )
+    {
+        uc = uc << 6 | ( *p++ & 0x3f );
+    }
+    *pp = p;
+    return uc;
+}
+
+#ifdef HAVE_FREETYPE
+static void * render_ft_alloc( FT_Memory p_memory, long i_size )
+{
+    return arib_malloc( (arib_instance_t*) p_memory->user, i_size );
+}
+
+static void render_ft_free( FT_Memory p_memory, void *p_block )
+{
+    arib_free( (arib_instance_t*) p_memory->user, p_block );
+}
+
+static void * render_ft_realloc( FT_Memory p_memory, long i_cur_size,
+                                 long i_new_size, void *p_block )
+{
+    (void) i_cur_size;
+    return arib_realloc( (arib_instance_t*) p_memory->user, p_block, i_new_size );
+}
+#endif
+
+/*****************************************************************************
+ * Public API
+ *****************************************************************************/
+arib_renderer_t * arib_renderer_new( arib_instance_t *p_instance,
+                                     const char *psz_font_file )
+{
+    arib_renderer_t *p_renderer = arib_calloc( p_instance, 1, sizeof(*p_renderer) );
+    if( p_renderer == NULL )
+    {
+        return NULL;
+    }
+    p_renderer->p_instance = p_instance;
+    render_init_cmla_table( p_renderer->cmla_table );
+
+    if( psz_font_file == NULL )
+    {
+        return p_renderer;
+    }
+#ifdef HAVE_FREETYPE
+    p_renderer->ft_memory.user = p_instance;
+    p_renderer->ft_memory.alloc = render_ft_alloc;
+    p_renderer->ft_memory.free = render_ft_free;
+    p_renderer->ft_memory.realloc = render_ft_realloc;
+    if( FT_New_Library( &p_renderer->ft_memory, &p_renderer->p_library ) )
+    {
+        arib_log( p_instance, ARIB_LOG_ERROR, "FreeType initialization failed" );
+        arib_free( p_instance, p_renderer );
+        return NULL;
+    }
+    FT_Add_Default_Modules( p_renderer->p_library );
+    if( FT_New_Face( p_renderer->p_library, psz_font_file, 0, &p_renderer->p_face ) )
+    {
+        arib_log( p_instance, ARIB_LOG_ERROR,
+                  "Failed loading font file %s", psz_font_file );
+        FT_Done_Library( p_renderer->p_library );
+        arib_free( p_instance, p_renderer );
+        return NULL;
+    }
+#else
+    arib_log( p_instance, ARIB_LOG_WARNING,
+              "Built without FreeType, font file %s is ignored", psz_font_file );
+#endif
+    return p_renderer;
+}
+
+void arib_renderer_free( arib_renderer_t *p_renderer )
+{
+    if( p_renderer == NULL )
+    {
+        return;
+    }
+    arib_instance_t *p_instance = p_renderer->p_instance;
+    for( int i = 0; i < RENDER_CACHE_SIZE; i++ )
+    {
+        arib_free( p_instance, p_renderer->glyph_cache[i].p_alpha );
+    }
+#ifdef HAVE_FREETYPE
+    if( p_renderer->p_face != NULL )
+    {
+        FT_Done_Face( p_renderer->p_face );
+    }
+    if( p_renderer->p_library != NULL )
+    {
+        FT_Done_Library( p_renderer->p_library );
+    }
+#endif
+    arib_free( p_instance, p_renderer->p_scratch );
+    arib_free( p_instance, p_renderer );
+}
+
+int arib_render( arib_renderer_t *p_renderer, arib_decoder_t *p_decoder,
+                 const char *psz_text, arib_surface_t *p_surface )
+{
+    const arib_buf_region_t *p_region = arib_decoder_get_regions( p_decoder );
+    if( p_region == NULL || p_region->i_planewidth <= 0 ||
+        p_region->i_planeheight <= 0 )
+    {
+        return 0;
+    }
+
+    /* plane coordinates to surface pixels */
+    const int i_plane_w = p_region->i_planewidth;
+    const int i_plane_h = p_region->i_planeheight;
+    const int i_surf_w = p_surface->i_width;
+    const int i_surf_h = p_surface->i_height;
+#define SX( v ) ( (int) ( (int64_t) (v) * i_surf_w / i_plane_w ) )
+#define SY( v ) ( (int) ( (int64_t) (v) * i_surf_h / i_plane_h ) )
+
+    const drcs_set_t *p_drcs = decoder_get_drcs( p_decoder );
+    const drcs_glyph_t *p_drcs_table = p_drcs->glyph_table;
+    const int i_drcs_num = p_drcs->i_num;
+    const uint32_t *p_cmla = p_renderer->cmla_table;
+
+    size_t i_runs;
+    const arib_styled_run_t *p_runs = arib_decoder_get_runs( p_decoder, &i_runs );
+    int i_drawn = 0;
+
+    for( size_t r = 0; r < i_runs; r++ )
+    {
+        const arib_styled_run_t *p_run = &p_runs[r];
+        uint32_t i_style = p_run->i_style;
+        uint32_t i_fg = p_cmla[ARIB_STYLE_GET( i_style, FOREGROUND )];
+        uint32_t i_bg = p_cmla[ARIB_STYLE_GET( i_style, BACKGROUND )];
+        uint32_t i_orn = p_cmla[ARIB_STYLE_GET( i_style, ORNAMENT_COLOR )];
+        int i_ornament = ARIB_STYLE_GET( i_style, ORNAMENT );
+        int i_highlight = ARIB_STYLE_GET( i_style, HIGHLIGHT );
+        bool b_conceal = ARIB_STYLE_GET( i_style, CONCEAL );
+        if( ARIB_STYLE_GET( i_style, POLARITY ) != 0 )
+        {
+            uint32_t i_tmp = i_fg;
+            i_fg = i_bg;
+            i_bg = i_tmp;
+        }
+
+        const int i_charwidth = p_run->i_fontwidth + p_run->i_horint;
+        const int i_charheight = p_run->i_fontheight + p_run->i_verint;
+        const int i_top = p_run->i_charbottom - i_charheight;
+        const int i_glyph_w = SX( p_run->i_fontwidth );
+        const int i_glyph_h = SY( p_run->i_fontheight );
+        const int i_glyph_y = SY( i_top + p_run->i_verint / 2 );
+        const int i_line = i_surf_h >= i_plane_h ? SY( 1 ) : 1;
+        if( i_glyph_w <= 0 || i_glyph_h <= 0 )
+        {
+            continue;
+        }
+
+        const unsigned char *p = (const unsigned char*) psz_text + p_run->i_offset;
+        const unsigned char *p_end = p + p_run->i_length;
+        int i_left = p_run->i_charleft - i_charwidth;
+        for( ; p < p_end; i_left += i_charwidth )
+        {
+            uint32_t uc = render_utf8_next( &p, p_end );
+            int x0 = SX( i_left ), x1 = SX( i_left + i_charwidth );
+            int y0 = SY( i_top ), y1 = SY( p_run->i_charbottom );
+
+            render_blit( p_surface, x0, y0, x1 - x0, y1 - y0, NULL, 0, i_bg );
+
+            if( !b_conceal )
+            {
+                int x = SX( i_left + p_run->i_horint / 2 );
+                const drcs_glyph_t *p_drcs = NULL;
+                if( p_run->i_drcs > 0 && p_run->i_drcs <= i_drcs_num &&
+                    p_drcs_table[p_run->i_drcs - 1].p_alpha != NULL )
+                {
+                    p_drcs = &p_drcs_table[p_run->i_drcs - 1];
+                }
+
+                if( p_drcs != NULL )
+                {
+                    const uint8_t *p_alpha = render_scale_drcs( p_renderer, p_drcs,
+                                                                i_glyph_w, i_glyph_h );
+                    if( p_alpha != NULL )
+                    {
+                        render_glyph( p_surface, x, i_glyph_y, p_alpha,
+                                      i_glyph_w, i_glyph_h, i_ornament, i_line,
+                                      i_fg, i_orn );
+                    }
+                }
+                else
+                {
+                    const render_glyph_t *p_glyph =
+                        render_get_glyph( p_renderer, uc, i_glyph_w, i_glyph_h );
+                    if( p_glyph->p_alpha != NULL )
+                    {
+                        render_glyph( p_surface, x + p_glyph->i_left,
+                                      i_glyph_y + p_glyph->i_top, p_glyph->p_alpha,
+                                      p_glyph->i_width, p_glyph->i_height,
+                                      i_ornament, i_line, i_fg, i_orn );
+                    }
+                }
+            }
+
+            /* HLC enclosure: bottom, right, top, left */
+            if( i_highlight & 0x01 )
+                render_blit( p_surface, x0, y1 - i_line, x1 - x0, i_line, NULL, 0, i_fg );
+            if( i_highlight & 0x02 )
+                render_blit( p_surface, x1 - i_line, y0, i_line, y1 - y0, NULL, 0, i_fg );
+            if( i_highlight & 0x04 )
+                render_blit( p_surface, x0, y0, x1 - x0, i_line, NULL, 0, i_fg );
+            if( i_highlight & 0x08 )
+                render_blit( p_surface, x0, y0, i_line, y1 - y0, NULL, 0, i_fg );
+
+            i_drawn++;
+        }
+    }
+#undef SX
+#undef SY
+
+    return i_drawn;
+}
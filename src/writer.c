@@ -0,0 +1,248 @@
+/*****************************************************************************
+ * writer.c : ARIB STD-B24 caption bitstream writer
+ *****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "aribb24/aribb24.h"
+#include "aribb24/parser.h"
+#include "aribb24/writer.h"
+#include "aribb24/bits.h"
+
+/* CRC_16 of ITU-T X.25 without inversion: x^16 + x^12 + x^5 + 1,
+ * initial value 0, ARIB STD-B24 VOLUME 1 Part 3 Chapter 9.2 */
+static uint16_t writer_crc16( const uint8_t *p, size_t i_size )
+{
+    static const uint16_t crc_nibble[16] =
+    {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    };
+    uint16_t i_crc = 0;
+    for( size_t i = 0; i < i_size; i++ )
+    {
+        i_crc = ( i_crc << 4 ) ^ crc_nibble[( i_crc >> 12 ) ^ ( p[i] >> 4 )];
+        i_crc = ( i_crc << 4 ) ^ crc_nibble[( i_crc >> 12 ) ^ ( p[i] & 0x0f )];
+    }
+    return i_crc;
+}
+
+static void writer_bytes( bs_t *p_bs, const uint8_t *p, size_t i_size )
+{
+    /* units and groups are byte aligned */
+    memcpy( p_bs->p, p, i_size );
+    p_bs->p += i_size;
+}
+
+/* 90 kHz to 36 bits BCD hours, minutes, seconds and milliseconds */
+static void writer_time( bs_t *p_bs, int64_t i_time )
+{
+    static const int digits[4] = { 2, 2, 2, 3 };
+    int64_t i_ms = i_time / 90;
+    int64_t i_value[4] = { i_ms / 3600000 % 100, i_ms / 60000 % 60,
+                           i_ms / 1000 % 60, i_ms % 1000 };
+    for( int i = 0; i < 4; i++ )
+    {
+        int i_div = digits[i] == 3 ? 100 : 10;
+        for( int j = 0; j < digits[i]; j++, i_div /= 10 )
+        {
+            bs_write( p_bs, 4, i_value[i] / i_div % 10 );
+        }
+    }
+}
+
+static bool writer_is_management( const arib_caption_group_t *p_group )
+{
+    return ( p_group->i_group_id & 0x0f ) == 0;
+}
+
+static bool writer_has_time( const arib_caption_group_t *p_group )
+{
+    if( writer_is_management( p_group ) )
+    {
+        return p_group->i_tmd == ARIB_TMD_OFFSET;
+    }
+    return p_group->i_tmd == ARIB_TMD_REALTIME || p_group->i_tmd == ARIB_TMD_OFFSET;
+}
+
+static size_t writer_units_size( const arib_caption_group_t *p_group )
+{
+    size_t i_size = 0;
+    for( size_t i = 0; i < p_group->i_units; i++ )
+    {
+        i_size += 5 + p_group->p_units[i].i_data;
+    }
+    return i_size;
+}
+
+static size_t writer_group_data_size( const arib_caption_group_t *p_group )
+{
+    size_t i_size = 1 + 3 + writer_units_size( p_group );
+    if( writer_has_time( p_group ) )
+    {
+        i_size += 5;
+    }
+    if( writer_is_management( p_group ) )
+    {
+        i_size += 1;
+        for( int i = 0; i < p_group->i_languages; i++ )
+        {
+            uint8_t i_dmf = p_group->p_languages[i].i_dmf;
+            i_size += i_dmf >= 0x0c && i_dmf <= 0x0e ? 6 : 5;
+        }
+    }
+    return i_size;
+}
+
+size_t arib_write_data_group( const arib_caption_group_t *p_group,
+                              uint8_t *p_buf, size_t i_size )
+{
+    size_t i_data = writer_group_data_size( p_group );
+    size_t i_units = writer_units_size( p_group );
+    if( i_data > 0xffff || i_units > 0xffffff || i_size < 5 + i_data + 2 )
+    {
+        return 0;
+    }
+    for( size_t i = 0; i < p_group->i_units; i++ )
+    {
+        if( p_group->p_units[i].i_data > 0xffffff )
+        {
+            return 0;
+        }
+    }
+
+    bs_t bs;
+    bs_init( &bs, p_buf, i_size );
+    bs_write( &bs, 6, p_group->i_group_id );
+    bs_write( &bs, 2, p_group->i_version );
+    bs_write( &bs, 8, 0 ); /* data_group_link_number */
+    bs_write( &bs, 8, 0 ); /* last_data_group_link_number */
+    bs_write( &bs, 16, i_data );
+
+    bs_write( &bs, 2, p_group->i_tmd );
+    bs_write( &bs, 6, 0x3f ); /* Reserved */
+    if( writer_has_time( p_group ) )
+    {
+        writer_time( &bs, p_group->i_time ); /* OTM or STM */
+        bs_write( &bs, 4, 0xf ); /* Reserved */
+    }
+    if( writer_is_management( p_group ) )
+    {
+        bs_write( &bs, 8, p_group->i_languages );
+        for( int i = 0; i < p_group->i_languages; i++ )
+        {
+            const arib_caption_language_t *p_lang = &p_group->p_languages[i];
+            bs_write( &bs, 3, p_lang->i_language_tag );
+            bs_write( &bs, 1, 1 ); /* Reserved */
+            bs_write( &bs, 4, p_lang->i_dmf );
+            if( p_lang->i_dmf >= 0x0c && p_lang->i_dmf <= 0x0e )
+            {
+                bs_write( &bs, 8, p_lang->i_dc );
+            }
+            for( int j = 0; j < 3; j++ )
+            {
+                bs_write( &bs, 8, (uint8_t) p_lang->language_code[j] );
+            }
+            bs_write( &bs, 4, p_lang->i_format );
+            bs_write( &bs, 2, p_lang->i_tcs );
+            bs_write( &bs, 2, p_lang->i_rollup_mode );
+        }
+    }
+
+    bs_write( &bs, 24, i_units ); /* data_unit_loop_length */
+    for( size_t i = 0; i < p_group->i_units; i++ )
+    {
+        const arib_data_unit_t *p_unit = &p_group->p_units[i];
+        bs_write( &bs, 8, 0x1f ); /* unit_separator */
+        bs_write( &bs, 8, p_unit->i_parameter );
+        bs_write( &bs, 24, p_unit->i_data );
+        writer_bytes( &bs, p_unit->p_data, p_unit->i_data );
+    }
+
+    bs_write( &bs, 16, writer_crc16( p_buf, 5 + i_data ) );
+    return bs.p - bs.p_start;
+}
+
+size_t arib_write_pes_data( const arib_caption_group_t *p_group,
+                            uint8_t i_data_identifier,
+                            uint8_t *p_buf, size_t i_size )
+{
+    if( i_size < 3 )
+    {
+        return 0;
+    }
+
+    bs_t bs;
+    bs_init( &bs, p_buf, i_size );
+    bs_write( &bs, 8, i_data_identifier );
+    bs_write( &bs, 8, 0xff ); /* private_stream_id */
+    bs_write( &bs, 4, 0xf ); /* reserved */
+    bs_write( &bs, 4, 0 ); /* PES_data_packet_header_length */
+
+    size_t i_group = arib_write_data_group( p_group, bs.p, i_size - 3 );
+    return i_group ? 3 + i_group : 0;
+}
+
+size_t arib_write_pes( const arib_caption_group_t *p_group, int64_t i_pts,
+                       uint8_t *p_buf, size_t i_size )
+{
+    /* asynchronous PES are private_stream_2, which has no optional header */
+    size_t i_header = i_pts >= 0 ? 14 : 6;
+    if( i_size < i_header )
+    {
+        return 0;
+    }
+
+    size_t i_data = arib_write_pes_data( p_group,
+                                         i_pts >= 0 ? ARIB_PES_SYNCHRONIZED
+                                                    : ARIB_PES_ASYNCHRONOUS,
+                                         p_buf + i_header, i_size - i_header );
+    size_t i_packet = i_header - 6 + i_data;
+    if( i_data == 0 || i_packet > 0xffff )
+    {
+        return 0;
+    }
+
+    bs_t bs;
+    bs_init( &bs, p_buf, i_header );
+    bs_write( &bs, 24, 0x000001 ); /* packet_start_code_prefix */
+    if( i_pts < 0 )
+    {
+        bs_write( &bs, 8, 0xbf ); /* private_stream_2 */
+        bs_write( &bs, 16, i_packet );
+    }
+    else
+    {
+        bs_write( &bs, 8, 0xbd ); /* private_stream_1 */
+        bs_write( &bs, 16, i_packet );
+        bs_write( &bs, 8, 0x84 ); /* '10', data_alignment_indicator */
+        bs_write( &bs, 8, 0x80 ); /* PTS_DTS_flags */
+        bs_write( &bs, 8, i_header - 9 ); /* PES_header_data_length */
+        i_pts &= ARIB_PTS_MASK;
+        bs_write( &bs, 4, 0x2 );
+        bs_write( &bs, 3, i_pts >> 30 );
+        bs_write( &bs, 1, 1 );
+        bs_write( &bs, 15, i_pts >> 15 );
+        bs_write( &bs, 1, 1 );
+        bs_write( &bs, 15, i_pts );
+        bs_write( &bs, 1, 1 );
+    }
+    return i_header + i_data;
+}